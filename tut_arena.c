@@ -0,0 +1,79 @@
+#include "tut_arena.h"
+#include "tut_util.h"
+
+#define ALIGNMENT	16
+#define ALIGN(size)	(((size) + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1))
+
+// Chunk data starts right after the (aligned) header
+#define HEADER_SIZE	ALIGN(sizeof(TutArenaChunk))
+
+void Tut_InitArena(TutArena* arena)
+{
+	arena->head = NULL;
+}
+
+static TutArenaChunk* AddChunk(TutArena* arena, size_t size)
+{
+	TutArenaChunk* chunk = Tut_Malloc(HEADER_SIZE + size);
+	
+	chunk->size = size;
+	chunk->used = 0;
+	chunk->next = arena->head;
+
+	arena->head = chunk;
+
+	return chunk;
+}
+
+void* Tut_ArenaAlloc(TutArena* arena, size_t size)
+{
+	size = ALIGN(size);
+
+	TutArenaChunk* chunk = arena->head;
+
+	if (!chunk || chunk->used + size > chunk->size)
+	{
+		// Big allocations get a chunk of their own so the current one isn't wasted
+		if (size > TUT_ARENA_CHUNK_SIZE / 4)
+		{
+			chunk = Tut_Malloc(HEADER_SIZE + size);
+
+			chunk->size = size;
+			chunk->used = size;
+
+			if (arena->head)
+			{
+				chunk->next = arena->head->next;
+				arena->head->next = chunk;
+			}
+			else
+			{
+				chunk->next = NULL;
+				arena->head = chunk;
+			}
+
+			return (uint8_t*)chunk + HEADER_SIZE;
+		}
+
+		chunk = AddChunk(arena, TUT_ARENA_CHUNK_SIZE);
+	}
+
+	void* mem = (uint8_t*)chunk + HEADER_SIZE + chunk->used;
+	chunk->used += size;
+
+	return mem;
+}
+
+void Tut_DestroyArena(TutArena* arena)
+{
+	TutArenaChunk* chunk = arena->head;
+
+	while (chunk)
+	{
+		TutArenaChunk* next = chunk->next;
+		Tut_Free(chunk);
+		chunk = next;
+	}
+
+	arena->head = NULL;
+}
@@ -0,0 +1,29 @@
+#ifndef TUT_ARENA_H
+#define TUT_ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TUT_ARENA_CHUNK_SIZE	(64 * 1024)
+
+typedef struct TutArenaChunk
+{
+	struct TutArenaChunk* next;
+	size_t size, used;
+} TutArenaChunk;
+
+// Bump allocator; individual allocations are never freed, everything goes
+// away at once in Tut_DestroyArena
+typedef struct
+{
+	TutArenaChunk* head;
+} TutArena;
+
+void Tut_InitArena(TutArena* arena);
+
+// Memory is aligned for any type (but not zeroed)
+void* Tut_ArenaAlloc(TutArena* arena, size_t size);
+
+void Tut_DestroyArena(TutArena* arena);
+
+#endif
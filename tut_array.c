@@ -59,6 +59,12 @@ void* Tut_ArrayGet(TutArray* array, size_t index)
 	return &array->data[index * array->datumSize];
 }
 
+const void* Tut_ArrayGetConst(const TutArray* array, size_t index)
+{
+	assert(index >= 0 && index < array->length);
+	return &array->data[index * array->datumSize];
+}
+
 void Tut_ArraySet(TutArray* array, size_t index, const void* value)
 {
 	assert(index >= 0 && index < array->length);
@@ -27,6 +27,9 @@ void Tut_ArrayResize(TutArray* array, size_t length, const void* init);
 void* Tut_ArrayGet(TutArray* array, size_t index);
 #define TUT_ARRAY_GET_VALUE(array, index, type) (*(type*)Tut_ArrayGet((array), (index)))
 
+const void* Tut_ArrayGetConst(const TutArray* array, size_t index);
+#define TUT_ARRAY_GET_CONST_VALUE(array, index, type) (*(type const*)Tut_ArrayGetConst((array), (index)))
+
 void Tut_ArraySet(TutArray* array, size_t index, const void* value);
 
 void Tut_ArrayPush(TutArray* array, const void* value);
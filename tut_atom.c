@@ -0,0 +1,120 @@
+#include <string.h>
+#include <stddef.h>
+
+#include "tut_atom.h"
+#include "tut_hash.h"
+#include "tut_util.h"
+
+#define ATOM_CHUNK_SIZE		(64 * 1024)
+
+// Header stored right in front of the characters of every atom
+typedef struct
+{
+	uint32_t hash;
+	uint32_t length;
+	char string[];
+} AtomData;
+
+#define ATOM_DATA(atom) ((AtomData*)((atom) - offsetof(AtomData, string)))
+
+static AtomData** Slots = NULL;
+static uint32_t Capacity = 0;
+static uint32_t Count = 0;
+
+// Atoms are carved out of big chunks which are never freed
+static char* Chunk = NULL;
+static size_t ChunkUsed = 0;
+
+static AtomData* AllocAtom(size_t length)
+{
+	size_t size = offsetof(AtomData, string) + length + 1;
+	size = (size + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+
+	if (size > ATOM_CHUNK_SIZE / 4)
+		return Tut_Malloc(size);
+
+	if (!Chunk || ChunkUsed + size > ATOM_CHUNK_SIZE)
+	{
+		Chunk = Tut_Malloc(ATOM_CHUNK_SIZE);
+		ChunkUsed = 0;
+	}
+
+	AtomData* data = (AtomData*)&Chunk[ChunkUsed];
+	ChunkUsed += size;
+
+	return data;
+}
+
+static AtomData** FindSlot(AtomData** slots, uint32_t capacity, const char* string, size_t length, uint32_t hash)
+{
+	uint32_t pos = hash & (capacity - 1);
+
+	while (slots[pos])
+	{
+		AtomData* data = slots[pos];
+		if (data->hash == hash && data->length == length && memcmp(data->string, string, length) == 0)
+			break;
+
+		pos = (pos + 1) & (capacity - 1);
+	}
+
+	return &slots[pos];
+}
+
+static void Grow()
+{
+	uint32_t capacity = Capacity ? Capacity * 2 : 1024;
+	AtomData** slots = Tut_Calloc(capacity, sizeof(AtomData*));
+
+	for (uint32_t i = 0; i < Capacity; ++i)
+	{
+		AtomData* data = Slots[i];
+		if (data)
+			*FindSlot(slots, capacity, data->string, data->length, data->hash) = data;
+	}
+
+	Tut_Free(Slots);
+
+	Slots = slots;
+	Capacity = capacity;
+}
+
+TutAtom Tut_InternLength(const char* string, size_t length)
+{
+	if ((Count + 1) * 4 > Capacity * 3)
+		Grow();
+
+	uint32_t hash = Tut_HashBytes(string, length);
+	AtomData** slot = FindSlot(Slots, Capacity, string, length, hash);
+
+	if (!*slot)
+	{
+		AtomData* data = AllocAtom(length);
+
+		data->hash = hash;
+		data->length = length;
+
+		memcpy(data->string, string, length);
+		data->string[length] = '\0';
+
+		*slot = data;
+		Count += 1;
+	}
+
+	return (*slot)->string;
+}
+
+TutAtom Tut_Intern(const char* string)
+{
+	return Tut_InternLength(string, strlen(string));
+}
+
+uint32_t Tut_AtomHash(TutAtom atom)
+{
+	return ATOM_DATA(atom)->hash;
+}
+
+size_t Tut_AtomLength(TutAtom atom)
+{
+	return ATOM_DATA(atom)->length;
+}
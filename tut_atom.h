@@ -0,0 +1,18 @@
+#ifndef TUT_ATOM_H
+#define TUT_ATOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Interned string; there is only ever one atom per distinct string so atoms
+// can be compared by pointer. They are ordinary NUL terminated strings otherwise
+// and stay alive for the rest of the program.
+typedef const char* TutAtom;
+
+TutAtom Tut_Intern(const char* string);
+TutAtom Tut_InternLength(const char* string, size_t length);
+
+uint32_t Tut_AtomHash(TutAtom atom);
+size_t Tut_AtomLength(TutAtom atom);
+
+#endif
@@ -3,301 +3,593 @@
 
 #include "tut_opcodes.h"
 #include "tut_buf.h"
+#include "tut_hash.h"
 #include "tut_codegen.h"
 
-void Tut_EmitOp(TutVM* vm, uint8_t op)
+static void Reserve(TutProgram* program, uint32_t size)
 {
-	vm->code[vm->codeSize++] = op;
+	assert(!program->codeReadOnly);
+
+	if (program->codeSize + size <= program->codeCapacity)
+		return;
+
+	uint32_t capacity = program->codeCapacity ? program->codeCapacity : TUT_PROGRAM_INIT_CODE_CAPACITY;
+
+	while (capacity < program->codeSize + size)
+		capacity *= 2;
+
+	program->code = Tut_Realloc(program->code, capacity);
+	program->codeCapacity = capacity;
+}
+
+static void EmitInt8(TutProgram* program, int8_t value)
+{
+	Reserve(program, 1);
+
+	Tut_WriteInt8(program->code, program->codeSize, value);
+	program->codeSize += 1;
+}
+
+static void EmitUint16(TutProgram* program, uint16_t value)
+{
+	Reserve(program, 2);
+
+	Tut_WriteUint16(program->code, program->codeSize, value);
+	program->codeSize += 2;
+}
+
+static void EmitInt16(TutProgram* program, int16_t value)
+{
+	Reserve(program, 2);
+
+	Tut_WriteInt16(program->code, program->codeSize, value);
+	program->codeSize += 2;
+}
+
+static void EmitInt32(TutProgram* program, int32_t value)
+{
+	Reserve(program, 4);
+
+	Tut_WriteInt32(program->code, program->codeSize, value);
+	program->codeSize += 4;
 }
 
-void Tut_EmitMakeVarRef(TutVM* vm, TutBool global, int32_t index)
+static void EmitFloat(TutProgram* program, float value)
+{
+	Reserve(program, 4);
+
+	Tut_WriteFloat(program->code, program->codeSize, value);
+	program->codeSize += 4;
+}
+
+void Tut_EmitOp(TutProgram* program, uint8_t op)
+{
+	Reserve(program, 1);
+	program->code[program->codeSize++] = op;
+}
+
+void Tut_EmitMakeVarRef(TutProgram* program, TutBool global, int32_t index)
 {
 	if (global)
-		Tut_EmitOp(vm, TUT_OP_MAKEGLOBALREF);
+		Tut_EmitOp(program, TUT_OP_MAKEGLOBALREF);
 	else
-		Tut_EmitOp(vm, TUT_OP_MAKELOCALREF);
+		Tut_EmitOp(program, TUT_OP_MAKELOCALREF);
 	
-	Tut_WriteInt32(vm->code, vm->codeSize, index);
-	vm->codeSize += 4;
+	EmitInt32(program, index);
 }
 
-void Tut_EmitMakeDynRef(TutVM * vm, uint16_t offset)
+void Tut_EmitMakeDynRef(TutProgram* program, uint16_t offset)
 {
-	Tut_EmitOp(vm, TUT_OP_MAKEDYNAMICREF);
+	Tut_EmitOp(program, TUT_OP_MAKEDYNAMICREF);
 
-	Tut_WriteUint16(vm->code, vm->codeSize, offset);
-	vm->codeSize += 2;
+	EmitUint16(program, offset);
 }
 
-void Tut_EmitMakeFunc(TutVM* vm, TutBool isExtern, int32_t index)
+void Tut_EmitMakeFunc(TutProgram* program, TutBool isExtern, int32_t index)
 {
 	if (!isExtern)
-		Tut_EmitOp(vm, TUT_OP_MAKEFUNC);
+		Tut_EmitOp(program, TUT_OP_MAKEFUNC);
 	else
-		Tut_EmitOp(vm, TUT_OP_MAKEEXTERNFUNC);
+		Tut_EmitOp(program, TUT_OP_MAKEEXTERNFUNC);
 	
-	Tut_WriteInt32(vm->code, vm->codeSize, index);
-	vm->codeSize += 4;
+	EmitInt32(program, index);
 }
 
-void Tut_EmitGetRef(TutVM* vm, uint16_t count, uint16_t offset)
+void Tut_EmitGetRef(TutProgram* program, uint16_t count, uint16_t offset)
 {
 	if (count == 1)
 	{
-		Tut_EmitOp(vm, TUT_OP_GETREF1);
+		Tut_EmitOp(program, TUT_OP_GETREF1);
 	
-		Tut_WriteUint16(vm->code, vm->codeSize, offset);
-		vm->codeSize += 2;
+		EmitUint16(program, offset);
 	}
 	else
 	{
-		Tut_EmitOp(vm, TUT_OP_GETREFN);
-
-		Tut_WriteUint16(vm->code, vm->codeSize, count);
-		vm->codeSize += 2;
+		Tut_EmitOp(program, TUT_OP_GETREFN);
 
-		Tut_WriteUint16(vm->code, vm->codeSize, offset);
-		vm->codeSize += 2;
+		EmitUint16(program, count);
+		EmitUint16(program, offset);
 	}
 }
 
-void Tut_EmitSetRef(TutVM* vm, uint16_t count, uint16_t offset)
+void Tut_EmitSetRef(TutProgram* program, uint16_t count, uint16_t offset)
 {
 	if (count == 1)
 	{
-		Tut_EmitOp(vm, TUT_OP_SETREF1);
+		Tut_EmitOp(program, TUT_OP_SETREF1);
 
-		Tut_WriteUint16(vm->code, vm->codeSize, offset);
-		vm->codeSize += 2;
+		EmitUint16(program, offset);
 	}
 	else
 	{
-		Tut_EmitOp(vm, TUT_OP_SETREFN);
+		Tut_EmitOp(program, TUT_OP_SETREFN);
 
-		Tut_WriteUint16(vm->code, vm->codeSize, count);
-		vm->codeSize += 2;
-
-		Tut_WriteUint16(vm->code, vm->codeSize, offset);
-		vm->codeSize += 2;
+		EmitUint16(program, count);
+		EmitUint16(program, offset);
 	}
 }
 
-void Tut_EmitGet(TutVM* vm, TutBool global, int32_t index, uint16_t count)
+void Tut_EmitGet(TutProgram* program, TutBool global, int32_t index, uint16_t count)
 {
 	if (count == 1)
 	{
 		if (global)
-			Tut_EmitOp(vm, TUT_OP_GETGLOBAL1);
+			Tut_EmitOp(program, TUT_OP_GETGLOBAL1);
 		else
-			Tut_EmitOp(vm, TUT_OP_GETLOCAL1);
+			Tut_EmitOp(program, TUT_OP_GETLOCAL1);
 	}
 	else
 	{
 		if (global)
-			Tut_EmitOp(vm, TUT_OP_GETGLOBALN);
+			Tut_EmitOp(program, TUT_OP_GETGLOBALN);
 		else
-			Tut_EmitOp(vm, TUT_OP_GETLOCALN);
+			Tut_EmitOp(program, TUT_OP_GETLOCALN);
 
-		Tut_WriteUint16(vm->code, vm->codeSize, count);
-		vm->codeSize += 2;
+		EmitUint16(program, count);
 	}
 
-	Tut_WriteInt32(vm->code, vm->codeSize, index);
-	vm->codeSize += 4;
+	EmitInt32(program, index);
 }
 
-void Tut_EmitSet(TutVM* vm, TutBool global, int32_t index, uint16_t count)
+void Tut_EmitSet(TutProgram* program, TutBool global, int32_t index, uint16_t count)
 {
 	if (count == 1)
 	{
 		if (global)
-			Tut_EmitOp(vm, TUT_OP_SETGLOBAL1);
+			Tut_EmitOp(program, TUT_OP_SETGLOBAL1);
 		else
-			Tut_EmitOp(vm, TUT_OP_SETLOCAL1);
+			Tut_EmitOp(program, TUT_OP_SETLOCAL1);
 	}
 	else
 	{
 		if (global)
-			Tut_EmitOp(vm, TUT_OP_SETGLOBALN);
+			Tut_EmitOp(program, TUT_OP_SETGLOBALN);
 		else
-			Tut_EmitOp(vm, TUT_OP_SETLOCALN);
+			Tut_EmitOp(program, TUT_OP_SETLOCALN);
 
-		Tut_WriteUint16(vm->code, vm->codeSize, count);
-		vm->codeSize += 2;
+		EmitUint16(program, count);
 	}
 
-	Tut_WriteInt32(vm->code, vm->codeSize, index);
-	vm->codeSize += 4;
+	EmitInt32(program, index);
 }
 
-void Tut_EmitPushInt(TutVM* vm, int32_t value)
+typedef TutBool(*PoolEquals)(const TutArray* pool, int32_t index, const void* value, uint32_t length);
+
+static TutBool StringEquals(const TutArray* pool, int32_t index, const void* value, uint32_t length)
 {
-	Tut_EmitOp(vm, TUT_OP_PUSH_INT);
+	const char* str = *(const char**)&pool->data[index * sizeof(const char*)];
+	return memcmp(str, value, length + 1) == 0;
+}
 
-	int32_t index = -1;
+static void GrowPoolIndex(TutPoolIndex* index)
+{
+	uint32_t capacity = index->capacity ? index->capacity * 2 : 64;
+	TutPoolSlot* slots = Tut_Calloc(capacity, sizeof(TutPoolSlot));
 
-	for (int i = 0; i < vm->integers.length; ++i)
+	for (uint32_t i = 0; i < index->capacity; ++i)
 	{
-		if (TUT_ARRAY_GET_VALUE(&vm->integers, i, int) == value)
-		{
-			index = i;
-			break;
-		}
-	}
+		TutPoolSlot* slot = &index->slots[i];
+		if (!slot->hash) continue;
 
-	if (index < 0)
-	{
-		index = vm->integers.length;
-		Tut_ArrayPush(&vm->integers, &value);
+		uint32_t pos = slot->hash & (capacity - 1);
+		while (slots[pos].hash)
+			pos = (pos + 1) & (capacity - 1);
+
+		slots[pos] = *slot;
 	}
 
-	Tut_WriteInt32(vm->code, vm->codeSize, index);
-	vm->codeSize += 4;
+	Tut_Free(index->slots);
+
+	index->slots = slots;
+	index->capacity = capacity;
 }
 
-void Tut_EmitPushFloat(TutVM* vm, float value)
+// Returns the slot holding value, or the empty slot it should go into
+static TutPoolSlot* FindPoolSlot(TutPoolIndex* index, const TutArray* pool, const void* value, uint32_t hash, uint32_t length, PoolEquals equals)
 {
-	Tut_EmitOp(vm, TUT_OP_PUSH_FLOAT);
+	// Keep the load factor under 3/4
+	if ((index->count + 1) * 4 > index->capacity * 3)
+		GrowPoolIndex(index);
 
-	int32_t index = -1;
+	uint32_t pos = hash & (index->capacity - 1);
 
-	for (int i = 0; i < vm->floats.length; ++i)
+	while (index->slots[pos].hash)
 	{
-		if (TUT_ARRAY_GET_VALUE(&vm->floats, i, float) == value)
-		{
-			index = i;
-			break;
-		}
+		TutPoolSlot* slot = &index->slots[pos];
+
+		if (slot->hash == hash && slot->length == length && equals(pool, slot->index, value, length))
+			return slot;
+
+		pos = (pos + 1) & (index->capacity - 1);
 	}
 
-	if (index < 0)
+	return &index->slots[pos];
+}
+
+void Tut_EmitPushInt(TutProgram* program, int32_t value)
+{
+	if (value >= INT8_MIN && value <= INT8_MAX)
+	{
+		Tut_EmitOp(program, TUT_OP_PUSH_I8);
+		EmitInt8(program, (int8_t)value);
+	}
+	else
 	{
-		index = vm->floats.length;
-		Tut_ArrayPush(&vm->floats, &value);
+		Tut_EmitOp(program, TUT_OP_PUSH_I32);
+		EmitInt32(program, value);
 	}
+}
 
-	Tut_WriteInt32(vm->code, vm->codeSize, index);
-	vm->codeSize += 4;
+void Tut_EmitPushFloat(TutProgram* program, float value)
+{
+	Tut_EmitOp(program, TUT_OP_PUSH_F32);
+	EmitFloat(program, value);
 }
 
-void Tut_EmitPushStr(TutVM* vm, const char* value)
+// Returns the index of value in the string pool, adding it if necessary
+static int32_t InternString(TutProgram* program, const char* value)
 {
-	Tut_EmitOp(vm, TUT_OP_PUSH_STR);
+	uint32_t length = strlen(value);
+	uint32_t hash = Tut_HashBytes(value, length);
 
-	int32_t index = -1;
+	TutPoolSlot* slot = FindPoolSlot(&program->stringIndex, &program->strings, value, hash, length, StringEquals);
 
-	for (int i = 0; i < vm->strings.length; ++i)
-	{
-		if (strcmp(TUT_ARRAY_GET_VALUE(&vm->strings, i, const char*), value) == 0)
-		{
-			index = i;
-			break;
-		}
-	}
-
-	if (index < 0)
+	if (!slot->hash)
 	{
 		const char* str = Tut_Strdup(value);
-		
-		index = vm->strings.length;
-		Tut_ArrayPush(&vm->strings, &str);
+
+		slot->hash = hash;
+		slot->length = length;
+		slot->index = program->strings.length;
+
+		program->stringIndex.count += 1;
+		Tut_ArrayPush(&program->strings, &str);
 	}
 
-	Tut_WriteInt32(vm->code, vm->codeSize, index);
-	vm->codeSize += 4;
+	return slot->index;
+}
+
+void Tut_EmitPushStr(TutProgram* program, const char* value)
+{
+	Tut_EmitOp(program, TUT_OP_PUSH_STR);
+	EmitInt32(program, InternString(program, value));
+}
+
+void Tut_EmitLocalBinOp(TutProgram* program, uint8_t op, int16_t dst, int16_t a, int16_t b)
+{
+	Tut_EmitOp(program, op);
+
+	EmitInt16(program, dst);
+	EmitInt16(program, a);
+	EmitInt16(program, b);
+}
+
+void Tut_EmitLocalBinOpInt(TutProgram* program, uint8_t op, int16_t dst, int16_t a, int32_t k)
+{
+	Tut_EmitOp(program, op);
+
+	EmitInt16(program, dst);
+	EmitInt16(program, a);
+	EmitInt32(program, k);
+}
+
+void Tut_EmitLocalBinOpFloat(TutProgram* program, uint8_t op, int16_t dst, int16_t a, float k)
+{
+	Tut_EmitOp(program, op);
+
+	EmitInt16(program, dst);
+	EmitInt16(program, a);
+	EmitFloat(program, k);
+}
+
+int32_t Tut_EmitLocalCompareJump(TutProgram* program, uint8_t op, int16_t a, int16_t b, int32_t pc)
+{
+	Tut_EmitOp(program, op);
+
+	EmitInt16(program, a);
+	EmitInt16(program, b);
+	EmitInt32(program, pc);
+
+	return program->codeSize - 4;
+}
+
+int32_t Tut_EmitLocalCompareJumpInt(TutProgram* program, uint8_t op, int16_t a, int32_t k, int32_t pc)
+{
+	Tut_EmitOp(program, op);
+
+	EmitInt16(program, a);
+	EmitInt32(program, k);
+	EmitInt32(program, pc);
+
+	return program->codeSize - 4;
+}
+
+void Tut_EmitIncLocal(TutProgram* program, int16_t index, int32_t k)
+{
+	Tut_EmitOp(program, TUT_OP_INCLOCAL);
+
+	EmitInt16(program, index);
+	EmitInt32(program, k);
 }
 
-void Tut_EmitPush(TutVM* vm, uint16_t count)
+void Tut_EmitGetFieldLocal(TutProgram* program, int16_t index, uint16_t offset)
+{
+	Tut_EmitOp(program, TUT_OP_GETFIELD_L);
+
+	EmitInt16(program, index);
+	EmitUint16(program, offset);
+}
+
+void Tut_EmitTag(TutProgram* program, uint16_t depth, uint8_t type)
+{
+	Tut_EmitOp(program, TUT_OP_TAG);
+
+	EmitUint16(program, depth);
+	EmitInt8(program, (int8_t)type);
+}
+
+void Tut_EmitPush(TutProgram* program, uint16_t count)
 {
 	if (count == 0) return;
 
 	if (count == 1)
-		Tut_EmitOp(vm, TUT_OP_PUSH1);
+		Tut_EmitOp(program, TUT_OP_PUSH1);
 	else
 	{
-		Tut_EmitOp(vm, TUT_OP_PUSHN);
+		Tut_EmitOp(program, TUT_OP_PUSHN);
 
-		Tut_WriteUint16(vm->code, vm->codeSize, count);
-		vm->codeSize += 2;
+		EmitUint16(program, count);
 	}
 }
 
-void Tut_EmitPop(TutVM* vm, uint16_t count)
+void Tut_EmitPop(TutProgram* program, uint16_t count)
 {
 	if (count == 0) return;
 
 	if (count == 1)
-		Tut_EmitOp(vm, TUT_OP_POP1);
+		Tut_EmitOp(program, TUT_OP_POP1);
 	else
 	{
-		Tut_EmitOp(vm, TUT_OP_POPN);
+		Tut_EmitOp(program, TUT_OP_POPN);
 		
-		Tut_WriteUint16(vm->code, vm->codeSize, count);
-		vm->codeSize += 2;
+		EmitUint16(program, count);
 	}
 }
 
-void Tut_EmitMove(TutVM* vm, uint16_t numObjects, uint16_t stackSpaces)
+void Tut_EmitMove(TutProgram* program, uint16_t numObjects, uint16_t stackSpaces)
 {
 	if (numObjects == 1)
 	{
-		Tut_EmitOp(vm, TUT_OP_MOVE1);
+		Tut_EmitOp(program, TUT_OP_MOVE1);
 
-		Tut_WriteUint16(vm->code, vm->codeSize, stackSpaces);
-		vm->codeSize += 2;
+		EmitUint16(program, stackSpaces);
 	}
 	else
 	{
-		Tut_EmitOp(vm, TUT_OP_MOVEN);
+		Tut_EmitOp(program, TUT_OP_MOVEN);
 
-		Tut_WriteUint16(vm->code, vm->codeSize, numObjects);
-		vm->codeSize += 2;
-
-		Tut_WriteUint16(vm->code, vm->codeSize, stackSpaces);
-		vm->codeSize += 2;
+		EmitUint16(program, numObjects);
+		EmitUint16(program, stackSpaces);
 	}
 }
 
-void Tut_EmitCall(TutVM* vm, uint16_t nargs)
+void Tut_EmitCall(TutProgram* program, uint16_t nargs, uint16_t nret)
 {
-	Tut_EmitOp(vm, TUT_OP_CALL);
+	Tut_EmitOp(program, TUT_OP_CALL);
 
-	Tut_WriteUint16(vm->code, vm->codeSize, nargs);
-	vm->codeSize += 2;
+	EmitUint16(program, nargs);
+	EmitUint16(program, nret);
 }
 
-void Tut_EmitRetval(TutVM* vm, uint16_t count)
+void Tut_EmitRetval(TutProgram* program, uint16_t count)
 {
 	if (count == 1)
-		Tut_EmitOp(vm, TUT_OP_RETVAL1);
+		Tut_EmitOp(program, TUT_OP_RETVAL1);
 	else
 	{
-		Tut_EmitOp(vm, TUT_OP_RETVALN);
+		Tut_EmitOp(program, TUT_OP_RETVALN);
 		
-		Tut_WriteUint16(vm->code, vm->codeSize, count);
-		vm->codeSize += 2;
+		EmitUint16(program, count);
 	}
 }
 
-int32_t Tut_EmitGoto(TutVM* vm, TutBool cond, int32_t pc)
+int32_t Tut_EmitGoto(TutProgram* program, TutBool cond, int32_t pc)
 {
 	if (!cond)
-		Tut_EmitOp(vm, TUT_OP_GOTO);
+		Tut_EmitOp(program, TUT_OP_GOTO);
 	else
-		Tut_EmitOp(vm, TUT_OP_GOTOFALSE);
+		Tut_EmitOp(program, TUT_OP_GOTOFALSE);
 
-	Tut_WriteInt32(vm->code, vm->codeSize, pc);
-	vm->codeSize += 4;
+	EmitInt32(program, pc);
 
-	return vm->codeSize - 4;
+	return program->codeSize - 4;
 }
 
-void Tut_PatchGoto(TutVM* vm, int32_t patchLoc, int32_t pc)
+void Tut_PatchGoto(TutProgram* program, int32_t patchLoc, int32_t pc)
 {
-	Tut_WriteInt32(vm->code, patchLoc, pc);
+	assert(!program->codeReadOnly);
+	Tut_WriteInt32(program->code, patchLoc, pc);
 }
 
-void Tut_EmitFunctionEntryPoint(TutVM* vm)
+// Entry points which are not set (yet) are -1
+static void SetFunctionPc(TutProgram* program, int32_t index, int32_t pc)
 {
-	Tut_ArrayPush(&vm->functionPcs, &vm->codeSize);
+	assert(index >= 0);
+
+	if ((size_t)index >= program->functionPcs.length)
+	{
+		int32_t unset = -1;
+		Tut_ArrayResize(&program->functionPcs, index + 1, &unset);
+	}
+
+	Tut_ArraySet(&program->functionPcs, index, &pc);
+}
+
+void Tut_EmitFunctionEntryPoint(TutProgram* program, int32_t index)
+{
+	SetFunctionPc(program, index, (int32_t)program->codeSize);
+}
+
+// Bytes of operands following each opcode
+static const uint8_t OperandSizes[TUT_OP_COUNT] =
+{
+	[TUT_OP_PUSH_INT] = 4,
+	[TUT_OP_PUSH_FLOAT] = 4,
+	[TUT_OP_PUSH_I8] = 1,
+	[TUT_OP_PUSH_I32] = 4,
+	[TUT_OP_PUSH_F32] = 4,
+	[TUT_OP_PUSH_STR] = 4,
+
+	[TUT_OP_MAKEGLOBALREF] = 4,
+	[TUT_OP_MAKELOCALREF] = 4,
+	[TUT_OP_MAKEDYNAMICREF] = 2,
+	[TUT_OP_MAKEFUNC] = 4,
+	[TUT_OP_MAKEEXTERNFUNC] = 4,
+
+	[TUT_OP_PUSHN] = 2,
+	[TUT_OP_POPN] = 2,
+	[TUT_OP_MOVEN] = 4,
+	[TUT_OP_MOVE1] = 2,
+
+	[TUT_OP_GETGLOBALN] = 6,
+	[TUT_OP_GETGLOBAL1] = 4,
+	[TUT_OP_SETGLOBALN] = 6,
+	[TUT_OP_SETGLOBAL1] = 4,
+	[TUT_OP_GETLOCALN] = 6,
+	[TUT_OP_GETLOCAL1] = 4,
+	[TUT_OP_SETLOCALN] = 6,
+	[TUT_OP_SETLOCAL1] = 4,
+
+	[TUT_OP_GETREFN] = 4,
+	[TUT_OP_GETREF1] = 2,
+	[TUT_OP_SETREFN] = 4,
+	[TUT_OP_SETREF1] = 2,
+
+	[TUT_OP_ADDI_LLL] = 6, [TUT_OP_SUBI_LLL] = 6, [TUT_OP_MULI_LLL] = 6, [TUT_OP_DIVI_LLL] = 6,
+	[TUT_OP_ADDI_LLK] = 8, [TUT_OP_SUBI_LLK] = 8, [TUT_OP_MULI_LLK] = 8, [TUT_OP_DIVI_LLK] = 8,
+	[TUT_OP_ADDF_LLL] = 6, [TUT_OP_SUBF_LLL] = 6, [TUT_OP_MULF_LLL] = 6, [TUT_OP_DIVF_LLL] = 6,
+	[TUT_OP_ADDF_LLK] = 8, [TUT_OP_SUBF_LLK] = 8, [TUT_OP_MULF_LLK] = 8, [TUT_OP_DIVF_LLK] = 8,
+
+	[TUT_OP_ILT_LL_JF] = 8, [TUT_OP_ILTE_LL_JF] = 8, [TUT_OP_IEQ_LL_JF] = 8, [TUT_OP_INE_LL_JF] = 8,
+	[TUT_OP_ILT_LK_JF] = 10, [TUT_OP_ILTE_LK_JF] = 10, [TUT_OP_IGT_LK_JF] = 10,
+	[TUT_OP_IGTE_LK_JF] = 10, [TUT_OP_IEQ_LK_JF] = 10, [TUT_OP_INE_LK_JF] = 10,
+
+	[TUT_OP_INCLOCAL] = 6,
+	[TUT_OP_GETFIELD_L] = 4,
+
+	[TUT_OP_TAG] = 3,
+
+	[TUT_OP_CALL] = 4,
+	[TUT_OP_RETVALN] = 2,
+
+	[TUT_OP_GOTO] = 4,
+	[TUT_OP_GOTOFALSE] = 4,
+	[TUT_OP_GOTOTRUE] = 4,
+};
+
+int Tut_GetOpcodeSize(uint8_t op)
+{
+	assert(op < TUT_OP_COUNT);
+	return 1 + OperandSizes[op];
+}
+
+int Tut_GetJumpTargetOffset(uint8_t op)
+{
+	switch (op)
+	{
+		case TUT_OP_GOTO:
+		case TUT_OP_GOTOFALSE:
+		case TUT_OP_GOTOTRUE:
+			return 1;
+
+		case TUT_OP_ILT_LL_JF:
+		case TUT_OP_ILTE_LL_JF:
+		case TUT_OP_IEQ_LL_JF:
+		case TUT_OP_INE_LL_JF:
+			return 5;
+
+		case TUT_OP_ILT_LK_JF:
+		case TUT_OP_ILTE_LK_JF:
+		case TUT_OP_IGT_LK_JF:
+		case TUT_OP_IGTE_LK_JF:
+		case TUT_OP_IEQ_LK_JF:
+		case TUT_OP_INE_LK_JF:
+			return 7;
+
+		default:
+			return 0;
+	}
+}
+
+void Tut_LinkChunk(TutProgram* program, const TutProgram* chunk)
+{
+	int32_t base = (int32_t)program->codeSize;
+
+	// Modules with only declarations in them have no code at all
+	if (chunk->codeSize == 0)
+		return;
+
+	Reserve(program, chunk->codeSize);
+
+	memcpy(program->code + base, chunk->code, chunk->codeSize);
+	program->codeSize += chunk->codeSize;
+
+	// Relocate
+	for (uint32_t pc = 0; pc < chunk->codeSize; pc += Tut_GetOpcodeSize(chunk->code[pc]))
+	{
+		uint8_t op = chunk->code[pc];
+		int targetOffset = Tut_GetJumpTargetOffset(op);
+
+		if (targetOffset)
+		{
+			int32_t target = Tut_ReadInt32(chunk->code, pc + targetOffset);
+			Tut_WriteInt32(program->code, base + pc + targetOffset, base + target);
+		}
+		else if (op == TUT_OP_PUSH_STR)
+		{
+			int32_t index = Tut_ReadInt32(chunk->code, pc + 1);
+			const char* str = TUT_ARRAY_GET_CONST_VALUE(&chunk->strings, index, const char*);
+
+			Tut_WriteInt32(program->code, base + pc + 1, InternString(program, str));
+		}
+		// The compiler emits literals inline, but hand written chunks may still
+		// use the pools
+		else if (op == TUT_OP_PUSH_INT || op == TUT_OP_PUSH_FLOAT)
+		{
+			const TutArray* from = op == TUT_OP_PUSH_INT ? &chunk->integers : &chunk->floats;
+			TutArray* to = op == TUT_OP_PUSH_INT ? &program->integers : &program->floats;
+
+			int32_t index = Tut_ReadInt32(chunk->code, pc + 1);
+
+			Tut_WriteInt32(program->code, base + pc + 1, (int32_t)to->length);
+			Tut_ArrayPush(to, Tut_ArrayGetConst(from, index));
+		}
+	}
+
+	for (size_t i = 0; i < chunk->functionPcs.length; ++i)
+	{
+		int32_t pc = TUT_ARRAY_GET_CONST_VALUE(&chunk->functionPcs, i, int32_t);
+		if (pc >= 0)
+			SetFunctionPc(program, (int32_t)i, base + pc);
+	}
 }
\ No newline at end of file
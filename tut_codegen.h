@@ -1,27 +1,51 @@
 #ifndef TUT_CODEGEN_H
 #define TUT_CODEGEN_H
 
-#include "tut_vm.h"
+#include "tut_program.h"
 
-void Tut_EmitOp(TutVM* vm, uint8_t op);
-void Tut_EmitMakeVarRef(TutVM* vm, TutBool global, int32_t index);
-void Tut_EmitMakeDynRef(TutVM* vm, uint16_t offset);
-void Tut_EmitMakeFunc(TutVM* vm, TutBool isExtern, int32_t index);
-void Tut_EmitGetRef(TutVM* vm, uint16_t count, uint16_t offset);
-void Tut_EmitSetRef(TutVM* vm, uint16_t count, uint16_t offset);
-void Tut_EmitGet(TutVM* vm, TutBool global, int32_t index, uint16_t count);
-void Tut_EmitSet(TutVM* vm, TutBool global, int32_t index, uint16_t count);
-void Tut_EmitPushInt(TutVM* vm, int32_t value);
-void Tut_EmitPushFloat(TutVM* vm, float value);
-void Tut_EmitPushStr(TutVM* vm, const char* value);
-void Tut_EmitPush(TutVM* vm, uint16_t count);
-void Tut_EmitPop(TutVM* vm, uint16_t count);
-void Tut_EmitMove(TutVM* vm, uint16_t numObjects, uint16_t stackSpaces);
-void Tut_EmitCall(TutVM* vm, uint16_t nargs);
-void Tut_EmitRetval(TutVM* vm, uint16_t count);
+void Tut_EmitOp(TutProgram* program, uint8_t op);
+void Tut_EmitMakeVarRef(TutProgram* program, TutBool global, int32_t index);
+void Tut_EmitMakeDynRef(TutProgram* program, uint16_t offset);
+void Tut_EmitMakeFunc(TutProgram* program, TutBool isExtern, int32_t index);
+void Tut_EmitGetRef(TutProgram* program, uint16_t count, uint16_t offset);
+void Tut_EmitSetRef(TutProgram* program, uint16_t count, uint16_t offset);
+void Tut_EmitGet(TutProgram* program, TutBool global, int32_t index, uint16_t count);
+void Tut_EmitSet(TutProgram* program, TutBool global, int32_t index, uint16_t count);
+void Tut_EmitPushInt(TutProgram* program, int32_t value);
+void Tut_EmitPushFloat(TutProgram* program, float value);
+void Tut_EmitPushStr(TutProgram* program, const char* value);
+// Three-address register ops (TUT_OP_*_LLL / TUT_OP_*_LLK) on local slots
+void Tut_EmitLocalBinOp(TutProgram* program, uint8_t op, int16_t dst, int16_t a, int16_t b);
+void Tut_EmitLocalBinOpInt(TutProgram* program, uint8_t op, int16_t dst, int16_t a, int32_t k);
+void Tut_EmitLocalBinOpFloat(TutProgram* program, uint8_t op, int16_t dst, int16_t a, float k);
+// Compare and branch ops (TUT_OP_*_LL_JF / TUT_OP_*_LK_JF); return the location of
+// the target like Tut_EmitGoto
+int32_t Tut_EmitLocalCompareJump(TutProgram* program, uint8_t op, int16_t a, int16_t b, int32_t pc);
+int32_t Tut_EmitLocalCompareJumpInt(TutProgram* program, uint8_t op, int16_t a, int32_t k, int32_t pc);
+void Tut_EmitIncLocal(TutProgram* program, int16_t index, int32_t k);
+void Tut_EmitGetFieldLocal(TutProgram* program, int16_t index, uint16_t offset);
+// Sets the runtime type of the value depth slots below the top of the stack
+void Tut_EmitTag(TutProgram* program, uint16_t depth, uint8_t type);
+void Tut_EmitPush(TutProgram* program, uint16_t count);
+void Tut_EmitPop(TutProgram* program, uint16_t count);
+void Tut_EmitMove(TutProgram* program, uint16_t numObjects, uint16_t stackSpaces);
+// nargs and nret are the number of objects passed and returned
+void Tut_EmitCall(TutProgram* program, uint16_t nargs, uint16_t nret);
+void Tut_EmitRetval(TutProgram* program, uint16_t count);
 // Returns the bytecode location where the 'pc' is written
-int32_t Tut_EmitGoto(TutVM* vm, TutBool cond, int32_t pc);
-void Tut_PatchGoto(TutVM* vm, int32_t patchLoc, int32_t pc);
-void Tut_EmitFunctionEntryPoint(TutVM* vm);
+int32_t Tut_EmitGoto(TutProgram* program, TutBool cond, int32_t pc);
+void Tut_PatchGoto(TutProgram* program, int32_t patchLoc, int32_t pc);
+// Records the current location as the entry point of function index
+void Tut_EmitFunctionEntryPoint(TutProgram* program, int32_t index);
+
+// Size in bytes of an instruction with the given opcode, operands included
+int Tut_GetOpcodeSize(uint8_t op);
+// Offset of the (int32) jump target from the opcode, or 0 if op doesn't jump
+int Tut_GetJumpTargetOffset(uint8_t op);
+
+// Appends chunk's code to program. The chunk has to be self contained: gotos are
+// relative to its start and string operands index its own pool; function entry
+// points which are set in the chunk are set in program.
+void Tut_LinkChunk(TutProgram* program, const TutProgram* chunk);
 
 #endif
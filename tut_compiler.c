@@ -6,17 +6,30 @@
 
 #include "tut_compiler.h"
 #include "tut_codegen.h"
+#include "tut_peephole.h"
 #include "tut_opcodes.h"
 #include "tut_expr.h"
+#include "tut_thread.h"
+#include "tut_hash.h"
+#include "tut_verify.h"
 
 static const char* Flags[TUT_CFLAG_COUNT] =
 {
+	NULL,
+	NULL,
+	NULL,
 	NULL,
 	NULL
 };
 
+// Modules are compiled in parallel; the first error wins and the process exits
+// while holding this
+static TutMutex ErrorLock = TUT_MUTEX_INITIALIZER;
+
 static void CompilerError(TutExpr* exp, const char* format, ...)
 {
+	Tut_LockMutex(&ErrorLock);
+
 	char* lineEnd = strchr(exp->context.lineStart, '\n');
 	if (lineEnd)
 		fprintf(stderr, "%.*s\n", (int)(lineEnd - exp->context.lineStart), exp->context.lineStart);
@@ -49,19 +62,24 @@ static void CompilerError(TutExpr* exp, const char* format, ...)
 	exit(1);
 }
 
-static TutTypetagMember* GetMember(TutTypetag* tag, const char* memberName)
+// Expressions are only added while parsing, so these pointers stay valid
+// throughout compilation
+static TutExpr* GetExpr(TutModule* module, TutExprIndex index)
+{
+	return TUT_AST_EXPR(&module->ast, index);
+}
+
+static TutExpr* GetListExpr(TutModule* module, TutExprRange range, uint32_t i)
+{
+	return TUT_AST_EXPR(&module->ast, TUT_AST_LIST_ITEM(&module->ast, range, i));
+}
+
+static TutTypetagMember* GetMember(TutTypetag* tag, TutAtom memberName)
 {
 	assert(tag);
 	assert(tag->type == TUT_TYPETAG_USERTYPE);
 
-	for (int i = 0; i < tag->user.members.length; ++i)
-	{
-		TutTypetagMember* mem = Tut_ArrayGet(&tag->user.members, i);
-		if (strcmp(mem->name, memberName) == 0)
-			return mem;
-	}
-
-	return NULL;
+	return Tut_GetTypetagMember(tag, memberName);
 }
 
 typedef struct
@@ -71,7 +89,7 @@ typedef struct
 	int offset;
 } Lvalue;
 
-static TutBool GetLvalue(Lvalue* value, TutExpr* exp, const char* memberName)
+static TutBool GetLvalue(TutModule* module, Lvalue* value, TutExpr* exp, TutAtom memberName)
 {
 	assert(exp);
 	assert(exp->typetag);
@@ -95,7 +113,7 @@ static TutBool GetLvalue(Lvalue* value, TutExpr* exp, const char* memberName)
 
 		case TUT_EXPR_DOT:
 		{
-			if (GetLvalue(value, exp->dotx.value, exp->dotx.memberName))
+			if (GetLvalue(module, value, GetExpr(module, exp->dotx.value), exp->dotx.memberName))
 			{
 				if (memberName)
 					value->offset += GetMember(exp->typetag, memberName)->offset;
@@ -108,13 +126,13 @@ static TutBool GetLvalue(Lvalue* value, TutExpr* exp, const char* memberName)
 
 		case TUT_EXPR_ARROW:
 		{
-			TutTypetag* tag = exp->dotx.value->typetag;
+			TutTypetag* tag = GetExpr(module, exp->dotx.value)->typetag;
 
 			assert(tag->type == TUT_TYPETAG_REF);
 			assert(tag->ref.value);
 			assert(tag->ref.value->type == TUT_TYPETAG_USERTYPE);
 
-			value->root = exp->dotx.value;
+			value->root = GetExpr(module, exp->dotx.value);
 			value->decl = NULL;
 			value->offset += GetMember(tag->ref.value, exp->dotx.memberName)->offset;
 
@@ -123,7 +141,7 @@ static TutBool GetLvalue(Lvalue* value, TutExpr* exp, const char* memberName)
 
 		case TUT_EXPR_PAREN:
 		{
-			return GetLvalue(value, exp->parenExpr, memberName);
+			return GetLvalue(module, value, GetExpr(module, exp->parenExpr), memberName);
 		} break;
 
 		default:
@@ -131,33 +149,45 @@ static TutBool GetLvalue(Lvalue* value, TutExpr* exp, const char* memberName)
 	}
 }
 
+// Members are laid out before the struct containing them, so each layout is computed once
+static void FinalizeType(TutTypetag* t)
+{
+	if (t->user.size >= 0)
+		return;
+
+	if (t->user.size == TUT_TYPETAG_SIZE_PENDING)
+		Tut_ErrorExit("Recursive type definition; Type '%s' contains itself.\n", t->user.name);
+
+	if (!t->user.defined)
+		Tut_ErrorExit("Attempted to use undefined type '%s'.\n", t->user.name);
+
+	if (t->user.members.length == 0)
+		Tut_ErrorExit("Type '%s' has no members.\n", t->user.name);
+
+	t->user.size = TUT_TYPETAG_SIZE_PENDING;
+
+	for (size_t i = 0; i < t->user.members.length; ++i)
+	{
+		TutTypetagMember* mem = Tut_ArrayGet(&t->user.members, i);
+		if (mem->typetag->type == TUT_TYPETAG_USERTYPE)
+			FinalizeType(mem->typetag);
+	}
+
+	Tut_FreezeTypetagLayout(t);
+}
+
 static void FinalizeTypes(TutModule* module)
 {
 	TUT_LIST_EACH(node, module->symbolTable->usertypes)
 	{
 		TutTypetag* t = node->value;
 		if (t->type == TUT_TYPETAG_USERTYPE)
-		{
-			if (!t->user.defined)
-				Tut_ErrorExit("Attempted to use undefined type '%s'.\n", t->user.name);
-
-			if (t->user.members.length == 0)
-				Tut_ErrorExit("Type '%s' has no members.\n", t->user.name);
-
-			int totalSize = 0;
-			
-			for(size_t i = 0; i < t->user.members.length; ++i)
-			{
-				TutTypetagMember* mem = Tut_ArrayGet(&t->user.members, i);
-
-				mem->offset = totalSize;
-				totalSize += Tut_GetTypetagSize(mem->typetag);
-			}
-		}
+			FinalizeType(t);
 	}
 }
 
-static void ResolveVariableIndices(TutModule* module)
+// Returns the number of global slots used
+static int ResolveVariableIndices(TutModule* module)
 {
 	int globalIndex = 0;
 
@@ -205,122 +235,51 @@ static void ResolveVariableIndices(TutModule* module)
 			}
 		}
 	}
+
+	return globalIndex;
 }
 
-static void ResolveSymbols(TutModule* module, TutExpr* exp)
+// Binds identifiers which the parser could not (i.e. used before they were declared);
+// by the time the module is compiled every declaration has been collected
+static void ResolveIdent(TutModule* module, TutExpr* exp)
 {
-	assert(exp);
+	exp->varx.decl = Tut_GetVarDecl(module->symbolTable, exp->varx.name, 0);
+	if (exp->varx.decl)
+		return;
 
-	switch (exp->type)
+	TutFuncDecl* decl = Tut_GetFuncDecl(module->symbolTable, exp->varx.name);
+	if (decl)
 	{
-		case TUT_EXPR_TRUE:
-		case TUT_EXPR_FALSE:
-		case TUT_EXPR_INT:
-		case TUT_EXPR_FLOAT:
-		case TUT_EXPR_STR:
-		case TUT_EXPR_STRUCT_DEF:
-		case TUT_EXPR_SIZEOF:
-		{
-		} break;
-
-		case TUT_EXPR_CAST:
-		{
-			ResolveSymbols(module, exp->castx.value);
-		} break;
-
-		case TUT_EXPR_VAR:
-		{
-			// Already resolved right?
-			assert(exp->varx.decl);
-		} break;
-
-		case TUT_EXPR_IDENT:
-		{
-			if (!exp->varx.decl)
-			{
-				exp->varx.decl = Tut_GetVarDecl(module->symbolTable, exp->varx.name, 0);
-				if (!exp->varx.decl)
-				{
-					TutFuncDecl* decl = Tut_GetFuncDecl(module->symbolTable, exp->varx.name);
-					if (!decl)
-					{
-						TutTypetag* tag = Tut_CreatePrimitiveTypetag(exp->varx.name);
-						if (!tag)
-						{
-							tag = Tut_GetType(module->symbolTable, exp->varx.name);
-							if (!tag)
-								CompilerError(exp, "Attempted to access undeclared variable '%s'.\n", exp->varx.name);
-							exp->varx.typetag = tag;
-						}
-						else
-							exp->varx.typetag = tag;
-					}
-					else
-						exp->varx.funcDecl = decl;
-				}
-			}
-		} break;
-
-		case TUT_EXPR_BIN:
-		{
-			ResolveSymbols(module, exp->binx.lhs);
-			ResolveSymbols(module, exp->binx.rhs);
-		} break;
-
-		case TUT_EXPR_UNARY:
-		{
-			ResolveSymbols(module, exp->unaryx.value);
-		} break;
-
-		case TUT_EXPR_PAREN:
-		{
-			ResolveSymbols(module, exp->parenExpr);
-		} break;
-
-		case TUT_EXPR_ARROW:
-		case TUT_EXPR_DOT:
-		{
-			ResolveSymbols(module, exp->dotx.value);
-		} break;
-		 
-		case TUT_EXPR_CALL:
-		{
-			ResolveSymbols(module, exp->callx.func);
-			TUT_LIST_EACH(node, exp->callx.args)
-				ResolveSymbols(module, node->value);
-		} break;
-
-		case TUT_EXPR_BLOCK:
-		{
-			TUT_LIST_EACH(node, exp->blockList)
-				ResolveSymbols(module, node->value);
-		} break;
-
-		case TUT_EXPR_IF:
-		{
-			ResolveSymbols(module, exp->ifx.cond);
-			ResolveSymbols(module, exp->ifx.body);
+		exp->varx.funcDecl = decl;
+		return;
+	}
 
-			if (exp->ifx.alt)
-				ResolveSymbols(module, exp->ifx.alt);
-		} break;
+	TutTypetag* tag = Tut_FindPrimitiveTypetag(exp->varx.name);
+	if (!tag)
+	{
+		tag = Tut_GetType(module->symbolTable, exp->varx.name);
+		if (!tag)
+			CompilerError(exp, "Attempted to access undeclared variable '%s'.\n", exp->varx.name);
+	}
 
-		case TUT_EXPR_WHILE:
-		{
-			ResolveSymbols(module, exp->whilex.cond);
-			ResolveSymbols(module, exp->whilex.body);
-		} break;
+	exp->varx.typetag = tag;
+}
 
-		case TUT_EXPR_RETURN:
-		{
-			if (exp->retx.value)
-				ResolveSymbols(module, exp->retx.value);
-		} break;
+// Resolving doesn't depend on where an identifier is in the tree, so this is a
+// single pass over the module's expressions
+static void ResolveSymbols(TutModule* module)
+{
+	for (TutExprIndex i = 1; i < module->ast.exprs.length; ++i)
+	{
+		TutExpr* exp = GetExpr(module, i);
 
-		case TUT_EXPR_FUNC:
+		if (exp->type == TUT_EXPR_VAR)
 		{
-			ResolveSymbols(module, exp->funcx.body);
-		} break;
+			// Already resolved right?
+			assert(exp->varx.decl);
+		}
+		else if (exp->type == TUT_EXPR_IDENT && !exp->varx.decl)
+			ResolveIdent(module, exp);
 	}
 }
 
@@ -332,43 +291,45 @@ static void ResolveTypes(TutModule* module, TutExpr* exp)
 	{
 		case TUT_EXPR_SIZEOF:
 		{
-			exp->typetag = Tut_CreatePrimitiveTypetag("int");
+			exp->typetag = Tut_GetPrimitiveTypetag(TUT_TYPETAG_INT);
 		} break;
 		
 		case TUT_EXPR_NULL:
 		{
-			exp->typetag = Tut_CreatePrimitiveTypetag("ref");
+			exp->typetag = Tut_GetPrimitiveTypetag(TUT_TYPETAG_REF);
 		} break;
 
 		case TUT_EXPR_TRUE:
 		case TUT_EXPR_FALSE:
 		{
-			exp->typetag = Tut_CreatePrimitiveTypetag("bool");
+			exp->typetag = Tut_GetPrimitiveTypetag(TUT_TYPETAG_BOOL);
 		} break;
 
 		case TUT_EXPR_INT:
 		{
-			exp->typetag = Tut_CreatePrimitiveTypetag("int");
+			exp->typetag = Tut_GetPrimitiveTypetag(TUT_TYPETAG_INT);
 		} break;
 
 		case TUT_EXPR_FLOAT:
 		{
-			exp->typetag = Tut_CreatePrimitiveTypetag("float");
+			exp->typetag = Tut_GetPrimitiveTypetag(TUT_TYPETAG_FLOAT);
 		} break;
 
 		case TUT_EXPR_STR:
 		{
-			exp->typetag = Tut_CreatePrimitiveTypetag("cstr");
+			exp->typetag = Tut_GetPrimitiveTypetag(TUT_TYPETAG_CSTR);
 		} break;
 
 		case TUT_EXPR_VAR:
 		{
-			exp->typetag = Tut_CreatePrimitiveTypetag("void");
+			exp->typetag = Tut_GetPrimitiveTypetag(TUT_TYPETAG_VOID);
 		} break;
 
 		case TUT_EXPR_IDENT:
 		{
-			assert(exp->varx.decl || exp->varx.funcDecl || exp->varx.typetag);
+			// Only left unresolved in single pass mode
+			if (!exp->varx.decl && !exp->varx.funcDecl && !exp->varx.typetag)
+				ResolveIdent(module, exp);
 
 			if (exp->varx.decl)
 				exp->typetag = exp->varx.decl->typetag;
@@ -380,7 +341,7 @@ static void ResolveTypes(TutModule* module, TutExpr* exp)
 
 		case TUT_EXPR_UNARY:
 		{
-			ResolveTypes(module, exp->unaryx.value);
+			ResolveTypes(module, GetExpr(module, exp->unaryx.value));
 			
 			assert(exp->unaryx.op == TUT_TOK_MINUS ||
 				   exp->unaryx.op == TUT_TOK_MUL ||
@@ -388,101 +349,98 @@ static void ResolveTypes(TutModule* module, TutExpr* exp)
 
 			if (exp->unaryx.op == TUT_TOK_MINUS)
 			{
-				if (exp->unaryx.value->typetag->type != TUT_TYPETAG_INT && exp->unaryx.value->typetag->type != TUT_TYPETAG_FLOAT)
-					CompilerError(exp, "Unary operator '%s' cannot be applied to value of type '%s'.\n", Tut_TokenRepr(exp->unaryx.op), Tut_TypetagRepr(exp->unaryx.value->typetag));
+				if (GetExpr(module, exp->unaryx.value)->typetag->type != TUT_TYPETAG_INT && GetExpr(module, exp->unaryx.value)->typetag->type != TUT_TYPETAG_FLOAT)
+					CompilerError(exp, "Unary operator '%s' cannot be applied to value of type '%s'.\n", Tut_TokenRepr(exp->unaryx.op), Tut_TypetagRepr(GetExpr(module, exp->unaryx.value)->typetag));
 
-				exp->typetag = exp->unaryx.value->typetag;
+				exp->typetag = GetExpr(module, exp->unaryx.value)->typetag;
 			}
 			else if (exp->unaryx.op == TUT_TOK_MUL)
 			{
-				if (exp->unaryx.value->typetag->type != TUT_TYPETAG_REF)
-					CompilerError(exp, "Cannot dereference value of type '%s'.\n", Tut_TypetagRepr(exp->unaryx.value->typetag));
-				if (!exp->unaryx.value->typetag->ref.value)
+				if (GetExpr(module, exp->unaryx.value)->typetag->type != TUT_TYPETAG_REF)
+					CompilerError(exp, "Cannot dereference value of type '%s'.\n", Tut_TypetagRepr(GetExpr(module, exp->unaryx.value)->typetag));
+				if (!GetExpr(module, exp->unaryx.value)->typetag->ref.value)
 					CompilerError(exp, "Cannot dereference unspecified reference value.\n");
 				
-				exp->typetag = exp->unaryx.value->typetag->ref.value;
+				exp->typetag = GetExpr(module, exp->unaryx.value)->typetag->ref.value;
 			}
 			else if (exp->unaryx.op == TUT_TOK_AND)
 			{
-				exp->typetag = Tut_CreatePrimitiveTypetag("ref");
-				assert(exp->typetag);
-
-				exp->typetag->ref.value = exp->unaryx.value->typetag;
+				exp->typetag = Tut_GetRefTypetag(&module->symbolTable->typeCache, GetExpr(module, exp->unaryx.value)->typetag);
 			}
 		} break;
 
 		case TUT_EXPR_BIN:
 		{
-			ResolveTypes(module, exp->binx.lhs);
-			ResolveTypes(module, exp->binx.rhs);
+			ResolveTypes(module, GetExpr(module, exp->binx.lhs));
+			ResolveTypes(module, GetExpr(module, exp->binx.rhs));
 		
-			assert(exp->binx.lhs->typetag && exp->binx.rhs->typetag);
+			assert(GetExpr(module, exp->binx.lhs)->typetag && GetExpr(module, exp->binx.rhs)->typetag);
 			
 			if (exp->binx.op != TUT_TOK_ASSIGN)
 			{
-				if (exp->binx.lhs->typetag->type == TUT_TYPETAG_VOID || exp->binx.lhs->typetag->type == TUT_TYPETAG_USERTYPE)
-					CompilerError(exp, "Cannot apply binary operation '%s' to type '%s'.\n", Tut_TokenRepr(exp->binx.op), Tut_TypetagRepr(exp->binx.lhs->typetag));
+				if (GetExpr(module, exp->binx.lhs)->typetag->type == TUT_TYPETAG_VOID || GetExpr(module, exp->binx.lhs)->typetag->type == TUT_TYPETAG_USERTYPE)
+					CompilerError(exp, "Cannot apply binary operation '%s' to type '%s'.\n", Tut_TokenRepr(exp->binx.op), Tut_TypetagRepr(GetExpr(module, exp->binx.lhs)->typetag));
 
-				if (!Tut_CompareTypes(exp->binx.lhs->typetag, exp->binx.rhs->typetag))
-					CompilerError(exp, "Mismatched types in binary operation (%s, %s).\n", Tut_TypetagRepr(exp->binx.lhs->typetag), Tut_TypetagRepr(exp->binx.rhs->typetag));
+				if (!Tut_CompareTypes(GetExpr(module, exp->binx.lhs)->typetag, GetExpr(module, exp->binx.rhs)->typetag))
+					CompilerError(exp, "Mismatched types in binary operation (%s, %s).\n", Tut_TypetagRepr(GetExpr(module, exp->binx.lhs)->typetag), Tut_TypetagRepr(GetExpr(module, exp->binx.rhs)->typetag));
 				
 				if (exp->binx.op != TUT_TOK_EQUALS && exp->binx.op != TUT_TOK_NEQUALS &&
 					exp->binx.op != TUT_TOK_LT && exp->binx.op != TUT_TOK_GT &&
 					exp->binx.op != TUT_TOK_LTE && exp->binx.op != TUT_TOK_GTE &&
 					exp->binx.op != TUT_TOK_LAND && exp->binx.op != TUT_TOK_LOR)
-					exp->typetag = exp->binx.lhs->typetag;
+					exp->typetag = GetExpr(module, exp->binx.lhs)->typetag;
 				else
-					exp->typetag = Tut_CreatePrimitiveTypetag("bool");
+					exp->typetag = Tut_GetPrimitiveTypetag(TUT_TYPETAG_BOOL);
 			}
 			else
 			{
-				if (exp->binx.lhs->type != TUT_EXPR_VAR)
+				if (GetExpr(module, exp->binx.lhs)->type != TUT_EXPR_VAR)
 				{
 					// IMPORTANT: Autoconversion from 'str' to 'cstr'
-					if(!Tut_CanAssignTypes(exp->binx.rhs->typetag, exp->binx.lhs->typetag))
-						CompilerError(exp, "Mismatched types in assignment operation (%s, %s).\n", Tut_TypetagRepr(exp->binx.lhs->typetag), Tut_TypetagRepr(exp->binx.rhs->typetag));
+					if(!Tut_CanAssignTypes(GetExpr(module, exp->binx.rhs)->typetag, GetExpr(module, exp->binx.lhs)->typetag))
+						CompilerError(exp, "Mismatched types in assignment operation (%s, %s).\n", Tut_TypetagRepr(GetExpr(module, exp->binx.lhs)->typetag), Tut_TypetagRepr(GetExpr(module, exp->binx.rhs)->typetag));
 				}
 				else
 				{
-					assert(exp->binx.lhs->varx.decl);
+					assert(GetExpr(module, exp->binx.lhs)->varx.decl);
 
-					if (!Tut_CanAssignTypes(exp->binx.rhs->typetag, exp->binx.lhs->varx.decl->typetag))
-						CompilerError(exp, "Mismatched types in assignment operation (%s, %s).\n", Tut_TypetagRepr(exp->binx.lhs->varx.decl->typetag), Tut_TypetagRepr(exp->binx.rhs->typetag));
+					if (!Tut_CanAssignTypes(GetExpr(module, exp->binx.rhs)->typetag, GetExpr(module, exp->binx.lhs)->varx.decl->typetag))
+						CompilerError(exp, "Mismatched types in assignment operation (%s, %s).\n", Tut_TypetagRepr(GetExpr(module, exp->binx.lhs)->varx.decl->typetag), Tut_TypetagRepr(GetExpr(module, exp->binx.rhs)->typetag));
 				}
 			}
 		} break;
 
 		case TUT_EXPR_PAREN:
 		{
-			ResolveTypes(module, exp->parenExpr);
-			exp->typetag = exp->parenExpr->typetag;
+			ResolveTypes(module, GetExpr(module, exp->parenExpr));
+			exp->typetag = GetExpr(module, exp->parenExpr)->typetag;
 		} break;
 		
 		case TUT_EXPR_ARROW:
 		case TUT_EXPR_DOT:
 		{
-			ResolveTypes(module, exp->dotx.value);
-			assert(exp->dotx.value->typetag);
+			ResolveTypes(module, GetExpr(module, exp->dotx.value));
+			assert(GetExpr(module, exp->dotx.value)->typetag);
 
 			TutTypetag* tag = NULL;
 
 			if (exp->type == TUT_EXPR_DOT)
 			{
-				if (exp->dotx.value->typetag->type != TUT_TYPETAG_USERTYPE)
-					CompilerError(exp, "Type '%s' has no members.\n", Tut_TypetagRepr(exp->dotx.value->typetag));
+				if (GetExpr(module, exp->dotx.value)->typetag->type != TUT_TYPETAG_USERTYPE)
+					CompilerError(exp, "Type '%s' has no members.\n", Tut_TypetagRepr(GetExpr(module, exp->dotx.value)->typetag));
 				
-				tag = exp->dotx.value->typetag;
+				tag = GetExpr(module, exp->dotx.value)->typetag;
 			}
 			else if (exp->type == TUT_EXPR_ARROW)
 			{
-				if (exp->dotx.value->typetag->type != TUT_TYPETAG_REF)
-					CompilerError(exp, "Type '%s' is not a reference type so you cannot use '->' to index it.\n", Tut_TypetagRepr(exp->dotx.value->typetag));
-				if (!exp->dotx.value->typetag->ref.value)
+				if (GetExpr(module, exp->dotx.value)->typetag->type != TUT_TYPETAG_REF)
+					CompilerError(exp, "Type '%s' is not a reference type so you cannot use '->' to index it.\n", Tut_TypetagRepr(GetExpr(module, exp->dotx.value)->typetag));
+				if (!GetExpr(module, exp->dotx.value)->typetag->ref.value)
 					CompilerError(exp, "Cannot use '->' operator on unspecified reference.\n");
-				if (exp->dotx.value->typetag->ref.value->type != TUT_TYPETAG_USERTYPE)
-					CompilerError(exp, "Type '%s' has no members.\n", Tut_TypetagRepr(exp->dotx.value->typetag->ref.value));
+				if (GetExpr(module, exp->dotx.value)->typetag->ref.value->type != TUT_TYPETAG_USERTYPE)
+					CompilerError(exp, "Type '%s' has no members.\n", Tut_TypetagRepr(GetExpr(module, exp->dotx.value)->typetag->ref.value));
 			
-				tag = exp->dotx.value->typetag->ref.value;
+				tag = GetExpr(module, exp->dotx.value)->typetag->ref.value;
 			}
 
 			assert(tag);
@@ -496,106 +454,103 @@ static void ResolveTypes(TutModule* module, TutExpr* exp)
 
 		case TUT_EXPR_CALL:
 		{
-			ResolveTypes(module, exp->callx.func);
+			TutExpr* func = GetExpr(module, exp->callx.func);
+			ResolveTypes(module, func);
 
-			if (exp->callx.func->typetag->type != TUT_TYPETAG_FUNC)
-				CompilerError(exp, "Attempted to call non-function value of type '%s'.\n", Tut_TypetagRepr(exp->callx.func->typetag));
+			if (func->typetag->type != TUT_TYPETAG_FUNC)
+				CompilerError(exp, "Attempted to call non-function value of type '%s'.\n", Tut_TypetagRepr(func->typetag));
 
-			assert(exp->callx.func->typetag->func.ret);
+			assert(func->typetag->func.ret);
 
-			exp->typetag = exp->callx.func->typetag->func.ret;
+			exp->typetag = func->typetag->func.ret;
 
-			if (!exp->callx.func->typetag->func.hasVarargs)
+			if (!func->typetag->func.hasVarargs)
 			{
-				if (exp->callx.args.length != exp->callx.func->typetag->func.args.length)
+				if (exp->callx.args.length != func->typetag->func.args.length)
 					CompilerError(exp, "Invalid number of arguments in function call; expected %d arguments but passed %d\n",
-						exp->callx.args.length, exp->callx.func->typetag->func.args.length);
+						exp->callx.args.length, func->typetag->func.args.length);
 			}
-			else if (exp->callx.args.length < exp->callx.func->typetag->func.args.length)
+			else if (exp->callx.args.length < func->typetag->func.args.length)
 				CompilerError(exp, "Expected at least %d arguments in function call but passed %d\n",
-					exp->callx.func->typetag->func.args.length, exp->callx.args.length);
+					func->typetag->func.args.length, exp->callx.args.length);
 
-			TUT_LIST_EACH(node, exp->callx.args)
-				ResolveTypes(module, node->value);
+			for (uint32_t i = 0; i < exp->callx.args.length; ++i)
+				ResolveTypes(module, GetListExpr(module, exp->callx.args, i));
 
-			TutListNode* argNode = exp->callx.args.head;
-			TutListNode* tagNode = exp->callx.func->typetag->func.args.head;
+			TutListNode* tagNode = func->typetag->func.args.head;
 
-			int i = 0;
-			while (argNode && tagNode)
+			for (uint32_t i = 0; i < exp->callx.args.length && tagNode; ++i)
 			{
-				TutExpr* arg = argNode->value;
+				TutExpr* arg = GetListExpr(module, exp->callx.args, i);
 				TutTypetag* tag = tagNode->value;
 
 				if (!Tut_CanAssignTypes(arg->typetag, tag))
 					CompilerError(arg, "Argument %d was supposed to be a '%s' but you passed a '%s'\n",
 							i + 1, Tut_TypetagRepr(tag), Tut_TypetagRepr(arg->typetag));
 
-				argNode = argNode->next;
 				tagNode = tagNode->next;
-				++i;
 			}
 		} break;
 
 		case TUT_EXPR_CAST:
 		{
-			ResolveTypes(module, exp->castx.value);
+			ResolveTypes(module, GetExpr(module, exp->castx.value));
 			exp->typetag = exp->castx.typetag;
 		} break;
 
 		case TUT_EXPR_BLOCK:
 		{
-			exp->typetag = Tut_CreatePrimitiveTypetag("void");
+			exp->typetag = Tut_GetPrimitiveTypetag(TUT_TYPETAG_VOID);
 
-			TUT_LIST_EACH(node, exp->blockList)
-				ResolveTypes(module, node->value);
+			for (uint32_t i = 0; i < exp->blockList.length; ++i)
+				ResolveTypes(module, GetListExpr(module, exp->blockList, i));
 		} break;
 
 		case TUT_EXPR_IF:
 		{
-			exp->typetag = Tut_CreatePrimitiveTypetag("void");
+			exp->typetag = Tut_GetPrimitiveTypetag(TUT_TYPETAG_VOID);
 
-			ResolveTypes(module, exp->ifx.cond);
-			ResolveTypes(module, exp->ifx.body);
+			ResolveTypes(module, GetExpr(module, exp->ifx.cond));
+			ResolveTypes(module, GetExpr(module, exp->ifx.body));
 
-			if (exp->ifx.alt)
-				ResolveTypes(module, exp->ifx.alt);
+			if (exp->ifx.alt != TUT_EXPR_NONE)
+				ResolveTypes(module, GetExpr(module, exp->ifx.alt));
 		} break;
 
 		case TUT_EXPR_WHILE:
 		{
-			exp->typetag = Tut_CreatePrimitiveTypetag("void");
+			exp->typetag = Tut_GetPrimitiveTypetag(TUT_TYPETAG_VOID);
 			
-			ResolveTypes(module, exp->whilex.cond);
-			ResolveTypes(module, exp->whilex.body);
+			ResolveTypes(module, GetExpr(module, exp->whilex.cond));
+			ResolveTypes(module, GetExpr(module, exp->whilex.body));
 		} break;
 
 		case TUT_EXPR_STRUCT_DEF:
 		{
-			exp->typetag = Tut_CreatePrimitiveTypetag("void");
+			exp->typetag = Tut_GetPrimitiveTypetag(TUT_TYPETAG_VOID);
 		} break;
 
 		case TUT_EXPR_FUNC:
 		{
-			exp->typetag = Tut_CreatePrimitiveTypetag("void");
+			exp->typetag = Tut_GetPrimitiveTypetag(TUT_TYPETAG_VOID);
 			
-			ResolveTypes(module, exp->funcx.body);
+			ResolveTypes(module, GetExpr(module, exp->funcx.body));
 		} break;
 		
 		case TUT_EXPR_RETURN:
 		{
-			exp->typetag = Tut_CreatePrimitiveTypetag("void");
+			exp->typetag = Tut_GetPrimitiveTypetag(TUT_TYPETAG_VOID);
 
 			assert(exp->retx.parent);
 			assert(exp->retx.parent->typetag->func.ret);
 
-			if (exp->retx.value)
+			if (exp->retx.value != TUT_EXPR_NONE)
 			{
-				ResolveTypes(module, exp->retx.value);
+				ResolveTypes(module, GetExpr(module, exp->retx.value));
 
-				if (!Tut_CompareTypes(exp->retx.parent->typetag->func.ret, exp->retx.value->typetag))
+				if (!Tut_CompareTypes(exp->retx.parent->typetag->func.ret, GetExpr(module, exp->retx.value)->typetag))
 					CompilerError(exp, "Type of value in return statement '%s' does not match return type of enclosing function '%s'\n", 
-						Tut_TypetagRepr(exp->retx.value->typetag), Tut_TypetagRepr(exp->retx.parent->typetag->func.ret));
+						Tut_TypetagRepr(GetExpr(module, exp->retx.value)->typetag), Tut_TypetagRepr(exp->retx.parent->typetag->func.ret));
 			}
 			else if (exp->retx.parent->typetag->func.ret->type != TUT_TYPETAG_VOID)
 				CompilerError(exp, "Function must return a value.\n");
@@ -603,9 +558,9 @@ static void ResolveTypes(TutModule* module, TutExpr* exp)
 	}
 }
 
-static void CompileValue(TutModule* module, TutVM* vm, TutExpr* exp);
+static void CompileValue(TutModule* module, TutProgram* program, TutExpr* exp);
 
-static void CompileAssign(TutModule* module, TutVM* vm, TutExpr* lhs)
+static void CompileAssign(TutModule* module, TutProgram* program, TutExpr* lhs)
 {
 	assert(lhs);
 	assert(lhs->typetag);
@@ -616,7 +571,7 @@ static void CompileAssign(TutModule* module, TutVM* vm, TutExpr* lhs)
 		case TUT_EXPR_IDENT:
 		{
 			assert(lhs->varx.decl);
-			Tut_EmitSet(vm, !lhs->varx.decl->parent, lhs->varx.decl->index, Tut_GetTypetagSize(lhs->varx.decl->typetag));
+			Tut_EmitSet(program, !lhs->varx.decl->parent, lhs->varx.decl->index, Tut_GetTypetagSize(lhs->varx.decl->typetag));
 		} break;
 
 		case TUT_EXPR_DOT:
@@ -624,10 +579,10 @@ static void CompileAssign(TutModule* module, TutVM* vm, TutExpr* lhs)
 			Lvalue value = { 0 };
 
 			// p.scene.x
-			if (!GetLvalue(&value, lhs->dotx.value, lhs->dotx.memberName))
+			if (!GetLvalue(module, &value, GetExpr(module, lhs->dotx.value), lhs->dotx.memberName))
 				CompilerError(lhs, "Invalid lhs in assignment expression.\n");
 
-			Tut_EmitSet(vm, !value.decl->parent, value.decl->index + value.offset, Tut_GetTypetagSize(lhs->typetag));
+			Tut_EmitSet(program, !value.decl->parent, value.decl->index + value.offset, Tut_GetTypetagSize(lhs->typetag));
 		} break;
 
 		case TUT_EXPR_UNARY:
@@ -635,33 +590,33 @@ static void CompileAssign(TutModule* module, TutVM* vm, TutExpr* lhs)
 			if (lhs->unaryx.op != TUT_TOK_MUL)
 				CompilerError(lhs, "Invalid lhs in assignment expression.\n");
 			
-			assert(lhs->unaryx.value->typetag);
-			assert(lhs->unaryx.value->typetag->type == TUT_TYPETAG_REF);
-			assert(lhs->unaryx.value->typetag->ref.value);
+			assert(GetExpr(module, lhs->unaryx.value)->typetag);
+			assert(GetExpr(module, lhs->unaryx.value)->typetag->type == TUT_TYPETAG_REF);
+			assert(GetExpr(module, lhs->unaryx.value)->typetag->ref.value);
 
 			// Push ref onto stack
-			CompileValue(module, vm, lhs->unaryx.value);
+			CompileValue(module, program, GetExpr(module, lhs->unaryx.value));
 
 			// Memcpy &stack[currentPos - size] into ref 
-			Tut_EmitSetRef(vm, Tut_GetTypetagSize(lhs->unaryx.value->typetag->ref.value), 0);
+			Tut_EmitSetRef(program, Tut_GetTypetagSize(GetExpr(module, lhs->unaryx.value)->typetag->ref.value), 0);
 		} break;
 
 		case TUT_EXPR_ARROW:
 		{
-			assert(lhs->dotx.value->typetag);
-			assert(lhs->dotx.value->typetag->type == TUT_TYPETAG_REF);
-			assert(lhs->dotx.value->typetag->ref.value->type == TUT_TYPETAG_USERTYPE);
+			assert(GetExpr(module, lhs->dotx.value)->typetag);
+			assert(GetExpr(module, lhs->dotx.value)->typetag->type == TUT_TYPETAG_REF);
+			assert(GetExpr(module, lhs->dotx.value)->typetag->ref.value->type == TUT_TYPETAG_USERTYPE);
 		
 			// Push ref onto stack
-			CompileValue(module, vm, lhs->dotx.value);
+			CompileValue(module, program, GetExpr(module, lhs->dotx.value));
 			
-			TutTypetagMember* mem = GetMember(lhs->dotx.value->typetag->ref.value, lhs->dotx.memberName);
+			TutTypetagMember* mem = GetMember(GetExpr(module, lhs->dotx.value)->typetag->ref.value, lhs->dotx.memberName);
 			
 			assert(mem);
 			assert(mem->offset >= 0);
 
 			// Pop (size) values off the stack and put them into &ref[mem->offset]
-			Tut_EmitSetRef(vm, Tut_GetTypetagSize(mem->typetag), mem->offset);
+			Tut_EmitSetRef(program, Tut_GetTypetagSize(mem->typetag), mem->offset);
 		} break;
 
 		default:
@@ -670,34 +625,113 @@ static void CompileAssign(TutModule* module, TutVM* vm, TutExpr* lhs)
 	}
 }
 
-static void CompileCall(TutModule* module, TutVM* vm, TutExpr* exp, TutBool discardReturnValue)
+static TutExpr* SkipParens(TutModule* module, TutExpr* exp)
 {
-	assert(exp->callx.func->typetag);
-	assert(exp->callx.func->typetag->type == TUT_TYPETAG_FUNC);
+	while (exp->type == TUT_EXPR_PAREN)
+		exp = GetExpr(module, exp->parenExpr);
+
+	return exp;
+}
+
+// Returns the declaration if exp is a local variable of the given (single slot)
+// type whose index fits in a register operand, NULL otherwise
+static TutVarDecl* GetRegisterLocal(TutModule* module, TutExpr* exp, TutTypetagType type)
+{
+	exp = SkipParens(module, exp);
+
+	if (exp->type != TUT_EXPR_IDENT && exp->type != TUT_EXPR_VAR)
+		return NULL;
+
+	TutVarDecl* decl = exp->varx.decl;
+
+	if (!decl || !decl->parent || decl->typetag->type != type)
+		return NULL;
+
+	if (decl->index < INT16_MIN || decl->index > INT16_MAX)
+		return NULL;
+
+	return decl;
+}
+
+static TutObjectType GetObjectType(TutTypetagType type)
+{
+	switch (type)
+	{
+		case TUT_TYPETAG_BOOL: return TUT_OBJECT_BOOL;
+		case TUT_TYPETAG_INT: return TUT_OBJECT_INT;
+		case TUT_TYPETAG_FLOAT: return TUT_OBJECT_FLOAT;
+		case TUT_TYPETAG_STR: return TUT_OBJECT_STR;
+		case TUT_TYPETAG_CSTR: return TUT_OBJECT_CSTR;
+		case TUT_TYPETAG_REF: return TUT_OBJECT_REF;
+		case TUT_TYPETAG_PTR: return TUT_OBJECT_PTR;
+		case TUT_TYPETAG_FUNC: return TUT_OBJECT_FUNC;
+		default: break;
+	}
+
+	assert(0);
+	return TUT_OBJECT_BOOL;
+}
+
+// Tags the value of type tag whose first slot is depth slots below the top of the stack
+static void EmitTags(TutProgram* program, const TutTypetag* tag, int depth)
+{
+	if (tag->type != TUT_TYPETAG_USERTYPE)
+	{
+		Tut_EmitTag(program, (uint16_t)depth, (uint8_t)GetObjectType(tag->type));
+		return;
+	}
+
+	for (uint32_t i = 0; i < tag->user.members.length; ++i)
+	{
+		const TutTypetagMember* mem = Tut_ArrayGet((TutArray*)&tag->user.members, i);
+		EmitTags(program, mem->typetag, depth - mem->offset);
+	}
+}
+
+// Whether the callee is known to be a function of the program (which doesn't need
+// its arguments tagged in untagged programs)
+static TutBool IsScriptFunction(TutModule* module, TutExpr* func)
+{
+	func = SkipParens(module, func);
+
+	if (func->type != TUT_EXPR_IDENT && func->type != TUT_EXPR_VAR)
+		return TUT_FALSE;
+
+	return !func->varx.decl && func->varx.funcDecl && func->varx.funcDecl->type != TUT_FUNC_DECL_EXTERN;
+}
+
+static void CompileCall(TutModule* module, TutProgram* program, TutExpr* exp, TutBool discardReturnValue)
+{
+	assert(GetExpr(module, exp->callx.func)->typetag);
+	assert(GetExpr(module, exp->callx.func)->typetag->type == TUT_TYPETAG_FUNC);
+
+	TutBool tagArgs = Flags[TUT_CFLAG_UNTAGGED] && !IsScriptFunction(module, GetExpr(module, exp->callx.func));
 
 	int totalCount = 0;
 
-	TUT_LIST_EACH(node, exp->callx.args)
+	for (uint32_t i = 0; i < exp->callx.args.length; ++i)
 	{
-		TutExpr* arg = node->value;
+		TutExpr* arg = GetListExpr(module, exp->callx.args, i);
 
 		assert(arg->typetag);
 		totalCount += Tut_GetTypetagSize(arg->typetag);
 
-		CompileValue(module, vm, node->value);
+		CompileValue(module, program, arg);
+
+		if (tagArgs)
+			EmitTags(program, arg->typetag, Tut_GetTypetagSize(arg->typetag));
 	}
 	
-	CompileValue(module, vm, exp->callx.func);
-	Tut_EmitCall(vm, totalCount);
+	TutTypetag* ret = GetExpr(module, exp->callx.func)->typetag->func.ret;
 
-	if (discardReturnValue && exp->callx.func->typetag->func.ret->type != TUT_TYPETAG_VOID)
-	{
-		TutTypetag* ret = exp->callx.func->typetag->func.ret;
-		Tut_EmitPop(vm, Tut_GetTypetagSize(ret));
-	}
+	CompileValue(module, program, GetExpr(module, exp->callx.func));
+	Tut_EmitCall(program, totalCount, Tut_GetTypetagSize(ret));
+
+	if (discardReturnValue && ret->type != TUT_TYPETAG_VOID)
+		Tut_EmitPop(program, Tut_GetTypetagSize(ret));
 }
 
-static void CompileValue(TutModule* module, TutVM* vm, TutExpr* exp)
+static void CompileValue(TutModule* module, TutProgram* program, TutExpr* exp)
 {
 	assert(exp);
 	assert(exp->typetag);
@@ -707,37 +741,37 @@ static void CompileValue(TutModule* module, TutVM* vm, TutExpr* exp)
 		case TUT_EXPR_SIZEOF:
 		{
 			assert(exp->sizeofx.typetag);
-			Tut_EmitPushInt(vm, Tut_GetTypetagSize(exp->sizeofx.typetag) * sizeof(TutObject));
+			Tut_EmitPushInt(program, Tut_GetTypetagSize(exp->sizeofx.typetag) * sizeof(TutObject));
 		} break;
 
 		case TUT_EXPR_TRUE:
 		{
-			Tut_EmitOp(vm, TUT_OP_PUSH_TRUE);
+			Tut_EmitOp(program, TUT_OP_PUSH_TRUE);
 		} break;
 
 		case TUT_EXPR_FALSE:
 		{
-			Tut_EmitOp(vm, TUT_OP_PUSH_FALSE);
+			Tut_EmitOp(program, TUT_OP_PUSH_FALSE);
 		} break;
 
 		case TUT_EXPR_NULL:
 		{
-			Tut_EmitOp(vm, TUT_OP_PUSH_NULL);
+			Tut_EmitOp(program, TUT_OP_PUSH_NULL);
 		} break;
 
 		case TUT_EXPR_INT:
 		{
-			Tut_EmitPushInt(vm, exp->intVal);
+			Tut_EmitPushInt(program, exp->intVal);
 		} break;
 
 		case TUT_EXPR_FLOAT:
 		{
-			Tut_EmitPushFloat(vm, exp->floatVal);
+			Tut_EmitPushFloat(program, exp->floatVal);
 		} break;
 
 		case TUT_EXPR_STR:
 		{
-			Tut_EmitPushStr(vm, exp->string);
+			Tut_EmitPushStr(program, exp->string);
 		} break;
 		
 		case TUT_EXPR_IDENT:
@@ -753,10 +787,10 @@ static void CompileValue(TutModule* module, TutVM* vm, TutExpr* exp)
 			if (exp->varx.decl)
 			{
 				// BAM! Copy the entire thing at once
-				Tut_EmitGet(vm, !exp->varx.decl->parent, exp->varx.decl->index, Tut_GetTypetagSize(exp->varx.decl->typetag));
+				Tut_EmitGet(program, !exp->varx.decl->parent, exp->varx.decl->index, Tut_GetTypetagSize(exp->varx.decl->typetag));
 			}
 			else if (exp->varx.funcDecl)
-				Tut_EmitMakeFunc(vm, exp->varx.funcDecl->type == TUT_FUNC_DECL_EXTERN, exp->varx.funcDecl->index);
+				Tut_EmitMakeFunc(program, exp->varx.funcDecl->type == TUT_FUNC_DECL_EXTERN, exp->varx.funcDecl->index);
 		} break;
 
 		case TUT_EXPR_UNARY:
@@ -769,37 +803,37 @@ static void CompileValue(TutModule* module, TutVM* vm, TutExpr* exp)
 			{
 				assert(exp->typetag->type == TUT_TYPETAG_INT || exp->typetag->type == TUT_TYPETAG_FLOAT);
 
-				CompileValue(module, vm, exp->unaryx.value);
+				CompileValue(module, program, GetExpr(module, exp->unaryx.value));
 
 				if (exp->typetag->type == TUT_TYPETAG_INT)
-					Tut_EmitOp(vm, TUT_OP_INEG);
+					Tut_EmitOp(program, TUT_OP_INEG);
 				else if (exp->typetag->type == TUT_TYPETAG_FLOAT)
-					Tut_EmitOp(vm, TUT_OP_FNEG);
+					Tut_EmitOp(program, TUT_OP_FNEG);
 			}
 			else if (exp->unaryx.op == TUT_TOK_AND)
 			{
 				Lvalue value = { 0 };
 
-				if (!GetLvalue(&value, exp->unaryx.value, NULL))
+				if (!GetLvalue(module, &value, GetExpr(module, exp->unaryx.value), NULL))
 					CompilerError(exp, "Cannot create a reference to this value (possibly a temporary value).\n");
 
 				if(value.decl)
-					Tut_EmitMakeVarRef(vm, !value.decl->parent, value.decl->index + value.offset);
+					Tut_EmitMakeVarRef(program, !value.decl->parent, value.decl->index + value.offset);
 				else
 				{
 					// The 'root' value is the reference
 					assert(value.root);
-					CompileValue(module, vm, value.root);
+					CompileValue(module, program, value.root);
 
-					Tut_EmitMakeDynRef(vm, value.offset);
+					Tut_EmitMakeDynRef(program, value.offset);
 				}
 			}
 			else if (exp->unaryx.op == TUT_TOK_MUL)
 			{
 				// Push ref onto stack
-				CompileValue(module, vm, exp->unaryx.value);
+				CompileValue(module, program, GetExpr(module, exp->unaryx.value));
 				// memcpy ref values onto stack
-				Tut_EmitGetRef(vm, Tut_GetTypetagSize(exp->unaryx.value->typetag->ref.value), 0);
+				Tut_EmitGetRef(program, Tut_GetTypetagSize(GetExpr(module, exp->unaryx.value)->typetag->ref.value), 0);
 			}
 		} break;
 
@@ -807,77 +841,77 @@ static void CompileValue(TutModule* module, TutVM* vm, TutExpr* exp)
 		{
 			if (exp->binx.op != TUT_TOK_ASSIGN)
 			{
-				CompileValue(module, vm, exp->binx.lhs);
-				CompileValue(module, vm, exp->binx.rhs);
+				CompileValue(module, program, GetExpr(module, exp->binx.lhs));
+				CompileValue(module, program, GetExpr(module, exp->binx.rhs));
 
-				assert(exp->binx.lhs->typetag);
-				if (exp->binx.lhs->typetag->type == TUT_TYPETAG_INT)
+				assert(GetExpr(module, exp->binx.lhs)->typetag);
+				if (GetExpr(module, exp->binx.lhs)->typetag->type == TUT_TYPETAG_INT)
 				{
-					if (exp->binx.op == TUT_TOK_PLUS) Tut_EmitOp(vm, TUT_OP_ADDI);
-					else if (exp->binx.op == TUT_TOK_MINUS) Tut_EmitOp(vm, TUT_OP_SUBI);
-					else if (exp->binx.op == TUT_TOK_MUL) Tut_EmitOp(vm, TUT_OP_MULI);
-					else if (exp->binx.op == TUT_TOK_DIV) Tut_EmitOp(vm, TUT_OP_DIVI);
-					else if (exp->binx.op == TUT_TOK_LT) Tut_EmitOp(vm, TUT_OP_ILT);
-					else if (exp->binx.op == TUT_TOK_GT) Tut_EmitOp(vm, TUT_OP_IGT);
-					else if (exp->binx.op == TUT_TOK_LTE) Tut_EmitOp(vm, TUT_OP_ILTE);
-					else if (exp->binx.op == TUT_TOK_GTE) Tut_EmitOp(vm, TUT_OP_IGTE);
-					else if (exp->binx.op == TUT_TOK_EQUALS) Tut_EmitOp(vm, TUT_OP_IEQ);
+					if (exp->binx.op == TUT_TOK_PLUS) Tut_EmitOp(program, TUT_OP_ADDI);
+					else if (exp->binx.op == TUT_TOK_MINUS) Tut_EmitOp(program, TUT_OP_SUBI);
+					else if (exp->binx.op == TUT_TOK_MUL) Tut_EmitOp(program, TUT_OP_MULI);
+					else if (exp->binx.op == TUT_TOK_DIV) Tut_EmitOp(program, TUT_OP_DIVI);
+					else if (exp->binx.op == TUT_TOK_LT) Tut_EmitOp(program, TUT_OP_ILT);
+					else if (exp->binx.op == TUT_TOK_GT) Tut_EmitOp(program, TUT_OP_IGT);
+					else if (exp->binx.op == TUT_TOK_LTE) Tut_EmitOp(program, TUT_OP_ILTE);
+					else if (exp->binx.op == TUT_TOK_GTE) Tut_EmitOp(program, TUT_OP_IGTE);
+					else if (exp->binx.op == TUT_TOK_EQUALS) Tut_EmitOp(program, TUT_OP_IEQ);
 					else if (exp->binx.op == TUT_TOK_NEQUALS)
 					{
-						Tut_EmitOp(vm, TUT_OP_IEQ);
-						Tut_EmitOp(vm, TUT_OP_LNOT);
+						Tut_EmitOp(program, TUT_OP_IEQ);
+						Tut_EmitOp(program, TUT_OP_LNOT);
 					}
-					else CompilerError(exp, "Invalid binary operator '%s' for operation involving type '%s'.\n", Tut_TokenRepr(exp->binx.op), Tut_TypetagRepr(exp->binx.lhs->typetag));
+					else CompilerError(exp, "Invalid binary operator '%s' for operation involving type '%s'.\n", Tut_TokenRepr(exp->binx.op), Tut_TypetagRepr(GetExpr(module, exp->binx.lhs)->typetag));
 				}
-				else if (exp->binx.lhs->typetag->type == TUT_TYPETAG_FLOAT)
+				else if (GetExpr(module, exp->binx.lhs)->typetag->type == TUT_TYPETAG_FLOAT)
 				{
-					if (exp->binx.op == TUT_TOK_PLUS) Tut_EmitOp(vm, TUT_OP_ADDF);
-					else if (exp->binx.op == TUT_TOK_MINUS) Tut_EmitOp(vm, TUT_OP_SUBF);
-					else if (exp->binx.op == TUT_TOK_MUL) Tut_EmitOp(vm, TUT_OP_MULF);
-					else if (exp->binx.op == TUT_TOK_DIV) Tut_EmitOp(vm, TUT_OP_DIVF);
-					else if (exp->binx.op == TUT_TOK_LT) Tut_EmitOp(vm, TUT_OP_FLT);
-					else if (exp->binx.op == TUT_TOK_GT) Tut_EmitOp(vm, TUT_OP_FGT);
-					else if (exp->binx.op == TUT_TOK_LTE) Tut_EmitOp(vm, TUT_OP_FLTE);
-					else if (exp->binx.op == TUT_TOK_GTE) Tut_EmitOp(vm, TUT_OP_FGTE);
-					else if (exp->binx.op == TUT_TOK_EQUALS) Tut_EmitOp(vm, TUT_OP_FEQ);
+					if (exp->binx.op == TUT_TOK_PLUS) Tut_EmitOp(program, TUT_OP_ADDF);
+					else if (exp->binx.op == TUT_TOK_MINUS) Tut_EmitOp(program, TUT_OP_SUBF);
+					else if (exp->binx.op == TUT_TOK_MUL) Tut_EmitOp(program, TUT_OP_MULF);
+					else if (exp->binx.op == TUT_TOK_DIV) Tut_EmitOp(program, TUT_OP_DIVF);
+					else if (exp->binx.op == TUT_TOK_LT) Tut_EmitOp(program, TUT_OP_FLT);
+					else if (exp->binx.op == TUT_TOK_GT) Tut_EmitOp(program, TUT_OP_FGT);
+					else if (exp->binx.op == TUT_TOK_LTE) Tut_EmitOp(program, TUT_OP_FLTE);
+					else if (exp->binx.op == TUT_TOK_GTE) Tut_EmitOp(program, TUT_OP_FGTE);
+					else if (exp->binx.op == TUT_TOK_EQUALS) Tut_EmitOp(program, TUT_OP_FEQ);
 					else if (exp->binx.op == TUT_TOK_NEQUALS)
 					{
-						Tut_EmitOp(vm, TUT_OP_FEQ);
-						Tut_EmitOp(vm, TUT_OP_LNOT);
+						Tut_EmitOp(program, TUT_OP_FEQ);
+						Tut_EmitOp(program, TUT_OP_LNOT);
 					}
-					else CompilerError(exp, "Invalid binary operator '%s' for operation involving type '%s'.\n", Tut_TokenRepr(exp->binx.op), Tut_TypetagRepr(exp->binx.lhs->typetag));
+					else CompilerError(exp, "Invalid binary operator '%s' for operation involving type '%s'.\n", Tut_TokenRepr(exp->binx.op), Tut_TypetagRepr(GetExpr(module, exp->binx.lhs)->typetag));
 				}
-				else if (exp->binx.lhs->typetag->type == TUT_TYPETAG_STR)
+				else if (GetExpr(module, exp->binx.lhs)->typetag->type == TUT_TYPETAG_STR)
 				{
-					if (exp->binx.op == TUT_TOK_EQUALS) Tut_EmitOp(vm, TUT_OP_SEQ);
+					if (exp->binx.op == TUT_TOK_EQUALS) Tut_EmitOp(program, TUT_OP_SEQ);
 					else if (exp->binx.op == TUT_TOK_NEQUALS)
 					{
-						Tut_EmitOp(vm, TUT_OP_SEQ);
-						Tut_EmitOp(vm, TUT_OP_LNOT);
+						Tut_EmitOp(program, TUT_OP_SEQ);
+						Tut_EmitOp(program, TUT_OP_LNOT);
 					}
-					else CompilerError(exp, "Invalid binary operator '%s' for operation involving type '%s'.\n", Tut_TokenRepr(exp->binx.op), Tut_TypetagRepr(exp->binx.lhs->typetag));
+					else CompilerError(exp, "Invalid binary operator '%s' for operation involving type '%s'.\n", Tut_TokenRepr(exp->binx.op), Tut_TypetagRepr(GetExpr(module, exp->binx.lhs)->typetag));
 				}
-				else if (exp->binx.lhs->typetag->type == TUT_TYPETAG_BOOL)
+				else if (GetExpr(module, exp->binx.lhs)->typetag->type == TUT_TYPETAG_BOOL)
 				{
-					if (exp->binx.op == TUT_TOK_LAND) Tut_EmitOp(vm, TUT_OP_LAND);
-					else if (exp->binx.op == TUT_TOK_LOR) Tut_EmitOp(vm, TUT_OP_LOR);
-					else if (exp->binx.op == TUT_TOK_EQUALS) Tut_EmitOp(vm, TUT_OP_BEQ);
+					if (exp->binx.op == TUT_TOK_LAND) Tut_EmitOp(program, TUT_OP_LAND);
+					else if (exp->binx.op == TUT_TOK_LOR) Tut_EmitOp(program, TUT_OP_LOR);
+					else if (exp->binx.op == TUT_TOK_EQUALS) Tut_EmitOp(program, TUT_OP_BEQ);
 					else if (exp->binx.op == TUT_TOK_NEQUALS)
 					{
-						Tut_EmitOp(vm, TUT_OP_BEQ);
-						Tut_EmitOp(vm, TUT_OP_LNOT);
+						Tut_EmitOp(program, TUT_OP_BEQ);
+						Tut_EmitOp(program, TUT_OP_LNOT);
 					}
-					else CompilerError(exp, "Invalid binary operator '%s' for operation involving type '%s'.\n", Tut_TokenRepr(exp->binx.op), Tut_TypetagRepr(exp->binx.lhs->typetag));
+					else CompilerError(exp, "Invalid binary operator '%s' for operation involving type '%s'.\n", Tut_TokenRepr(exp->binx.op), Tut_TypetagRepr(GetExpr(module, exp->binx.lhs)->typetag));
 				}
-				else if (exp->binx.lhs->typetag->type == TUT_TYPETAG_REF)
+				else if (GetExpr(module, exp->binx.lhs)->typetag->type == TUT_TYPETAG_REF)
 				{
-					if (exp->binx.op == TUT_TOK_EQUALS) Tut_EmitOp(vm, TUT_OP_REQ);
+					if (exp->binx.op == TUT_TOK_EQUALS) Tut_EmitOp(program, TUT_OP_REQ);
 					else if (exp->binx.op == TUT_TOK_NEQUALS)
 					{
-						Tut_EmitOp(vm, TUT_OP_REQ);
-						Tut_EmitOp(vm, TUT_OP_LNOT);
+						Tut_EmitOp(program, TUT_OP_REQ);
+						Tut_EmitOp(program, TUT_OP_LNOT);
 					}
-					else CompilerError(exp, "Invalid binary operator '%s' for operation involving type '%s'.\n", Tut_TokenRepr(exp->binx.op), Tut_TypetagRepr(exp->binx.lhs->typetag));
+					else CompilerError(exp, "Invalid binary operator '%s' for operation involving type '%s'.\n", Tut_TokenRepr(exp->binx.op), Tut_TypetagRepr(GetExpr(module, exp->binx.lhs)->typetag));
 				}
 				else
 					CompilerError(exp, "(INTERNAL) Invalid lhs type in binary operation. Invalid type resolution, possibly?\n");
@@ -888,22 +922,22 @@ static void CompileValue(TutModule* module, TutVM* vm, TutExpr* exp)
 
 		case TUT_EXPR_PAREN:
 		{
-			CompileValue(module, vm, exp->parenExpr);
+			CompileValue(module, program, GetExpr(module, exp->parenExpr));
 		} break;
 
 		case TUT_EXPR_DOT:
 		{
-			assert(exp->dotx.value->typetag);
-			assert(exp->dotx.value->typetag->type == TUT_TYPETAG_USERTYPE);
+			assert(GetExpr(module, exp->dotx.value)->typetag);
+			assert(GetExpr(module, exp->dotx.value)->typetag->type == TUT_TYPETAG_USERTYPE);
 
-			CompileValue(module, vm, exp->dotx.value);
+			CompileValue(module, program, GetExpr(module, exp->dotx.value));
 
 			// Every value of the structure is pushed onto the stack
 			//                x   y   z
 			// stack = [10, { 20, 30, 40 }], where curly braces denote values in the struct
 			// if we wanna get at y, we have to pop z and then move y's value to x
 	
-			TutTypetag* tag = exp->dotx.value->typetag;
+			TutTypetag* tag = GetExpr(module, exp->dotx.value)->typetag;
 			TutTypetagMember* mem = GetMember(tag, exp->dotx.memberName);
 
 			int size = Tut_GetTypetagSize(tag);
@@ -914,33 +948,43 @@ static void CompileValue(TutModule* module, TutVM* vm, TutExpr* exp)
 			int amountToPop = size - mem->offset - memberSize;
 			int amountToMove = mem->offset;
 
-			Tut_EmitPop(vm, amountToPop);
-			Tut_EmitMove(vm, memberSize, amountToMove);
+			Tut_EmitPop(program, amountToPop);
+			Tut_EmitMove(program, memberSize, amountToMove);
 		} break;
 
 		case TUT_EXPR_ARROW:
 		{
-			assert(exp->dotx.value->typetag);
-			assert(exp->dotx.value->typetag->type == TUT_TYPETAG_REF);
-			assert(exp->dotx.value->typetag->ref.value->type == TUT_TYPETAG_USERTYPE);
+			assert(GetExpr(module, exp->dotx.value)->typetag);
+			assert(GetExpr(module, exp->dotx.value)->typetag->type == TUT_TYPETAG_REF);
+			assert(GetExpr(module, exp->dotx.value)->typetag->ref.value->type == TUT_TYPETAG_USERTYPE);
 
-			// Push ref onto stack
-			CompileValue(module, vm, exp->dotx.value);
-
-			TutTypetagMember* mem = GetMember(exp->dotx.value->typetag->ref.value, exp->dotx.memberName);
+			TutTypetagMember* mem = GetMember(GetExpr(module, exp->dotx.value)->typetag->ref.value, exp->dotx.memberName);
 			assert(mem);
 
-			Tut_EmitGetRef(vm, Tut_GetTypetagSize(mem->typetag), mem->offset);
+			int memberSize = Tut_GetTypetagSize(mem->typetag);
+
+			// local->member
+			TutVarDecl* decl = GetRegisterLocal(module, GetExpr(module, exp->dotx.value), TUT_TYPETAG_REF);
+			if (decl && memberSize == 1)
+			{
+				Tut_EmitGetFieldLocal(program, (int16_t)decl->index, (uint16_t)mem->offset);
+				break;
+			}
+
+			// Push ref onto stack
+			CompileValue(module, program, GetExpr(module, exp->dotx.value));
+
+			Tut_EmitGetRef(program, memberSize, mem->offset);
 		} break;
 		
 		case TUT_EXPR_CAST:
 		{
-			CompileValue(module, vm, exp->castx.value);
+			CompileValue(module, program, GetExpr(module, exp->castx.value));
 		} break;
 
 		case TUT_EXPR_CALL:
 		{
-			CompileCall(module, vm, exp, TUT_FALSE);
+			CompileCall(module, program, exp, TUT_FALSE);
 		} break;
 
 		default:
@@ -949,7 +993,170 @@ static void CompileValue(TutModule* module, TutVM* vm, TutExpr* exp)
 	}
 }
 
-static void CompileStatement(TutModule* module, TutVM* vm, TutExpr* exp)
+static int GetArithmeticOpOffset(int op)
+{
+	switch (op)
+	{
+		case TUT_TOK_PLUS: return 0;
+		case TUT_TOK_MINUS: return 1;
+		case TUT_TOK_MUL: return 2;
+		case TUT_TOK_DIV: return 3;
+	}
+
+	return -1;
+}
+
+// Lowers 'local = a op b' to a single three-address op when the destination
+// and operands are locals or constants. Returns TUT_FALSE if the assignment has
+// to go through the stack instead.
+// Only assignment statements are lowered: arithmetic inside a larger expression
+// (arguments, conditions, 'x = (a + b) * c') stays on the stack, since writing it
+// to a temporary slot would need the expression's stack depth, which the compiler
+// doesn't track.
+static TutBool CompileRegisterAssign(TutModule* module, TutProgram* program, TutExpr* lhs, TutExpr* rhs)
+{
+	rhs = SkipParens(module, rhs);
+
+	if (rhs->type != TUT_EXPR_BIN)
+		return TUT_FALSE;
+
+	int opOffset = GetArithmeticOpOffset(rhs->binx.op);
+	if (opOffset < 0)
+		return TUT_FALSE;
+
+	TutTypetagType type = rhs->typetag->type;
+	if (type != TUT_TYPETAG_INT && type != TUT_TYPETAG_FLOAT)
+		return TUT_FALSE;
+
+	TutVarDecl* dst = GetRegisterLocal(module, lhs, type);
+	if (!dst)
+		return TUT_FALSE;
+
+	TutExpr* a = SkipParens(module, GetExpr(module, rhs->binx.lhs));
+	TutExpr* b = SkipParens(module, GetExpr(module, rhs->binx.rhs));
+
+	TutExprType constType = type == TUT_TYPETAG_INT ? TUT_EXPR_INT : TUT_EXPR_FLOAT;
+
+	// k + a and k * a can be flipped around
+	if (a->type == constType && (rhs->binx.op == TUT_TOK_PLUS || rhs->binx.op == TUT_TOK_MUL))
+	{
+		TutExpr* temp = a;
+		a = b;
+		b = temp;
+	}
+
+	TutVarDecl* aDecl = GetRegisterLocal(module, a, type);
+	if (!aDecl)
+		return TUT_FALSE;
+
+	TutVarDecl* bDecl = GetRegisterLocal(module, b, type);
+
+	if (bDecl)
+	{
+		uint8_t op = (type == TUT_TYPETAG_INT ? TUT_OP_ADDI_LLL : TUT_OP_ADDF_LLL) + opOffset;
+		Tut_EmitLocalBinOp(program, op, (int16_t)dst->index, (int16_t)aDecl->index, (int16_t)bDecl->index);
+
+		return TUT_TRUE;
+	}
+	
+	if (b->type != constType)
+		return TUT_FALSE;
+
+	// Counters
+	if (type == TUT_TYPETAG_INT && dst == aDecl && (rhs->binx.op == TUT_TOK_PLUS || (rhs->binx.op == TUT_TOK_MINUS && b->intVal != INT32_MIN)))
+		Tut_EmitIncLocal(program, (int16_t)dst->index, rhs->binx.op == TUT_TOK_PLUS ? b->intVal : -b->intVal);
+	else if (type == TUT_TYPETAG_INT)
+		Tut_EmitLocalBinOpInt(program, TUT_OP_ADDI_LLK + opOffset, (int16_t)dst->index, (int16_t)aDecl->index, b->intVal);
+	else
+		Tut_EmitLocalBinOpFloat(program, TUT_OP_ADDF_LLK + opOffset, (int16_t)dst->index, (int16_t)aDecl->index, b->floatVal);
+
+	return TUT_TRUE;
+}
+
+// Ops which jump unless the comparison holds, indexed by token (see GetCompareJump)
+typedef struct
+{
+	uint8_t ll, lk;
+	TutBool swapLL;
+} CompareJumpOps;
+
+static TutBool GetCompareJump(int op, CompareJumpOps* ops)
+{
+	switch (op)
+	{
+		case TUT_TOK_LT: ops->ll = TUT_OP_ILT_LL_JF; ops->lk = TUT_OP_ILT_LK_JF; ops->swapLL = TUT_FALSE; return TUT_TRUE;
+		case TUT_TOK_LTE: ops->ll = TUT_OP_ILTE_LL_JF; ops->lk = TUT_OP_ILTE_LK_JF; ops->swapLL = TUT_FALSE; return TUT_TRUE;
+		case TUT_TOK_GT: ops->ll = TUT_OP_ILT_LL_JF; ops->lk = TUT_OP_IGT_LK_JF; ops->swapLL = TUT_TRUE; return TUT_TRUE;
+		case TUT_TOK_GTE: ops->ll = TUT_OP_ILTE_LL_JF; ops->lk = TUT_OP_IGTE_LK_JF; ops->swapLL = TUT_TRUE; return TUT_TRUE;
+		case TUT_TOK_EQUALS: ops->ll = TUT_OP_IEQ_LL_JF; ops->lk = TUT_OP_IEQ_LK_JF; ops->swapLL = TUT_FALSE; return TUT_TRUE;
+		case TUT_TOK_NEQUALS: ops->ll = TUT_OP_INE_LL_JF; ops->lk = TUT_OP_INE_LK_JF; ops->swapLL = TUT_FALSE; return TUT_TRUE;
+	}
+
+	return TUT_FALSE;
+}
+
+static int MirrorCompare(int op)
+{
+	switch (op)
+	{
+		case TUT_TOK_LT: return TUT_TOK_GT;
+		case TUT_TOK_LTE: return TUT_TOK_GTE;
+		case TUT_TOK_GT: return TUT_TOK_LT;
+		case TUT_TOK_GTE: return TUT_TOK_LTE;
+	}
+
+	return op;
+}
+
+// Emits a jump which is taken if cond is false and returns where its target has
+// to be patched. Comparisons of an int local with another one or with a constant
+// are a single instruction.
+static int32_t CompileConditionalJump(TutModule* module, TutProgram* program, TutExpr* cond)
+{
+	TutExpr* exp = SkipParens(module, cond);
+	CompareJumpOps ops;
+
+	if (exp->type == TUT_EXPR_BIN && GetCompareJump(exp->binx.op, &ops))
+	{
+		int op = exp->binx.op;
+
+		TutExpr* a = SkipParens(module, GetExpr(module, exp->binx.lhs));
+		TutExpr* b = SkipParens(module, GetExpr(module, exp->binx.rhs));
+
+		if (a->type == TUT_EXPR_INT)
+		{
+			TutExpr* temp = a;
+			a = b;
+			b = temp;
+
+			op = MirrorCompare(op);
+			GetCompareJump(op, &ops);
+		}
+
+		TutVarDecl* aDecl = GetRegisterLocal(module, a, TUT_TYPETAG_INT);
+		TutVarDecl* bDecl = GetRegisterLocal(module, b, TUT_TYPETAG_INT);
+
+		if (aDecl && bDecl)
+		{
+			if (ops.swapLL)
+			{
+				TutVarDecl* temp = aDecl;
+				aDecl = bDecl;
+				bDecl = temp;
+			}
+
+			return Tut_EmitLocalCompareJump(program, ops.ll, (int16_t)aDecl->index, (int16_t)bDecl->index, 0);
+		}
+
+		if (aDecl && b->type == TUT_EXPR_INT)
+			return Tut_EmitLocalCompareJumpInt(program, ops.lk, (int16_t)aDecl->index, b->intVal, 0);
+	}
+
+	CompileValue(module, program, cond);
+	return Tut_EmitGoto(program, TUT_TRUE, 0);
+}
+
+static void CompileStatement(TutModule* module, TutProgram* program, TutExpr* exp)
 {
 	assert(exp);
 
@@ -963,42 +1170,40 @@ static void CompileStatement(TutModule* module, TutVM* vm, TutExpr* exp)
 
 		case TUT_EXPR_BLOCK:
 		{
-			TUT_LIST_EACH(node, exp->blockList)
-				CompileStatement(module, vm, node->value);
+			for (uint32_t i = 0; i < exp->blockList.length; ++i)
+				CompileStatement(module, program, GetListExpr(module, exp->blockList, i));
 		} break;
 
 		case TUT_EXPR_IF:
 		{
-			CompileValue(module, vm, exp->ifx.cond);
-			int32_t patchLoc = Tut_EmitGoto(vm, TUT_TRUE, 0);
+			int32_t patchLoc = CompileConditionalJump(module, program, GetExpr(module, exp->ifx.cond));
 
-			CompileStatement(module, vm, exp->ifx.body);
-			int32_t exitPatchLoc = Tut_EmitGoto(vm, TUT_FALSE, 0);
+			CompileStatement(module, program, GetExpr(module, exp->ifx.body));
+			int32_t exitPatchLoc = Tut_EmitGoto(program, TUT_FALSE, 0);
 			
-			Tut_PatchGoto(vm, patchLoc, vm->codeSize);
+			Tut_PatchGoto(program, patchLoc, program->codeSize);
 
-			if (exp->ifx.alt)
-				CompileStatement(module, vm, exp->ifx.alt);
+			if (exp->ifx.alt != TUT_EXPR_NONE)
+				CompileStatement(module, program, GetExpr(module, exp->ifx.alt));
 
-			Tut_PatchGoto(vm, exitPatchLoc, vm->codeSize);
+			Tut_PatchGoto(program, exitPatchLoc, program->codeSize);
 		} break;
 
 		case TUT_EXPR_WHILE:
 		{
-			int continueLoc = vm->codeSize;
+			int continueLoc = program->codeSize;
 			
-			CompileValue(module, vm, exp->whilex.cond);
-			int32_t patchLoc = Tut_EmitGoto(vm, TUT_TRUE, 0);
+			int32_t patchLoc = CompileConditionalJump(module, program, GetExpr(module, exp->whilex.cond));
 
-			CompileStatement(module, vm, exp->whilex.body);
-			Tut_EmitGoto(vm, TUT_FALSE, continueLoc);
+			CompileStatement(module, program, GetExpr(module, exp->whilex.body));
+			Tut_EmitGoto(program, TUT_FALSE, continueLoc);
 
-			Tut_PatchGoto(vm, patchLoc, vm->codeSize);
+			Tut_PatchGoto(program, patchLoc, program->codeSize);
 		} break;
 
 		case TUT_EXPR_FUNC:
 		{
-			Tut_EmitFunctionEntryPoint(vm);
+			Tut_EmitFunctionEntryPoint(program, exp->funcx.decl->index);
 
 			// Make space for each locals
 			int totalLocalSize = 0;
@@ -1008,29 +1213,39 @@ static void CompileStatement(TutModule* module, TutVM* vm, TutExpr* exp)
 				totalLocalSize += Tut_GetTypetagSize(decl->typetag);
 			}
 			if (totalLocalSize > 0)
-				Tut_EmitPush(vm, totalLocalSize);
+				Tut_EmitPush(program, totalLocalSize);
 
-			CompileStatement(module, vm, exp->funcx.body);
-			
-			Tut_EmitOp(vm, TUT_OP_RET);
+			CompileStatement(module, program, GetExpr(module, exp->funcx.body));
+
+			// Falling off the end of a function which returns a value still has to
+			// return as many objects as its callers expect (see Tut_VerifyProgram)
+			int retSize = Tut_GetTypetagSize(exp->funcx.decl->typetag->func.ret);
+
+			if (retSize > 0)
+			{
+				Tut_EmitPush(program, retSize);
+				Tut_EmitRetval(program, retSize);
+			}
+			else
+				Tut_EmitOp(program, TUT_OP_RET);
 		} break;
 
 		case TUT_EXPR_CALL:
 		{
-			CompileCall(module, vm, exp, TUT_TRUE);
+			CompileCall(module, program, exp, TUT_TRUE);
 		} break;
 
 		case TUT_EXPR_RETURN:
 		{
-			if (exp->retx.value)
+			if (exp->retx.value != TUT_EXPR_NONE)
 			{
-				assert(exp->retx.value->typetag);
+				assert(GetExpr(module, exp->retx.value)->typetag);
 
-				CompileValue(module, vm, exp->retx.value);
-				Tut_EmitRetval(vm, Tut_GetTypetagSize(exp->retx.value->typetag));
+				CompileValue(module, program, GetExpr(module, exp->retx.value));
+				Tut_EmitRetval(program, Tut_GetTypetagSize(GetExpr(module, exp->retx.value)->typetag));
 			}
 			else
-				Tut_EmitOp(vm, TUT_OP_RET);
+				Tut_EmitOp(program, TUT_OP_RET);
 		} break;
 
 		case TUT_EXPR_BIN:
@@ -1038,8 +1253,11 @@ static void CompileStatement(TutModule* module, TutVM* vm, TutExpr* exp)
 			if (exp->binx.op != TUT_TOK_ASSIGN)
 				CompilerError(exp, "Found expression when expecting statement.\n");
 
-			CompileValue(module, vm, exp->binx.rhs);
-			CompileAssign(module, vm, exp->binx.lhs);
+			if (CompileRegisterAssign(module, program, GetExpr(module, exp->binx.lhs), GetExpr(module, exp->binx.rhs)))
+				break;
+
+			CompileValue(module, program, GetExpr(module, exp->binx.rhs));
+			CompileAssign(module, program, GetExpr(module, exp->binx.lhs));
 		} break;
 
 		default:
@@ -1048,56 +1266,617 @@ static void CompileStatement(TutModule* module, TutVM* vm, TutExpr* exp)
 	}
 }
 
-void Tut_CompileModule(TutModule* module, TutVM* vm)
+static void StoreExternNames(TutProgram* program, TutList* functions)
+{
+	TUT_LIST_EACH(node, *functions)
+	{
+		TutFuncDecl* decl = node->value;
+
+		if (decl->type == TUT_FUNC_DECL_EXTERN)
+		{
+			char* name = Tut_Strdup(decl->name);
+			Tut_ArraySet(&program->externNames, decl->index, &name);
+		}
+		else
+			StoreExternNames(program, &decl->nestedFunctions);
+	}
+}
+
+// Imports come before the modules importing them; every module is added once
+static void CollectModules(TutList* modules, TutModule* module)
+{
+	TUT_LIST_EACH(node, *modules)
+	{
+		if (node->value == module)
+			return;
+	}
+
+	TUT_LIST_EACH(node, module->importedModules)
+		CollectModules(modules, node->value);
+
+	Tut_ListAppend(modules, module);
+}
+
+typedef struct
+{
+	char* path;
+	uint32_t pathHash;
+
+	uint32_t contentHash;
+	size_t contentLength;
+	uint32_t signatureHash;
+	// CompileDependency, what the chunk's code was resolved against
+	TutArray dependencies;
+
+	TutProgram* chunk;
+} CompileCacheEntry;
+
+static uint32_t MixHash(uint32_t hash, uint32_t value)
+{
+	return Tut_HashUint32(hash * 31 + value);
+}
+
+// Usertypes are hashed by name here, their layout is hashed separately
+static uint32_t HashTypetag(uint32_t hash, const TutTypetag* tag)
+{
+	if (!tag)
+		return MixHash(hash, 0);
+
+	hash = MixHash(hash, tag->type + 1);
+
+	switch (tag->type)
+	{
+		case TUT_TYPETAG_USERTYPE: return MixHash(hash, Tut_AtomHash(tag->user.name));
+		case TUT_TYPETAG_REF: return HashTypetag(hash, tag->ref.value);
+
+		case TUT_TYPETAG_FUNC:
+		{
+			hash = HashTypetag(hash, tag->func.ret);
+
+			TUT_LIST_EACH(node, tag->func.args)
+				hash = HashTypetag(hash, node->value);
+
+			return MixHash(hash, tag->func.hasVarargs);
+		}
+
+		default: return hash;
+	}
+}
+
+static uint32_t HashFunctions(uint32_t hash, const TutList* functions)
+{
+	TUT_LIST_EACH(node, *functions)
+	{
+		const TutFuncDecl* decl = node->value;
+
+		hash = MixHash(hash, Tut_AtomHash(decl->name));
+		hash = MixHash(hash, decl->type);
+		hash = MixHash(hash, (uint32_t)decl->index);
+		hash = HashTypetag(hash, decl->typetag);
+
+		// Nested functions take indices from the same counter
+		hash = HashFunctions(hash, &decl->nestedFunctions);
+	}
+
+	return hash;
+}
+
+// The indices the module's functions, externs and globals were given and the types
+// and layouts they have
+static uint32_t HashDeclarations(const TutModule* module)
+{
+	uint32_t hash = HashFunctions(0, &module->functions);
+
+	TUT_LIST_EACH(node, module->globals)
+	{
+		const TutVarDecl* decl = node->value;
+
+		hash = MixHash(hash, Tut_AtomHash(decl->name));
+		hash = MixHash(hash, (uint32_t)decl->index);
+		hash = HashTypetag(hash, decl->typetag);
+	}
+
+	TUT_LIST_EACH(node, module->usertypes)
+	{
+		const TutTypetag* tag = node->value;
+
+		hash = MixHash(hash, Tut_AtomHash(tag->user.name));
+		hash = MixHash(hash, (uint32_t)tag->user.size);
+
+		for (uint32_t i = 0; i < tag->user.members.length; ++i)
+		{
+			const TutTypetagMember* mem = Tut_ArrayGetConst(&tag->user.members, i);
+
+			hash = MixHash(hash, Tut_AtomHash(mem->name));
+			hash = MixHash(hash, (uint32_t)mem->offset);
+			hash = HashTypetag(hash, mem->typetag);
+		}
+	}
+
+	return hash;
+}
+
+// Structs are hashed by value; refs and usertypes inside them only by name
+static uint32_t HashLayout(uint32_t hash, const TutTypetag* tag)
+{
+	hash = HashTypetag(hash, tag);
+
+	if (tag->type != TUT_TYPETAG_USERTYPE)
+		return hash;
+
+	for (uint32_t i = 0; i < tag->user.members.length; ++i)
+	{
+		const TutTypetagMember* mem = Tut_ArrayGet((TutArray*)&tag->user.members, i);
+
+		hash = MixHash(hash, Tut_AtomHash(mem->name));
+		hash = MixHash(hash, (uint32_t)mem->offset);
+		hash = HashLayout(hash, mem->typetag);
+	}
+
+	return hash;
+}
+
+typedef enum
+{
+	// A name the module's code looks up outside of its functions' locals
+	DEPENDENCY_IDENT,
+	// A struct the module's code or locals use, directly or through refs and functions
+	DEPENDENCY_USERTYPE
+} CompileDependencyType;
+
+typedef struct
+{
+	CompileDependencyType type;
+	TutAtom name;
+} CompileDependency;
+
+static void AddDependency(TutArray* deps, CompileDependencyType type, TutAtom name)
+{
+	CompileDependency dep;
+
+	dep.type = type;
+	dep.name = name;
+
+	Tut_ArrayPush(deps, &dep);
+}
+
+static void AddTypetagDependencies(TutArray* deps, const TutTypetag* tag)
+{
+	if (!tag)
+		return;
+
+	switch (tag->type)
+	{
+		case TUT_TYPETAG_USERTYPE: AddDependency(deps, DEPENDENCY_USERTYPE, tag->user.name); break;
+		case TUT_TYPETAG_REF: AddTypetagDependencies(deps, tag->ref.value); break;
+
+		case TUT_TYPETAG_FUNC:
+		{
+			AddTypetagDependencies(deps, tag->func.ret);
+
+			TUT_LIST_EACH(node, tag->func.args)
+				AddTypetagDependencies(deps, node->value);
+		} break;
+
+		default: break;
+	}
+}
+
+static int CompareDependencies(const void* a, const void* b)
+{
+	const CompileDependency* da = a;
+	const CompileDependency* db = b;
+
+	if (da->type != db->type)
+		return da->type < db->type ? -1 : 1;
+	if (da->name != db->name)
+		return (uintptr_t)da->name < (uintptr_t)db->name ? -1 : 1;
+
+	return 0;
+}
+
+// Has to run after the module is compiled, when every identifier is resolved
+static void CollectDependencies(const TutModule* module, TutArray* deps)
+{
+	Tut_ArrayClear(deps);
+
+	for (TutExprIndex i = 1; i < module->ast.exprs.length; ++i)
+	{
+		const TutExpr* exp = TUT_AST_EXPR(&module->ast, i);
+
+		AddTypetagDependencies(deps, exp->typetag);
+
+		switch (exp->type)
+		{
+			case TUT_EXPR_IDENT:
+			case TUT_EXPR_VAR:
+			{
+				// Locals shadow everything else so they stay bound to the same thing
+				if (!exp->varx.decl || !exp->varx.decl->parent)
+					AddDependency(deps, DEPENDENCY_IDENT, exp->varx.name);
+
+				AddTypetagDependencies(deps, exp->varx.typetag);
+			} break;
+
+			case TUT_EXPR_FUNC:
+			{
+				TUT_LIST_EACH(node, exp->funcx.decl->args)
+					AddTypetagDependencies(deps, ((const TutVarDecl*)node->value)->typetag);
+				TUT_LIST_EACH(node, exp->funcx.decl->locals)
+					AddTypetagDependencies(deps, ((const TutVarDecl*)node->value)->typetag);
+			} break;
+
+			case TUT_EXPR_CAST: AddTypetagDependencies(deps, exp->castx.typetag); break;
+			case TUT_EXPR_SIZEOF: AddTypetagDependencies(deps, exp->sizeofx.typetag); break;
+			case TUT_EXPR_STRUCT_DEF: AddTypetagDependencies(deps, exp->structx.typetag); break;
+
+			default: break;
+		}
+	}
+
+	if (deps->length == 0)
+		return;
+
+	Tut_ArraySort(deps, CompareDependencies, NULL);
+
+	// Drop duplicates
+	uint32_t length = 0;
+	for (uint32_t i = 0; i < deps->length; ++i)
+	{
+		if (length > 0 && CompareDependencies(Tut_ArrayGet(deps, length - 1), Tut_ArrayGet(deps, i)) == 0)
+			continue;
+
+		if (length != i)
+			Tut_ArraySet(deps, length, Tut_ArrayGet(deps, i));
+		++length;
+	}
+
+	deps->length = length;
+}
+
+// Resolves name the way ResolveIdent does
+static uint32_t HashIdent(uint32_t hash, TutSymbolTable* table, TutAtom name)
 {
-	TutFuncDecl* decl = Tut_GetFuncDecl(module->symbolTable, "_main");
+	const TutVarDecl* var = Tut_GetVarDecl(table, name, 0);
+	if (var)
+	{
+		hash = MixHash(hash, 1);
+		hash = MixHash(hash, (uint32_t)var->index);
+		return HashTypetag(hash, var->typetag);
+	}
+
+	const TutFuncDecl* func = Tut_GetFuncDecl(table, name);
+	if (func)
+	{
+		hash = MixHash(hash, 2);
+		hash = MixHash(hash, func->type);
+		hash = MixHash(hash, (uint32_t)func->index);
+		return HashTypetag(hash, func->typetag);
+	}
+
+	const TutTypetag* tag = Tut_FindPrimitiveTypetag(name);
+	if (!tag)
+		tag = Tut_GetType(table, name);
+
+	return HashTypetag(MixHash(hash, 3), tag);
+}
+
+// Everything the chunk of module was compiled against: the module's own declarations,
+// whatever deps resolve to in the symbol table and the flags. If this is unchanged,
+// an unchanged module compiles to the same code.
+static uint32_t HashSignature(const TutModule* module, const TutArray* deps)
+{
+	uint32_t hash = HashDeclarations(module);
+
+	for (uint32_t i = 0; i < deps->length; ++i)
+	{
+		const CompileDependency* dep = Tut_ArrayGetConst(deps, i);
+
+		hash = MixHash(hash, Tut_AtomHash(dep->name));
+
+		if (dep->type == DEPENDENCY_IDENT)
+			hash = HashIdent(hash, module->symbolTable, dep->name);
+		else
+		{
+			const TutTypetag* tag = Tut_GetType(module->symbolTable, dep->name);
+
+			hash = MixHash(hash, tag ? (uint32_t)tag->user.size : 0);
+			if (tag)
+				hash = HashLayout(hash, tag);
+		}
+	}
+
+	hash = MixHash(hash, Flags[TUT_CFLAG_NO_PEEPHOLE] != NULL);
+	hash = MixHash(hash, Flags[TUT_CFLAG_UNTAGGED] != NULL);
+
+	return hash;
+}
+
+static void StoreGlobalLayout(TutProgram* program, const TutList* globals)
+{
+	TUT_LIST_EACH(node, *globals)
+	{
+		const TutVarDecl* decl = node->value;
+		TutGlobalLayout layout;
+
+		layout.nameHash = Tut_AtomHash(decl->name);
+		layout.layoutHash = HashLayout(0, decl->typetag);
+		layout.index = decl->index;
+		layout.size = Tut_GetTypetagSize(decl->typetag);
+
+		Tut_ArrayPush(&program->globalLayout, &layout);
+	}
+}
+
+// Slots hold the index of an entry plus one, 0 is free
+static void GrowCacheIndex(TutCompileCache* cache)
+{
+	uint32_t capacity = cache->capacity ? cache->capacity * 2 : 64;
+	uint32_t* slots = Tut_Calloc(capacity, sizeof(uint32_t));
+
+	for (uint32_t i = 0; i < cache->entries.length; ++i)
+	{
+		const CompileCacheEntry* entry = Tut_ArrayGetConst(&cache->entries, i);
+
+		uint32_t pos = entry->pathHash & (capacity - 1);
+		while (slots[pos])
+			pos = (pos + 1) & (capacity - 1);
+
+		slots[pos] = i + 1;
+	}
+
+	Tut_Free(cache->slots);
+
+	cache->slots = slots;
+	cache->capacity = capacity;
+}
+
+// Returns the entry for path, adding an empty one (with no chunk) if there is none
+static CompileCacheEntry* FindCacheEntry(TutCompileCache* cache, const char* path, uint32_t pathHash)
+{
+	// Keep the load factor under 3/4
+	if ((cache->entries.length + 1) * 4 > cache->capacity * 3)
+		GrowCacheIndex(cache);
+
+	uint32_t pos = pathHash & (cache->capacity - 1);
+
+	while (cache->slots[pos])
+	{
+		CompileCacheEntry* entry = Tut_ArrayGet(&cache->entries, cache->slots[pos] - 1);
+		if (entry->pathHash == pathHash && strcmp(entry->path, path) == 0)
+			return entry;
+
+		pos = (pos + 1) & (cache->capacity - 1);
+	}
+
+	CompileCacheEntry entry;
+
+	entry.path = Tut_Strdup(path);
+	entry.pathHash = pathHash;
+	entry.chunk = NULL;
+	Tut_InitArray(&entry.dependencies, sizeof(CompileDependency));
+
+	Tut_ArrayPush(&cache->entries, &entry);
+	cache->slots[pos] = (uint32_t)cache->entries.length;
+
+	return Tut_ArrayGet(&cache->entries, cache->entries.length - 1);
+}
+
+void Tut_InitCompileCache(TutCompileCache* cache)
+{
+	Tut_InitArray(&cache->entries, sizeof(CompileCacheEntry));
+
+	cache->slots = NULL;
+	cache->capacity = 0;
+}
+
+void Tut_DestroyCompileCache(TutCompileCache* cache)
+{
+	for (uint32_t i = 0; i < cache->entries.length; ++i)
+	{
+		CompileCacheEntry* entry = Tut_ArrayGet(&cache->entries, i);
+
+		Tut_Free(entry->path);
+		Tut_DestroyArray(&entry->dependencies);
+		if (entry->chunk)
+			Tut_ReleaseProgram(entry->chunk);
+	}
+
+	Tut_DestroyArray(&cache->entries);
+	Tut_Free(cache->slots);
+}
+
+typedef struct
+{
+	TutModule** modules;
+	TutProgram** chunks;
+} CompileJob;
+
+// Modules only share the symbol table, which is read only at this point (apart
+// from the typetag cache, which has its own lock), so they can be compiled in
+// parallel. Each goes into its own chunk which is linked afterwards.
+static void CompileChunk(void* data, uint32_t index)
+{
+	CompileJob* job = data;
+
+	// Reused from the cache
+	if (job->chunks[index])
+		return;
+
+	TutModule* mod = job->modules[index];
+	TutProgram* chunk = Tut_CreateProgram();
+
+	if (Flags[TUT_CFLAG_SINGLE_PASS])
+	{
+		// Each statement is still in cache when it is emitted
+		for (uint32_t i = 0; i < mod->exprList.length; ++i)
+		{
+			TutExpr* exp = GetListExpr(mod, mod->exprList, i);
+
+			ResolveTypes(mod, exp);
+			CompileStatement(mod, chunk, exp);
+		}
+	}
+	else
+	{
+		ResolveSymbols(mod);
+
+		for (uint32_t i = 0; i < mod->exprList.length; ++i)
+			ResolveTypes(mod, GetListExpr(mod, mod->exprList, i));
+
+		for (uint32_t i = 0; i < mod->exprList.length; ++i)
+			CompileStatement(mod, chunk, GetListExpr(mod, mod->exprList, i));
+	}
+
+	if (!Flags[TUT_CFLAG_NO_PEEPHOLE])
+		Tut_OptimizeCode(chunk);
+
+	job->chunks[index] = chunk;
+}
+
+// Modules created from a string have no path and are always compiled
+static void UpdateCompileCache(TutCompileCache* cache, CompileJob* job, uint32_t numModules, TutBool lookup)
+{
+	for (uint32_t i = 0; i < numModules; ++i)
+	{
+		TutModule* mod = job->modules[i];
+		const char* path = mod->lexer.context.filename;
+
+		if (!path)
+			continue;
+
+		size_t length = strlen(mod->lexer.source);
+		uint32_t contentHash = Tut_HashBytes(mod->lexer.source, length);
+
+		CompileCacheEntry* entry = FindCacheEntry(cache, path, Tut_HashString(path));
+
+		if (lookup)
+		{
+			if (entry->chunk && entry->contentHash == contentHash && entry->contentLength == length &&
+				entry->signatureHash == HashSignature(mod, &entry->dependencies))
+			{
+				Tut_RetainProgram(entry->chunk);
+				job->chunks[i] = entry->chunk;
+			}
+
+			continue;
+		}
+
+		if (entry->chunk == job->chunks[i])
+			continue;
+
+		if (entry->chunk)
+			Tut_ReleaseProgram(entry->chunk);
+
+		entry->contentHash = contentHash;
+		entry->contentLength = length;
+		CollectDependencies(mod, &entry->dependencies);
+		entry->signatureHash = HashSignature(mod, &entry->dependencies);
+
+		Tut_RetainProgram(job->chunks[i]);
+		entry->chunk = job->chunks[i];
+	}
+}
+
+TutProgram* Tut_CompileModule(TutModule* module)
+{
+	return Tut_CompileModuleCached(module, NULL);
+}
+
+TutProgram* Tut_CompileModuleCached(TutModule* module, TutCompileCache* cache)
+{
+	TutFuncDecl* decl = Tut_GetFuncDecl(module->symbolTable, Tut_Intern("_main"));
 	if (!decl)
 		Tut_ErrorExit("Module '%s' has no '_main' function.\n", module->name);
 
-	// Goto _main
-	int32_t patchLoc = Tut_EmitGoto(vm, TUT_FALSE, 0);
-
 	TutList allModules;
 
 	Tut_InitList(&allModules);
+	CollectModules(&allModules, module);
 
-	TUT_LIST_EACH(node, module->importedModules)
-		Tut_ListAppend(&allModules, node->value);
+	// Types and variables are shared by all modules
+	FinalizeTypes(module);
 
-	Tut_ListAppend(&allModules, module);
+	TutProgram* program = Tut_CreateProgram();
 
-	TUT_LIST_EACH(node, allModules)
-	{
-		TutModule* mod = node->value;
+	program->numGlobals = ResolveVariableIndices(module);
+
+	if (program->numGlobals > TUT_VM_MAX_GLOBALS)
+		Tut_ErrorExit("Module '%s' uses too many globals (%d, max is %d).\n", module->name, program->numGlobals, TUT_VM_MAX_GLOBALS);
 
-		FinalizeTypes(mod);
-		ResolveVariableIndices(mod);
+	// For Tut_ReloadVM
+	program->functionSignature = HashFunctions(0, &module->symbolTable->functions);
+	StoreGlobalLayout(program, &module->symbolTable->globals);
 
-		TUT_LIST_EACH(node, mod->exprList)
-			ResolveSymbols(mod, node->value);
+	CompileJob job;
 
-		TUT_LIST_EACH(node, mod->exprList)
-			ResolveTypes(mod, node->value);
+	job.modules = Tut_Malloc(sizeof(TutModule*) * allModules.length);
+	job.chunks = Tut_Calloc(allModules.length, sizeof(TutProgram*));
+
+	uint32_t numModules = 0;
+	TUT_LIST_EACH(node, allModules)
+		job.modules[numModules++] = node->value;
 
-		TUT_LIST_EACH(node, mod->exprList)
-			CompileStatement(mod, vm, node->value);
+	if (Flags[TUT_CFLAG_UNTAGGED])
+		program->flags |= TUT_PROGRAM_UNTAGGED;
+
+	if (cache)
+	{
+		UpdateCompileCache(cache, &job, numModules, TUT_TRUE);
 	}
 
-	int32_t pc = TUT_ARRAY_GET_VALUE(&vm->functionPcs, decl->index, int32_t);
-	Tut_PatchGoto(vm, patchLoc, pc);
+	Tut_ParallelFor(numModules, CompileChunk, &job);
 
-	int numExterns = 0;
-	TUT_LIST_EACH(node, module->symbolTable->functions)
+	if (cache)
+		UpdateCompileCache(cache, &job, numModules, TUT_FALSE);
+
+	// Goto _main
+	int32_t patchLoc = Tut_EmitGoto(program, TUT_FALSE, 0);
+	for (uint32_t i = 0; i < numModules; ++i)
 	{
-		TutFuncDecl* decl = node->value;
-		if (decl->type == TUT_FUNC_DECL_EXTERN)
-			++numExterns;
+		Tut_LinkChunk(program, job.chunks[i]);
+		Tut_ReleaseProgram(job.chunks[i]);
 	}
 
+	Tut_Free(job.modules);
+	Tut_Free(job.chunks);
+
+	Tut_DestroyList(&allModules);
+
+	int32_t pc = TUT_ARRAY_GET_VALUE(&program->functionPcs, decl->index, int32_t);
+	Tut_PatchGoto(program, patchLoc, pc);
+
 	void* value = NULL;
 
-	Tut_ArrayResize(&vm->externs, numExterns, &value);
-	Tut_ArrayResize(&vm->externNames, numExterns, &value);
+	Tut_ArrayResize(&program->externs, module->symbolTable->numExterns, &value);
+	Tut_ArrayResize(&program->externNames, module->symbolTable->numExterns, &value);
+
+	// Names are kept in the program so externs can be bound without the module
+	StoreExternNames(program, &module->symbolTable->functions);
+
+	// Anything the compiler emits should pass; the vm relies on it
+	if (!Tut_VerifyProgram(program))
+		Tut_ErrorExit("Generated invalid bytecode.\n");
+
+	return program;
+}
+
+TutBool Tut_ReloadModule(TutVM* vm, TutModule* module, TutCompileCache* cache)
+{
+	TutProgram* program = Tut_CompileModuleCached(module, cache);
+	Tut_FinalizeCode(program, TUT_TRUE);
+
+	// Nothing else holds program yet, so it can take over the old bindings
+	for (uint32_t i = 0; i < program->externs.length && i < vm->program->externs.length; ++i)
+	{
+		if (!TUT_ARRAY_GET_VALUE(&program->externs, i, TutVMExternFunction))
+			Tut_ArraySet(&program->externs, i, Tut_ArrayGet(&vm->program->externs, i));
+	}
+
+	TutBool success = Tut_ReloadVM(vm, program);
+
+	Tut_ReleaseProgram(program);
+	return success;
 }
 
 void Tut_SetCompilerFlag(Tut_CompilerFlag flag, const char* value)
@@ -1105,9 +1884,9 @@ void Tut_SetCompilerFlag(Tut_CompilerFlag flag, const char* value)
 	Flags[flag] = value;
 }
 
-void Tut_BindExternFindIndex(TutModule* module, TutVM* vm, const char* name, TutVMExternFunction fn)
+void Tut_BindExternFindIndex(TutModule* module, TutProgram* program, const char* name, TutVMExternFunction fn)
 {
-	TutFuncDecl* decl = Tut_GetFuncDecl(module->symbolTable, name);
+	TutFuncDecl* decl = Tut_GetFuncDecl(module->symbolTable, Tut_Intern(name));
 	if (decl && decl->type == TUT_FUNC_DECL_EXTERN && decl->index >= 0)
-		Tut_BindExtern(vm, decl->index, name, fn);
+		Tut_BindExtern(program, decl->index, name, fn);
 }
\ No newline at end of file
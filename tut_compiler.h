@@ -8,11 +8,48 @@ typedef enum
 {
 	TUT_CFLAG_OPEN_ERROR_GEANY_PATH,
 	TUT_CFLAG_OPEN_ERROR_NPP_PATH,
+	// Any non-NULL value resolves, typechecks and emits each top level statement in
+	// one traversal; without it every pass finishes over the whole module before the
+	// next starts, so e.g. all undeclared names are reported before type errors
+	TUT_CFLAG_SINGLE_PASS,
+	// Any non-NULL value leaves the emitted code as it is (see Tut_OptimizeCode)
+	TUT_CFLAG_NO_PEEPHOLE,
+	// Any non-NULL value compiles a TUT_PROGRAM_UNTAGGED program: the vm doesn't
+	// store the type of values the code computes, except for arguments to externs
+	// (or to function values which might be externs), which are tagged from their
+	// static type right before the call
+	TUT_CFLAG_UNTAGGED,
 	TUT_CFLAG_COUNT
 } Tut_CompilerFlag;
 
+// Compiled modules kept from one compile to the next, found by path. A module is
+// only compiled again if its source changed or if one of its own declarations or
+// one its code was resolved against did: what a name it uses resolves to (index and
+// type), or the layout of a struct it uses, whichever module declares them. Modules
+// are still lexed and parsed every time since declaring into the symbol table is
+// what gives declarations their indices.
+typedef struct
+{
+	TutArray entries;
+
+	// Open addressing index into entries by path hash
+	uint32_t* slots;
+	uint32_t capacity;
+} TutCompileCache;
+
+void Tut_InitCompileCache(TutCompileCache* cache);
+void Tut_DestroyCompileCache(TutCompileCache* cache);
+
 void Tut_SetCompilerFlag(Tut_CompilerFlag flag, const char* value);
-void Tut_CompileModule(TutModule* module, TutVM* vm);
-void Tut_BindExternFindIndex(TutModule* module, TutVM* vm, const char* name, TutVMExternFunction fn);
+// Returns a new program (with a reference count of 1) containing module and all its imports
+TutProgram* Tut_CompileModule(TutModule* module);
+// Same as above but modules which are unchanged since they were put in cache are
+// not compiled again; cache may be NULL
+TutProgram* Tut_CompileModuleCached(TutModule* module, TutCompileCache* cache);
+// Compiles module and swaps it into vm with Tut_ReloadVM, keeping the externs bound
+// in the vm's program; returns FALSE if that fails, in which case vm keeps running
+// what it was running
+TutBool Tut_ReloadModule(TutVM* vm, TutModule* module, TutCompileCache* cache);
+void Tut_BindExternFindIndex(TutModule* module, TutProgram* program, const char* name, TutVMExternFunction fn);
 
 #endif
\ No newline at end of file
@@ -1,100 +1,67 @@
 #include <assert.h>
+#include <string.h>
 
 #include "tut_util.h"
 #include "tut_expr.h"
 
-TutExpr* Tut_CreateExpr(TutExprType type, const TutLexerContext* context)
+void Tut_InitAst(TutAst* ast)
 {
-	TutExpr* exp = Tut_Malloc(sizeof(TutExpr));
-	
-	exp->type = type;
-	exp->typetag = NULL;
-	exp->context = *context;
+	Tut_InitArray(&ast->exprs, sizeof(TutExpr));
+	Tut_InitArray(&ast->lists, sizeof(TutExprIndex));
+	Tut_InitArray(&ast->pending, sizeof(TutExprIndex));
 
-	return exp;
+	// Reserve TUT_EXPR_NONE
+	TutExpr none;
+	memset(&none, 0, sizeof(none));
+
+	Tut_ArrayPush(&ast->exprs, &none);
+}
+
+void Tut_DestroyAst(TutAst* ast)
+{
+	Tut_DestroyArray(&ast->exprs);
+	Tut_DestroyArray(&ast->lists);
+	Tut_DestroyArray(&ast->pending);
+}
+
+TutExprIndex Tut_CreateExpr(TutAst* ast, TutExprType type, const TutLexerContext* context)
+{
+	TutExpr exp;
+	memset(&exp, 0, sizeof(exp));
+
+	exp.type = type;
+	exp.typetag = NULL;
+	exp.context = *context;
+
+	Tut_ArrayPush(&ast->exprs, &exp);
+
+	return (TutExprIndex)(ast->exprs.length - 1);
 }
 
-void Tut_FlattenExpr(TutExpr* exp, TutArray* into)
+uint32_t Tut_BeginExprList(TutAst* ast)
 {
-	assert(exp);
-
-	Tut_ArrayPush(into, &exp);
-
-	switch (exp->type)
-	{
-		case TUT_EXPR_NULL:
-		case TUT_EXPR_INT:
-		case TUT_EXPR_FLOAT:
-		case TUT_EXPR_STR:
-		case TUT_EXPR_STRUCT_DEF:
-		case TUT_EXPR_VAR:
-		case TUT_EXPR_IDENT:
-		{
-			// No sub expressions
-		} break;
-
-		case TUT_EXPR_ARROW:
-		case TUT_EXPR_DOT:
-		{
-			Tut_FlattenExpr(exp->dotx.value, into);
-		} break;
-
-		case TUT_EXPR_UNARY:
-		{
-			Tut_FlattenExpr(exp->unaryx.value, into);
-		} break;
-
-		case TUT_EXPR_BIN:
-		{
-			Tut_FlattenExpr(exp->binx.lhs, into);
-			Tut_FlattenExpr(exp->binx.rhs, into);
-		} break;
-
-		case TUT_EXPR_PAREN:
-		{
-			Tut_FlattenExpr(exp->parenExpr, into);
-		} break;
-
-		case TUT_EXPR_CALL:
-		{
-			Tut_FlattenExpr(exp->callx.func, into);
-			TUT_LIST_EACH(node, exp->callx.args)
-				Tut_FlattenExpr(node->value, into);
-		} break;
-
-		case TUT_EXPR_BLOCK:
-		{
-			TUT_LIST_EACH(node, exp->blockList)
-				Tut_FlattenExpr(node->value, into);
-		} break;
-
-		case TUT_EXPR_RETURN:
-		{
-			Tut_FlattenExpr(exp->retx.value, into);
-		} break;
-
-		case TUT_EXPR_IF:
-		{
-			Tut_FlattenExpr(exp->ifx.cond, into);
-			Tut_FlattenExpr(exp->ifx.body, into);
-			if (exp->ifx.alt)
-				Tut_FlattenExpr(exp->ifx.alt, into);
-		} break;
-
-		case TUT_EXPR_WHILE:
-		{
-			Tut_FlattenExpr(exp->whilex.cond, into);
-			Tut_FlattenExpr(exp->whilex.body, into);
-		} break;
-
-		case TUT_EXPR_FUNC:
-		{
-			Tut_FlattenExpr(exp->funcx.body, into);
-		} break;
-	}
+	return (uint32_t)ast->pending.length;
 }
 
-void Tut_DestroyExpr(TutExpr* expr)
+void Tut_PushExprList(TutAst* ast, TutExprIndex index)
 {
-	// TODO: Implement this
+	assert(index != TUT_EXPR_NONE);
+	Tut_ArrayPush(&ast->pending, &index);
+}
+
+TutExprRange Tut_EndExprList(TutAst* ast, uint32_t mark)
+{
+	assert(mark <= ast->pending.length);
+
+	TutExprRange range;
+
+	range.first = (uint32_t)ast->lists.length;
+	range.length = (uint32_t)ast->pending.length - mark;
+
+	for (uint32_t i = mark; i < ast->pending.length; ++i)
+		Tut_ArrayPush(&ast->lists, Tut_ArrayGet(&ast->pending, i));
+
+	ast->pending.length = mark;
+
+	return range;
 }
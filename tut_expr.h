@@ -42,6 +42,18 @@ typedef enum
 	TUT_EXPR_STRUCT_DEF,
 } TutExprType;
 
+// Expressions reference their children by index into the module's TutAst
+typedef uint32_t TutExprIndex;
+
+// Index 0 is reserved so it can mark a missing child
+#define TUT_EXPR_NONE	0
+
+// Block statements and call arguments are stored contiguously in TutAst::lists
+typedef struct
+{
+	uint32_t first, length;
+} TutExprRange;
+
 typedef struct TutExpr
 {
 	TutExprType type;
@@ -50,16 +62,16 @@ typedef struct TutExpr
 
 	union
 	{
-		TutList blockList;
+		TutExprRange blockList;
 		
 		int intVal;
 		float floatVal;
-		char* string;
+		TutAtom string;
 		
 		// Used by both EXPR_VAR and EXPR_IDENT
 		struct
 		{
-			char* name;
+			TutAtom name;
 			TutVarDecl* decl;
 			// This is for ResolveSymbols to cache the function
 			// once so it doesn't have to be looked up again in 
@@ -73,59 +85,59 @@ typedef struct TutExpr
 		struct
 		{
 			TutToken op;
-			struct TutExpr* value;
+			TutExprIndex value;
 		} unaryx;
 
 		struct
 		{
-			struct TutExpr* lhs;
-			struct TutExpr* rhs;
+			TutExprIndex lhs;
+			TutExprIndex rhs;
 			int op;
 		} binx;
 		
-		struct TutExpr* parenExpr;
+		TutExprIndex parenExpr;
 		
 		// Used by both EXPR_DOT and EXPR_ARROW
 		struct
 		{
-			struct TutExpr* value;
-			char* memberName;
+			TutExprIndex value;
+			TutAtom memberName;
 		} dotx;
 
 		struct
 		{
-			struct TutExpr* func;
-			TutList args;
+			TutExprIndex func;
+			TutExprRange args;
 		} callx;
 		
 		struct
 		{
 			TutFuncDecl* decl;
-			struct TutExpr* body;
+			TutExprIndex body;
 		} funcx;
 		
 		struct
 		{
 			TutFuncDecl* parent;
-			struct TutExpr* value;
+			TutExprIndex value;
 		} retx;
 		
 		struct
 		{
-			struct TutExpr* cond;
-			struct TutExpr* body;
-			struct TutExpr* alt;
+			TutExprIndex cond;
+			TutExprIndex body;
+			TutExprIndex alt;
 		} ifx;
 		
 		struct
 		{
-			struct TutExpr* cond;
-			struct TutExpr* body;
+			TutExprIndex cond;
+			TutExprIndex body;
 		} whilex;
 
 		struct
 		{
-			struct TutExpr* value;
+			TutExprIndex value;
 			TutTypetag* typetag;
 		} castx;
 
@@ -141,8 +153,28 @@ typedef struct TutExpr
 	};
 } TutExpr;
 
-TutExpr* Tut_CreateExpr(TutExprType type, const TutLexerContext* context);
-void Tut_FlattenExpr(TutExpr* exp, TutArray* into);
-void Tut_DestroyExpr(TutExpr* expr);
+typedef struct
+{
+	TutArray exprs;
+	TutArray lists;
+
+	// Items of the lists currently being parsed; nested lists are pushed on top
+	// and moved into lists once they are complete
+	TutArray pending;
+} TutAst;
+
+// Pointers into the AST are only stable once it is no longer being added to
+#define TUT_AST_EXPR(ast, index) ((TutExpr*)(ast)->exprs.data + (index))
+#define TUT_AST_LIST_ITEM(ast, range, i) (((TutExprIndex*)(ast)->lists.data)[(range).first + (i)])
+
+void Tut_InitAst(TutAst* ast);
+void Tut_DestroyAst(TutAst* ast);
+
+TutExprIndex Tut_CreateExpr(TutAst* ast, TutExprType type, const TutLexerContext* context);
+
+// Returns a mark which has to be passed to Tut_EndExprList
+uint32_t Tut_BeginExprList(TutAst* ast);
+void Tut_PushExprList(TutAst* ast, TutExprIndex index);
+TutExprRange Tut_EndExprList(TutAst* ast, uint32_t mark);
 
 #endif
@@ -0,0 +1,37 @@
+#include <string.h>
+
+#include "tut_hash.h"
+
+#define FNV_OFFSET_BASIS	2166136261u
+#define FNV_PRIME			16777619u
+
+uint32_t Tut_HashBytes(const void* data, size_t length)
+{
+	const uint8_t* bytes = data;
+	uint32_t hash = FNV_OFFSET_BASIS;
+
+	for (size_t i = 0; i < length; ++i)
+	{
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+
+	return hash ? hash : 1;
+}
+
+uint32_t Tut_HashString(const char* string)
+{
+	return Tut_HashBytes(string, strlen(string));
+}
+
+uint32_t Tut_HashUint32(uint32_t value)
+{
+	// Integer finalizer from MurmurHash3, sequential values spread well
+	value ^= value >> 16;
+	value *= 0x85ebca6bu;
+	value ^= value >> 13;
+	value *= 0xc2b2ae35u;
+	value ^= value >> 16;
+
+	return value ? value : 1;
+}
@@ -0,0 +1,12 @@
+#ifndef TUT_HASH_H
+#define TUT_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// FNV-1a; never returns 0 so callers can use 0 to mark empty slots
+uint32_t Tut_HashBytes(const void* data, size_t length);
+uint32_t Tut_HashString(const char* string);
+uint32_t Tut_HashUint32(uint32_t value);
+
+#endif
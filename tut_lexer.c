@@ -1,13 +1,191 @@
 #include <stdlib.h>
 #include <assert.h>
-#include <ctype.h>
 #include <string.h>
 
 #include "tut_lexer.h"
 #include "tut_util.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TUT_LEXER_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// The source is followed by this many zero bytes so 16 byte wide scans
+// never read past the allocation
+#define SOURCE_PADDING	16
+
+#define S	CHAR_SPACE
+#define A	CHAR_ALPHA
+#define D	CHAR_DIGIT
+
+enum
+{
+	CHAR_SPACE = 1,
+	CHAR_ALPHA = 2,		// letters and '_'
+	CHAR_DIGIT = 4,
+	CHAR_IDENT = CHAR_ALPHA | CHAR_DIGIT
+};
+
+// Same as isspace/isalpha/isdigit in the C locale
+static const unsigned char CharClasses[256] =
+{
+	0, 0, 0, 0, 0, 0, 0, 0, 0, S, S, S, S, S, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	S, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, 0,
+	0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,
+	A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, A,
+	0, A, A, A, A, A, A, A, A, A, A, A, A, A, A, A,
+	A, A, A, A, A, A, A, A, A, A, A, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+#undef S
+#undef A
+#undef D
+
+#define CHAR_CLASS(c) ((c) == EOF ? 0 : CharClasses[(unsigned char)(c)])
+
+typedef struct
+{
+	const char* name;
+	size_t length;
+	TutToken tok;
+} Keyword;
+
+// Perfect hash of the keyword set, see KeywordHash
+static const Keyword Keywords[32] =
+{
+	[2] = { "while", 5, TUT_TOK_WHILE },
+	[3] = { "struct", 6, TUT_TOK_STRUCT },
+	[6] = { "var", 3, TUT_TOK_VAR },
+	[7] = { "extern", 6, TUT_TOK_EXTERN },
+	[13] = { "sizeof", 6, TUT_TOK_SIZEOF },
+	[14] = { "else", 4, TUT_TOK_ELSE },
+	[15] = { "cast", 4, TUT_TOK_CAST },
+	[17] = { "false", 5, TUT_TOK_FALSE },
+	[18] = { "null", 4, TUT_TOK_NULL },
+	[20] = { "return", 6, TUT_TOK_RETURN },
+	[21] = { "func", 4, TUT_TOK_FUNC },
+	[25] = { "import", 6, TUT_TOK_IMPORT },
+	[26] = { "module", 6, TUT_TOK_MODULE },
+	[27] = { "if", 2, TUT_TOK_IF },
+	[29] = { "true", 4, TUT_TOK_TRUE },
+};
+
+static TutAtom KeywordAtoms[32];
+
+// Collision free for the keywords above; has to be searched for again (and the
+// table rebuilt) whenever a keyword is added
+static uint32_t KeywordHash(const char* name, size_t length)
+{
+	return (uint32_t)(2 * length + (unsigned char)name[0] + 13 * (unsigned char)name[length - 1]) & 31;
+}
+
+static void InternKeywords()
+{
+	static TutBool interned = TUT_FALSE;
+	if (interned) return;
+
+	for (int i = 0; i < 32; ++i)
+	{
+		if (Keywords[i].name)
+			KeywordAtoms[i] = Tut_Intern(Keywords[i].name);
+	}
+
+	interned = TUT_TRUE;
+}
+
+static uint32_t CountTrailingZeros(uint32_t value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, value);
+	return index;
+#else
+	return __builtin_ctz(value);
+#endif
+}
+
+// Returns a pointer to the first character which cannot be part of an identifier
+static const char* ScanIdent(const char* p)
+{
+#ifdef TUT_LEXER_SSE2
+	for (;;)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+
+		// Bytes above 127 are negative so they fail every range check
+		__m128i folded = _mm_or_si128(v, _mm_set1_epi8(0x20));
+		__m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(folded, _mm_set1_epi8('z' + 1)));
+		__m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+		__m128i under = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), under));
+		if (mask != 0xFFFF)
+			return p + CountTrailingZeros(~mask);
+
+		p += 16;
+	}
+#else
+	while (CharClasses[(unsigned char)*p] & CHAR_IDENT)
+		++p;
+	return p;
+#endif
+}
+
+// Skips spaces and tabs (newlines are left to the caller so it can count lines)
+static const char* SkipBlanks(const char* p)
+{
+#ifdef TUT_LEXER_SSE2
+	for (;;)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)p);
+		__m128i blank = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(blank);
+		if (mask != 0xFFFF)
+			return p + CountTrailingZeros(~mask);
+
+		p += 16;
+	}
+#else
+	while (*p == ' ' || *p == '\t')
+		++p;
+	return p;
+#endif
+}
+
+// Continues lexing at p (p becomes the last character read)
+static void SkipTo(TutLexer* lexer, const char* p)
+{
+	if (*p)
+	{
+		lexer->last = (unsigned char)*p;
+		lexer->context.current = p + 1;
+	}
+	else
+	{
+		lexer->last = EOF;
+		lexer->context.current = p;
+	}
+}
+
 static void InitLexer(TutLexer* lexer, char* source)
 {
+	InternKeywords();
+
 	lexer->source = source;	
 	
 	lexer->context.filename = NULL;
@@ -19,14 +197,17 @@ static void InitLexer(TutLexer* lexer, char* source)
 
 	lexer->last = ' ';
 	lexer->lexeme[0] = '\0';
+	lexer->atom = NULL;
 	lexer->number = 0;
 }
 
 void Tut_InitLexer(TutLexer* lexer, const char* source)
 {
 	size_t sourceLength = strlen(source);
-	char* str = Tut_Malloc(sourceLength + 1);
-	strcpy(str, source);
+	char* str = Tut_Malloc(sourceLength + 1 + SOURCE_PADDING);
+	
+	memcpy(str, source, sourceLength);
+	memset(str + sourceLength, 0, 1 + SOURCE_PADDING);
 
 	InitLexer(lexer, str);
 }
@@ -39,9 +220,9 @@ void Tut_InitLexerFromFile(TutLexer* lexer, FILE* file)
 	size_t length = ftell(file);
 	rewind(file);
 	
-	char* str = Tut_Malloc(length + 1);
-	fread(str, 1, length, file);
-	str[length] = '\0';
+	char* str = Tut_Malloc(length + 1 + SOURCE_PADDING);
+	length = fread(str, 1, length, file);
+	memset(str + length, 0, 1 + SOURCE_PADDING);
 	
 	InitLexer(lexer, str);
 }
@@ -50,7 +231,7 @@ static int GetChar(TutLexer* lexer)
 {
 	if(*lexer->context.current)
 	{
-		int c = (int)(*lexer->context.current);
+		int c = (unsigned char)(*lexer->context.current);
 		lexer->context.current++;
 		return c;
 	}
@@ -60,56 +241,48 @@ static int GetChar(TutLexer* lexer)
 
 static TutToken GetToken(TutLexer* lexer)
 {
-	while(isspace(lexer->last))
+	while(CHAR_CLASS(lexer->last) & CHAR_SPACE)
 	{
-		int prev = lexer->last;
-		lexer->last = GetChar(lexer);
-		if(prev == '\n')
+		if(lexer->last == '\n')
 		{ 
 			++lexer->context.line;
 			lexer->context.lineStart = lexer->context.current;
 		}
+
+		SkipTo(lexer, SkipBlanks(lexer->context.current));
 	}
 	
-	if(isalpha(lexer->last) || lexer->last == '_')
+	if(CHAR_CLASS(lexer->last) & CHAR_ALPHA)
 	{
-		int i = 0;
-		while(isalnum(lexer->last) || lexer->last == '_')
-		{
-			if(i < TUT_MAX_LEXEME_LENGTH - 1)
-				lexer->lexeme[i++] = lexer->last;
-			else
-				Tut_ErrorExit("Identifier exceeded maximum lexeme length.\n");
-			lexer->last = GetChar(lexer);
-		}
+		const char* start = lexer->context.current - 1;
+		const char* end = ScanIdent(lexer->context.current);
 		
-		lexer->lexeme[i] = '\0';
+		size_t length = end - start;
+		if(length >= TUT_MAX_LEXEME_LENGTH)
+			Tut_ErrorExit("Identifier exceeded maximum lexeme length.\n");
+
+		memcpy(lexer->lexeme, start, length);
+		lexer->lexeme[length] = '\0';
 
-		if (strcmp(lexer->lexeme, "true") == 0) return TUT_TOK_TRUE;
-		if (strcmp(lexer->lexeme, "false") == 0) return TUT_TOK_FALSE;
-		if (strcmp(lexer->lexeme, "if") == 0) return TUT_TOK_IF;
-		if (strcmp(lexer->lexeme, "else") == 0) return TUT_TOK_ELSE;
-		if (strcmp(lexer->lexeme, "while") == 0) return TUT_TOK_WHILE;
-		if (strcmp(lexer->lexeme, "var") == 0) return TUT_TOK_VAR;
-		if (strcmp(lexer->lexeme, "func") == 0) return TUT_TOK_FUNC;
-		if (strcmp(lexer->lexeme, "return") == 0) return TUT_TOK_RETURN;
-		if (strcmp(lexer->lexeme, "extern") == 0) return TUT_TOK_EXTERN;
-		if (strcmp(lexer->lexeme, "struct") == 0) return TUT_TOK_STRUCT;
-		if (strcmp(lexer->lexeme, "cast") == 0) return TUT_TOK_CAST;
-		if (strcmp(lexer->lexeme, "import") == 0) return TUT_TOK_IMPORT;
-		if (strcmp(lexer->lexeme, "module") == 0) return TUT_TOK_MODULE;
-		if (strcmp(lexer->lexeme, "null") == 0) return TUT_TOK_NULL;
-		if (strcmp(lexer->lexeme, "sizeof") == 0) return TUT_TOK_SIZEOF;
+		SkipTo(lexer, end);
 
+		uint32_t hash = KeywordHash(start, length);
+		if(Keywords[hash].length == length && memcmp(Keywords[hash].name, start, length) == 0)
+		{
+			lexer->atom = KeywordAtoms[hash];
+			return Keywords[hash].tok;
+		}
+
+		lexer->atom = Tut_InternLength(start, length);
 		return TUT_TOK_IDENT;
 	}
 	
-	if(isdigit(lexer->last))
+	if(CHAR_CLASS(lexer->last) & CHAR_DIGIT)
 	{
 		int i = 0;
 		TutBool hasRadix = TUT_FALSE;
 		
-		while(isdigit(lexer->last) || lexer->last == '.')
+		while((CHAR_CLASS(lexer->last) & CHAR_DIGIT) || lexer->last == '.')
 		{
 			if(hasRadix && lexer->last == '.')
 				Tut_ErrorExit("Number token contains multiple radices ('.').\n");
@@ -277,8 +450,8 @@ static TutToken GetToken(TutLexer* lexer)
 		lexer->last = GetChar(lexer);
 		if(lexer->last == '/')
 		{
-			while(lexer->last != '\n' && lexer->last != EOF)
-				lexer->last = GetChar(lexer);
+			const char* lineEnd = strchr(lexer->context.current, '\n');
+			SkipTo(lexer, lineEnd ? lineEnd : lexer->context.current + strlen(lexer->context.current));
 			
 			return GetToken(lexer);
 		}
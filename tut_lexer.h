@@ -6,6 +6,7 @@
 #include <stdio.h>
 
 #include "tut_token.h"
+#include "tut_atom.h"
 #include "tut_lexercontext.h"
 
 typedef struct
@@ -19,6 +20,8 @@ typedef struct
 											// a string "hello world", this would contain
 											// that string)
 											
+	TutAtom atom;							// Interned lexeme if the token is TUT_TOK_IDENT
+
 	double number;							// Stores the numerical value of the token if the token is
 											// TUT_TOK_NUMBER
 
@@ -1,10 +1,8 @@
 #include "tut_util.h"
 #include "tut_list.h"
 
-static TutListNode* MakeNode(void* value)
+static TutListNode* InitNode(TutListNode* node, void* value)
 {
-	TutListNode* node = Tut_Malloc(sizeof(TutListNode));
-	
 	node->value = value;
 	node->next = NULL;
 	node->prev = NULL;
@@ -18,10 +16,8 @@ void Tut_InitList(TutList* list)
 	list->head = list->tail = NULL;
 }
 
-void Tut_ListAppend(TutList* list, void* value)
+static void AppendNode(TutList* list, TutListNode* node)
 {
-	TutListNode* node = MakeNode(value);
-	
 	if(!list->head)
 		list->head = list->tail = node;
 	else
@@ -34,9 +30,19 @@ void Tut_ListAppend(TutList* list, void* value)
 	++list->length;
 }
 
+void Tut_ListAppend(TutList* list, void* value)
+{
+	AppendNode(list, InitNode(Tut_Malloc(sizeof(TutListNode)), value));
+}
+
+void Tut_ListAppendArena(TutList* list, void* value, TutArena* arena)
+{
+	AppendNode(list, InitNode(Tut_ArenaAlloc(arena, sizeof(TutListNode)), value));
+}
+
 void Tut_ListPrepend(TutList* list, void* value)
 {
-	TutListNode* node = MakeNode(value);
+	TutListNode* node = InitNode(Tut_Malloc(sizeof(TutListNode)), value);
 	
 	if(!list->head)
 		list->head = list->tail = node;
@@ -52,8 +58,14 @@ void Tut_ListPrepend(TutList* list, void* value)
 
 void Tut_DestroyList(TutList* list)
 {
-	TUT_LIST_EACH(node, *list)
+	TutListNode* node = list->head;
+
+	while(node)
+	{
+		TutListNode* next = node->next;
 		Tut_Free(node);
+		node = next;
+	}
 	
 	list->length = 0;
 	list->head = list->tail = NULL;
@@ -3,6 +3,8 @@
 
 #include <stddef.h>
 
+#include "tut_arena.h"
+
 #define TUT_LIST_EACH(nodeName, list) for(TutListNode* nodeName = (list).head; nodeName; nodeName = nodeName->next)
 #define TUT_LIST_REVERSE_EACH(nodeName, list) for(TutListNode* node = (list).tail; nodeName; nodeName = nodeName->prev)
 
@@ -23,6 +25,8 @@ typedef struct
 void Tut_InitList(TutList* list);
 
 void Tut_ListAppend(TutList* list, void* value);
+// The node comes out of arena, so the list must not be passed to Tut_DestroyList
+void Tut_ListAppendArena(TutList* list, void* value, TutArena* arena);
 void Tut_ListPrepend(TutList* list, void* value);
 
 void Tut_DestroyList(TutList* list);
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <string.h>
 
 #include "tut_expr.h"
 #include "tut_opcodes.h"
@@ -6,44 +7,55 @@
 #include "tut_compiler.h"
 #include "tut_stdext.h"
 #include "tut_array.h"
+#include "tut_verify.h"
 
 static void TestVM()
 {
-	TutVM vm;
-
-	Tut_InitVM(&vm);
+	TutProgram* program = Tut_CreateProgram();
 
-	int32_t patchLoc = Tut_EmitGoto(&vm, TUT_FALSE, 0);
+	int32_t patchLoc = Tut_EmitGoto(program, TUT_FALSE, 0);
 	
-	Tut_EmitFunctionEntryPoint(&vm);
-	Tut_EmitGet(&vm, TUT_FALSE, -2, 1);
-	Tut_EmitGet(&vm, TUT_FALSE, -1, 1);
-	Tut_EmitOp(&vm, TUT_OP_SUBI);
-	Tut_EmitRetval(&vm, 1);
+	Tut_EmitFunctionEntryPoint(program, 0);
+	Tut_EmitGet(program, TUT_FALSE, -2, 1);
+	Tut_EmitGet(program, TUT_FALSE, -1, 1);
+	Tut_EmitOp(program, TUT_OP_SUBI);
+	Tut_EmitRetval(program, 1);
 	
-	Tut_PatchGoto(&vm, patchLoc, vm.codeSize);
+	Tut_PatchGoto(program, patchLoc, program->codeSize);
+
+	Tut_EmitPushInt(program, 100);
+	Tut_EmitPushInt(program, 200);
+	Tut_EmitMakeFunc(program, TUT_FALSE, 0);
+	Tut_EmitCall(program, 2, 1);
 
-	Tut_EmitPushInt(&vm, 100);
-	Tut_EmitPushInt(&vm, 200);
-	Tut_EmitMakeFunc(&vm, TUT_FALSE, 0);
-	Tut_EmitCall(&vm, 2);
+	Tut_EmitOp(program, TUT_OP_HALT);
 
-	Tut_EmitOp(&vm, TUT_OP_HALT);
+	if (!Tut_VerifyProgram(program))
+		Tut_ErrorExit("Invalid test program.\n");
+
+	TutVM vm;
+	Tut_InitVM(&vm, program);
 
 	vm.pc = 0;
-	while(vm.pc >= 0)
-		Tut_ExecuteCycle(&vm, TUT_FALSE);
+	Tut_Run(&vm, -1);
 
-	assert(vm.stack[0].iv == -100);
+	assert(TUT_OBJECT_INT(vm.stack[0]) == -100);
 
 	Tut_DestroyVM(&vm);
+	Tut_ReleaseProgram(program);
 }
 
-static void TestCompiler(const char* filename)
+static TutBool IsImageFile(const char* filename)
 {
-	TutVM vm;
-	Tut_InitVM(&vm);
+	size_t length = strlen(filename);
+	return length >= 5 && strcmp(filename + length - 5, ".tutc") == 0;
+}
 
+// Modules which didn't change are not compiled again by later compiles
+static TutCompileCache CompileCache;
+
+static TutProgram* CompileFile(const char* filename)
+{
 	Tut_ClearModuleCache();
 
 	TutModule module;
@@ -53,20 +65,74 @@ static void TestCompiler(const char* filename)
 	Tut_InitModuleFromFile(&module, &symbolTable, filename);
 
 	Tut_SetCompilerFlag(TUT_CFLAG_OPEN_ERROR_GEANY_PATH, "geany");
-	Tut_CompileModule(&module, &vm);
-	
-	TutStdExt_BindAll(&module, &vm);
+	TutProgram* program = Tut_CompileModuleCached(&module, &CompileCache);
+	Tut_FinalizeCode(program, TUT_TRUE);
 
+	// The whole front end goes away in one go
 	Tut_DestroyModule(&module);
+	Tut_ClearModuleCache();
+	Tut_DestroySymbolTable(&symbolTable);
+
+	return program;
+}
+
+// Compiles filename into filename + "c" (e.g. test.tut -> test.tutc)
+static void SaveImage(const char* filename)
+{
+	TutProgram* program = CompileFile(filename);
+
+	char* imageFilename = Tut_Malloc(strlen(filename) + 2);
+	strcpy(imageFilename, filename);
+	strcat(imageFilename, "c");
+
+	if (!Tut_SaveProgram(program, imageFilename))
+		Tut_ErrorExit("Failed to write image '%s'.\n", imageFilename);
+
+	Tut_Free(imageFilename);
+	Tut_ReleaseProgram(program);
+}
+
+static void TestCompiler(const char* filename)
+{
+	TutProgram* program;
+
+	if (IsImageFile(filename))
+	{
+		program = Tut_LoadProgram(filename);
+		if (!program)
+			Tut_ErrorExit("'%s' is not a valid image (version %d).\n", filename, TUT_IMAGE_VERSION);
+	}
+	else
+		program = CompileFile(filename);
+	
+	TutStdExt_BindAll(program);
+
+	TutVM vm;
+	Tut_InitVM(&vm, program);
 
 	vm.pc = 0;
-	while (vm.pc >= 0)
-		Tut_ExecuteCycle(&vm, TUT_VM_DEBUG_NONE);
+	Tut_Run(&vm, -1);
+
+	Tut_DestroyVM(&vm);
+	Tut_ReleaseProgram(program);
 	getchar();
 }
 
 int main(int argc, char** argv)
 {
+	Tut_InitModuleCache();
+	Tut_InitCompileCache(&CompileCache);
+
+	if (argc >= 3 && strcmp(argv[1], "-c") == 0)
+	{
+		for (int i = 2; i < argc; ++i)
+			SaveImage(argv[i]);
+
+		Tut_DestroyCompileCache(&CompileCache);
+		Tut_DestroyModuleCache();
+		return TUT_SUCCESS;
+	}
+
 	if(argc >= 2)
 	{
 		//TestVM();
@@ -77,9 +143,14 @@ int main(int argc, char** argv)
 		}
 		getchar();
 
+		Tut_DestroyCompileCache(&CompileCache);
+		Tut_DestroyModuleCache();
 		return TUT_SUCCESS;
 	}
 	
-	fprintf(stderr, "Usage:\n%s (path/to/file)+.\n", argv[0]);
+	Tut_DestroyCompileCache(&CompileCache);
+	Tut_DestroyModuleCache();
+
+	fprintf(stderr, "Usage:\n%s (path/to/file)+.\n%s -c (path/to/file.tut)+ to compile .tutc images.\n", argv[0], argv[0]);
 	return TUT_FAILURE;
 }
@@ -1,10 +1,60 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
 #include "tut_module.h"
 #include "tut_parser.h"
+#include "tut_thread.h"
+#include "tut_hash.h"
+
+// Identifies a file regardless of the path it was reached by. 'ino' is 0 if
+// the file system couldn't tell us, in which case only the path is compared.
+typedef struct
+{
+	uint64_t dev, ino;
+	int64_t mtime;
+} FileIdentity;
+
+typedef struct
+{
+	TutSymbolTable* table;
+	char* path;		// Canonical; the module's lexer context points at this
+	FileIdentity id;
+
+	uint32_t hash;
+	TutBool loaded;
 
-static TutList ModuleCache;
+	TutModule* module;
+} CacheEntry;
+
+// The cache is split into shards with a lock each so lookups from different
+// threads rarely wait on each other; an entry never moves between shards
+typedef struct
+{
+	TutMutex lock;
+
+	CacheEntry* entries;	// Open addressing; 'module' is NULL in empty slots
+	uint32_t capacity, count;
+} CacheShard;
+
+#define NUM_CACHE_SHARDS	16
+#define MIN_SHARD_CAPACITY	16
+
+static CacheShard ModuleCache[NUM_CACHE_SHARDS];
+
+// The nodes belong to the symbol table's arena
+static void InitDeclarations(TutModule* module)
+{
+	Tut_InitList(&module->functions);
+	Tut_InitList(&module->globals);
+	Tut_InitList(&module->usertypes);
+}
 
 void Tut_InitModule(TutModule* module, TutSymbolTable* table, const char* code)
 {
@@ -12,8 +62,9 @@ void Tut_InitModule(TutModule* module, TutSymbolTable* table, const char* code)
 	module->symbolTable = table;
 
 	Tut_InitList(&module->importedModules);
+	InitDeclarations(module);
 	Tut_InitLexer(&module->lexer, code);
-	Tut_InitList(&module->exprList);
+	Tut_InitAst(&module->ast);
 	
 	Tut_ParseModule(module);
 }
@@ -33,51 +84,257 @@ void Tut_InitModuleFromFile(TutModule* module, TutSymbolTable* table, const char
 	module->lexer.context.filename = filename;
 
 	Tut_InitList(&module->importedModules);
-	Tut_InitList(&module->exprList);
+	InitDeclarations(module);
+	Tut_InitAst(&module->ast);
 	
 	Tut_ParseModule(module);
 }
 
 void Tut_DestroyModule(TutModule* module)
 {
-	// TODO: Implement this
+	Tut_DestroyLexer(&module->lexer);
+	Tut_DestroyAst(&module->ast);
+
+	Tut_InitList(&module->importedModules);
+	InitDeclarations(module);
+	module->exprList.first = 0;
+	module->exprList.length = 0;
+}
+
+static char* GetCanonicalPath(const char* filename)
+{
+#ifdef _WIN32
+	char buf[MAX_PATH];
+
+	DWORD length = GetFullPathNameA(filename, MAX_PATH, buf, NULL);
+	if (length > 0 && length < MAX_PATH)
+	{
+		// Paths are case insensitive
+		CharLowerA(buf);
+		return Tut_Strdup(buf);
+	}
+#else
+	char* path = realpath(filename, NULL);
+	if (path)
+	{
+		char* result = Tut_Strdup(path);
+		free(path);
+
+		return result;
+	}
+#endif
+	// The file probably doesn't exist; opening it will complain
+	return Tut_Strdup(filename);
+}
+
+static void GetFileIdentity(const char* path, FileIdentity* id)
+{
+	memset(id, 0, sizeof(*id));
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return;
+
+	BY_HANDLE_FILE_INFORMATION info;
+	if (GetFileInformationByHandle(file, &info))
+	{
+		id->dev = info.dwVolumeSerialNumber;
+		id->ino = ((uint64_t)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+		id->mtime = ((int64_t)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime;
+	}
+
+	CloseHandle(file);
+#else
+	struct stat st;
+	if (stat(path, &st) != 0)
+		return;
+
+	id->dev = (uint64_t)st.st_dev;
+	id->ino = (uint64_t)st.st_ino;
+	id->mtime = (int64_t)st.st_mtime;
+#endif
+}
+
+// A file which changed on disk is a different module, and every symbol table
+// gets its own copy of a module since parsing declares into the table
+static uint32_t HashKey(const TutSymbolTable* table, const char* path, const FileIdentity* id)
+{
+	uint32_t hash = Tut_HashBytes(&table, sizeof(table));
+
+	if (id->ino)
+		hash ^= Tut_HashBytes(id, sizeof(*id));
+	else
+		hash ^= Tut_HashBytes(path, strlen(path));
+
+	return hash;
+}
+
+static TutBool KeyEquals(const CacheEntry* entry, const TutSymbolTable* table, const char* path, const FileIdentity* id)
+{
+	if (entry->table != table || entry->id.mtime != id->mtime)
+		return TUT_FALSE;
+
+	if (entry->id.ino && id->ino)
+		return entry->id.dev == id->dev && entry->id.ino == id->ino;
+
+	return strcmp(entry->path, path) == 0;
+}
+
+static void GrowShard(CacheShard* shard)
+{
+	uint32_t capacity = shard->capacity ? shard->capacity * 2 : MIN_SHARD_CAPACITY;
+	CacheEntry* entries = Tut_Calloc(capacity, sizeof(CacheEntry));
+
+	for (uint32_t i = 0; i < shard->capacity; ++i)
+	{
+		CacheEntry* entry = &shard->entries[i];
+		if (!entry->module)
+			continue;
+
+		uint32_t pos = entry->hash & (capacity - 1);
+		while (entries[pos].module)
+			pos = (pos + 1) & (capacity - 1);
+
+		entries[pos] = *entry;
+	}
+
+	Tut_Free(shard->entries);
+
+	shard->entries = entries;
+	shard->capacity = capacity;
 }
 
 void Tut_InitModuleCache()
 {
-	Tut_InitList(&ModuleCache);
+	for (int i = 0; i < NUM_CACHE_SHARDS; ++i)
+	{
+		CacheShard* shard = &ModuleCache[i];
+
+		Tut_InitMutex(&shard->lock);
+
+		shard->entries = NULL;
+		shard->capacity = 0;
+		shard->count = 0;
+	}
 }
 
 TutModule* Tut_LoadModule(TutSymbolTable* table, const char* filename)
 {
-	TUT_LIST_EACH(node, ModuleCache)
+	char* path = GetCanonicalPath(filename);
+
+	FileIdentity id;
+	GetFileIdentity(path, &id);
+
+	uint32_t hash = HashKey(table, path, &id);
+	CacheShard* shard = &ModuleCache[hash % NUM_CACHE_SHARDS];
+
+	Tut_LockMutex(&shard->lock);
+
+	// Shards are indexed by the low bits of the hash, so probe with the rest
+	uint32_t probe = hash / NUM_CACHE_SHARDS;
+
+	if (shard->capacity)
 	{
-		TutModule* mod = node->value;
-		if (mod->lexer.context.filename &&
-			strcmp(mod->lexer.context.filename, filename) == 0)
-			return mod;
+		uint32_t mask = shard->capacity - 1;
+
+		for (uint32_t pos = probe & mask; shard->entries[pos].module; pos = (pos + 1) & mask)
+		{
+			CacheEntry* entry = &shard->entries[pos];
+			if (entry->hash != hash || !KeyEquals(entry, table, path, &id))
+				continue;
+
+			TutBool loaded = entry->loaded;
+			TutModule* module = entry->module;
+
+			Tut_UnlockMutex(&shard->lock);
+
+			// Modules with the same table are parsed one at a time, so this
+			// can only be an import of a module which is still being parsed
+			if (!loaded)
+				Tut_ErrorExit("Cyclic import of module '%s'.\n", filename);
+
+			Tut_Free(path);
+			return module;
+		}
 	}
 
+	if ((shard->count + 1) * 4 > shard->capacity * 3)
+		GrowShard(shard);
+
+	// The entry goes in before parsing so that an import of this module from
+	// within itself is caught above
+	uint32_t mask = shard->capacity - 1;
+	uint32_t pos = probe & mask;
+
+	while (shard->entries[pos].module)
+		pos = (pos + 1) & mask;
+
 	TutModule* module = Tut_Malloc(sizeof(TutModule));
+	CacheEntry* entry = &shard->entries[pos];
+
+	entry->table = table;
+	entry->path = path;
+	entry->id = id;
+	entry->hash = hash;
+	entry->loaded = TUT_FALSE;
+	entry->module = module;
+
+	shard->count += 1;
+
+	Tut_UnlockMutex(&shard->lock);
+
+	Tut_InitModuleFromFile(module, table, path);
+
+	Tut_LockMutex(&shard->lock);
+
+	// The shard may have grown while the module was parsed
+	mask = shard->capacity - 1;
+	pos = probe & mask;
+
+	while (shard->entries[pos].module != module)
+		pos = (pos + 1) & mask;
 
-	Tut_InitModuleFromFile(module, table, filename);
-	Tut_ListAppend(&ModuleCache, module);
+	shard->entries[pos].loaded = TUT_TRUE;
+
+	Tut_UnlockMutex(&shard->lock);
 
 	return module;
 }
 
 void Tut_ClearModuleCache()
 {
-	TUT_LIST_EACH(node, ModuleCache)
-		Tut_DestroyModule(node->value);
-	
-	ModuleCache.head = ModuleCache.tail = NULL;
-	ModuleCache.length = 0;
+	for (int i = 0; i < NUM_CACHE_SHARDS; ++i)
+	{
+		CacheShard* shard = &ModuleCache[i];
+
+		Tut_LockMutex(&shard->lock);
+
+		for (uint32_t j = 0; j < shard->capacity; ++j)
+		{
+			CacheEntry* entry = &shard->entries[j];
+			if (!entry->module)
+				continue;
+
+			Tut_DestroyModule(entry->module);
+			Tut_Free(entry->module);
+			Tut_Free(entry->path);
+		}
+
+		Tut_Free(shard->entries);
+
+		shard->entries = NULL;
+		shard->capacity = 0;
+		shard->count = 0;
+
+		Tut_UnlockMutex(&shard->lock);
+	}
 }
 
 void Tut_DestroyModuleCache()
 {
-	TUT_LIST_EACH(node, ModuleCache)
-		Tut_DestroyModule(node->value);
-	Tut_DestroyList(&ModuleCache);
+	Tut_ClearModuleCache();
+
+	for (int i = 0; i < NUM_CACHE_SHARDS; ++i)
+		Tut_DestroyMutex(&ModuleCache[i].lock);
 }
\ No newline at end of file
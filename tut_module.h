@@ -4,19 +4,29 @@
 #include "tut_lexer.h"
 #include "tut_list.h"
 #include "tut_symbols.h"
+#include "tut_expr.h"
 
 typedef struct TutModule
 {
-	char* name;
+	TutAtom name;
 
 	TutList importedModules;
 	TutSymbolTable* symbolTable;
+
+	// Declarations the module makes (TutFuncDecl*, TutVarDecl* and usertype
+	// TutTypetag*); externs are listed by every module declaring them
+	TutList functions, globals, usertypes;
+
 	TutLexer lexer;
-	TutList exprList;
+
+	TutAst ast;
+	// Top level statements
+	TutExprRange exprList;
 } TutModule;
 
 void Tut_InitModule(TutModule* module, TutSymbolTable* table, const char* code);
 void Tut_InitModuleFromFile(TutModule* module, TutSymbolTable* table, const char* filename);
+// Declarations and typetags belong to the symbol table (see TutSymbolTable::arena)
 void Tut_DestroyModule(TutModule* module);
 
 void Tut_InitModuleCache();
@@ -23,6 +23,48 @@ typedef struct
 	int32_t index;
 } TutFunctionObject;
 
+// Externs and other code outside the vm read and write objects through the
+// TUT_OBJECT_* accessors, which work with both layouts below. The type, sv, ref,
+// ptr and func members only exist in the default layout.
+#ifdef TUT_COMPACT_OBJECTS
+
+// 8 byte objects: bool/int/float payloads are stored in the low 32 bits like
+// before, pointers in the low 48 bits (user space addresses fit into those on
+// x86-64 and AArch64 as long as the top byte isn't used for tagging) and the
+// type in the top byte. Requires a little endian target.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "TUT_COMPACT_OBJECTS requires a little endian target"
+#endif
+
+typedef struct TutObject
+{
+	union
+	{
+		int32_t bv;
+		int32_t iv;
+		float fv;
+		uint64_t bits;
+	};
+} TutObject;
+
+#define TUT_OBJECT_PAYLOAD_MASK		((UINT64_C(1) << 48) - 1)
+#define TUT_OBJECT_FUNC_EXTERN_BIT	(UINT64_C(1) << 32)
+
+#define TUT_OBJECT_TYPE(obj)				(((const uint8_t*)&(obj).bits)[7])
+#define TUT_OBJECT_SET_TYPE(obj, t)			(((uint8_t*)&(obj).bits)[7] = (uint8_t)(t))
+
+#define TUT_OBJECT_REF(obj)					((TutObject*)(uintptr_t)((obj).bits & TUT_OBJECT_PAYLOAD_MASK))
+#define TUT_OBJECT_STR(obj)					((char*)(uintptr_t)((obj).bits & TUT_OBJECT_PAYLOAD_MASK))
+#define TUT_OBJECT_PTR(obj)					((void*)(uintptr_t)((obj).bits & TUT_OBJECT_PAYLOAD_MASK))
+// Sets the type and a pointer payload at once
+#define TUT_OBJECT_SET_REF(obj, t, value)	((obj).bits = ((uint64_t)(t) << 56) | ((uint64_t)(uintptr_t)(value) & TUT_OBJECT_PAYLOAD_MASK))
+
+#define TUT_OBJECT_FUNC_IS_EXTERN(obj)				((TutBool)(((obj).bits & TUT_OBJECT_FUNC_EXTERN_BIT) != 0))
+#define TUT_OBJECT_FUNC_INDEX(obj)					((obj).iv)
+#define TUT_OBJECT_SET_FUNC(obj, ext, i)			((obj).bits = ((uint64_t)TUT_OBJECT_FUNC << 56) | ((ext) ? TUT_OBJECT_FUNC_EXTERN_BIT : 0) | (uint32_t)(i))
+
+#else
+
 typedef struct TutObject
 {
 	uint8_t type;
@@ -38,4 +80,24 @@ typedef struct TutObject
 	};
 } TutObject;
 
+#define TUT_OBJECT_TYPE(obj)				((obj).type)
+#define TUT_OBJECT_SET_TYPE(obj, t)			((obj).type = (uint8_t)(t))
+
+#define TUT_OBJECT_REF(obj)					((obj).ref)
+#define TUT_OBJECT_STR(obj)					((obj).sv)
+#define TUT_OBJECT_PTR(obj)					((obj).ptr)
+#define TUT_OBJECT_SET_REF(obj, t, value)	((obj).type = (uint8_t)(t), (obj).ptr = (void*)(value))
+
+#define TUT_OBJECT_FUNC_IS_EXTERN(obj)				((obj).func.isExtern)
+#define TUT_OBJECT_FUNC_INDEX(obj)					((obj).func.index)
+#define TUT_OBJECT_SET_FUNC(obj, ext, i)			((obj).type = TUT_OBJECT_FUNC, (obj).func.isExtern = (ext), (obj).func.index = (i))
+
+#endif
+
+// Payloads which are stored the same way in both layouts
+#define TUT_OBJECT_BOOL(obj)				((TutBool)(obj).bv)
+#define TUT_OBJECT_INT(obj)					((obj).iv)
+#define TUT_OBJECT_FLOAT(obj)				((obj).fv)
+#define TUT_OBJECT_FUNC(obj)				((TutFunctionObject){ TUT_OBJECT_FUNC_IS_EXTERN(obj), TUT_OBJECT_FUNC_INDEX(obj) })
+
 #endif
@@ -7,6 +7,9 @@ typedef enum
 	TUT_OP_PUSH_FALSE,
 	TUT_OP_PUSH_INT,
 	TUT_OP_PUSH_FLOAT,
+	TUT_OP_PUSH_I8,			// value (int8) follows the opcode
+	TUT_OP_PUSH_I32,		// value (int32) follows the opcode
+	TUT_OP_PUSH_F32,		// value (float) follows the opcode
 	TUT_OP_PUSH_STR,
 	TUT_OP_PUSH_NULL,
 
@@ -54,6 +57,49 @@ typedef enum
 	TUT_OP_SUBF,
 	TUT_OP_MULF,
 	TUT_OP_DIVF,
+
+	// Register forms of the arithmetic ops; these operate directly on the
+	// frame slots at fp + index instead of going through the stack.
+	// dst, a and b are int16 local indices, k is an immediate int32 (or float).
+	TUT_OP_ADDI_LLL,		// locals[dst] = locals[a] + locals[b]
+	TUT_OP_SUBI_LLL,
+	TUT_OP_MULI_LLL,
+	TUT_OP_DIVI_LLL,
+
+	TUT_OP_ADDI_LLK,		// locals[dst] = locals[a] + k
+	TUT_OP_SUBI_LLK,
+	TUT_OP_MULI_LLK,
+	TUT_OP_DIVI_LLK,
+
+	TUT_OP_ADDF_LLL,
+	TUT_OP_SUBF_LLL,
+	TUT_OP_MULF_LLL,
+	TUT_OP_DIVF_LLL,
+
+	TUT_OP_ADDF_LLK,
+	TUT_OP_SUBF_LLK,
+	TUT_OP_MULF_LLK,
+	TUT_OP_DIVF_LLK,
+
+	// Compare and branch on locals: goto target unless locals[a] op locals[b] (or
+	// op k); a and b are int16 local indices, k an int32 and target an int32 pc.
+	// There are no greater than forms for two locals since a > b is b < a.
+	TUT_OP_ILT_LL_JF,
+	TUT_OP_ILTE_LL_JF,
+	TUT_OP_IEQ_LL_JF,
+	TUT_OP_INE_LL_JF,
+
+	TUT_OP_ILT_LK_JF,
+	TUT_OP_ILTE_LK_JF,
+	TUT_OP_IGT_LK_JF,
+	TUT_OP_IGTE_LK_JF,
+	TUT_OP_IEQ_LK_JF,
+	TUT_OP_INE_LK_JF,
+
+	TUT_OP_INCLOCAL,		// locals[a] += k; a is an int16 local index, k an int32
+	TUT_OP_GETFIELD_L,		// push locals[a].ref[offset]; a is an int16 local index, offset an uint16
+
+	TUT_OP_TAG,				// stack[sp - depth].type = type; depth is an uint16, type an uint8 (TutObjectType)
 	
 	TUT_OP_LAND,
 	TUT_OP_LOR,
@@ -64,6 +110,7 @@ typedef enum
 	TUT_OP_ILTE,
 	TUT_OP_IGTE,
 	TUT_OP_IEQ,
+	TUT_OP_INE,
 	TUT_OP_INEG,
 
 	TUT_OP_FLT,
@@ -71,13 +118,14 @@ typedef enum
 	TUT_OP_FLTE,
 	TUT_OP_FGTE,
 	TUT_OP_FEQ,
+	TUT_OP_FNE,
 	TUT_OP_FNEG,
 
 	TUT_OP_BEQ,
 	TUT_OP_SEQ,
 	TUT_OP_REQ,
 
-	TUT_OP_CALL,
+	TUT_OP_CALL,			// nargs (uint16) objects are passed, nret (uint16) returned
 
 	TUT_OP_RET,
 
@@ -86,8 +134,11 @@ typedef enum
 
 	TUT_OP_GOTO,
 	TUT_OP_GOTOFALSE,
+	TUT_OP_GOTOTRUE,		// only emitted by the peephole optimizer
 	
-	TUT_OP_HALT
+	TUT_OP_HALT,
+
+	TUT_OP_COUNT
 } TutOpcode;
 
 #endif
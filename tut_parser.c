@@ -36,17 +36,28 @@ static void EatToken(TutModule* module, TutToken token)
 	Tut_GetToken(&module->lexer);
 }
 
+static TutExprIndex CreateExpr(TutModule* module, TutExprType type)
+{
+	return Tut_CreateExpr(&module->ast, type, &module->lexer.context);
+}
+
+// The pointer is only valid until the next expression is created
+static TutExpr* GetExpr(TutModule* module, TutExprIndex index)
+{
+	return TUT_AST_EXPR(&module->ast, index);
+}
+
 static void SkipSemicolon(TutModule* module)
 {
 	if (module->lexer.curTok == TUT_TOK_SEMICOLON)
 		Tut_GetToken(&module->lexer);
 }
 
-static TutExpr* ParseExpr(TutModule* module);
+static TutExprIndex ParseExpr(TutModule* module);
 
-static TutExpr* ParseStatement(TutModule* module)
+static TutExprIndex ParseStatement(TutModule* module)
 {
-	TutExpr* exp = ParseExpr(module);
+	TutExprIndex exp = ParseExpr(module);
 	if (module->lexer.curTok == TUT_TOK_SEMICOLON)
 		Tut_GetToken(&module->lexer);
 	return exp;
@@ -57,33 +68,24 @@ static TutTypetag* ParseType(TutModule* module)
 	if (module->lexer.curTok != TUT_TOK_IDENT && module->lexer.curTok != TUT_TOK_FUNC)
 		ParseError(module, "Expected typename but received '%s'\n", Tut_TokenRepr(module->lexer.curTok));
 
-	// Attempt to create a primitive type tag (i.e bool, int, str, etc)
-	TutTypetag* tag = Tut_CreatePrimitiveTypetag(module->lexer.lexeme);
-	if(!tag)
-		tag = Tut_RegisterType(module->symbolTable, module->lexer.lexeme);
-	else if (tag->type == TUT_TYPETAG_REF)
-	{
-		Tut_GetToken(&module->lexer);
+	TutTypetagCache* cache = &module->symbolTable->typeCache;
 
-		if (module->lexer.curTok == TUT_TOK_MINUS)
-		{
-			Tut_GetToken(&module->lexer);
-			tag->ref.value = ParseType(module);
-		}
-
-		return tag;
-	}
-	else if (tag->type == TUT_TYPETAG_FUNC)
+	if (module->lexer.curTok == TUT_TOK_FUNC)
 	{
 		Tut_GetToken(&module->lexer);
 
 		EatToken(module, TUT_TOK_OPENPAREN);
 
+		TutArray args;
+		Tut_InitArray(&args, sizeof(TutTypetag*));
+
+		TutBool hasVarargs = TUT_FALSE;
+
 		while (module->lexer.curTok != TUT_TOK_CLOSEPAREN)
 		{
 			if (module->lexer.curTok == TUT_TOK_ELLIPSIS)
 			{
-				tag->func.hasVarargs = TUT_TRUE;
+				hasVarargs = TUT_TRUE;
 				Tut_GetToken(&module->lexer);
 
 				ExpectToken(module, TUT_TOK_CLOSEPAREN);
@@ -92,7 +94,7 @@ static TutTypetag* ParseType(TutModule* module)
 
 			TutTypetag* arg = ParseType(module);
 
-			Tut_ListAppend(&tag->func.args, arg);
+			Tut_ArrayPush(&args, &arg);
 
 			if (module->lexer.curTok == TUT_TOK_COMMA)
 				Tut_GetToken(&module->lexer);
@@ -106,7 +108,26 @@ static TutTypetag* ParseType(TutModule* module)
 
 		Tut_GetToken(&module->lexer);
 
-		tag->func.ret = ParseType(module);
+		TutTypetag* ret = ParseType(module);
+		TutTypetag* tag = Tut_GetFuncTypetag(cache, ret, (TutTypetag**)args.data, (uint32_t)args.length, hasVarargs);
+
+		Tut_DestroyArray(&args);
+		return tag;
+	}
+
+	// Attempt to find a primitive type tag (i.e bool, int, str, etc)
+	TutTypetag* tag = Tut_FindPrimitiveTypetag(module->lexer.lexeme);
+	if(!tag)
+		tag = Tut_RegisterType(module->symbolTable, module->lexer.atom);
+	else if (tag->type == TUT_TYPETAG_REF)
+	{
+		Tut_GetToken(&module->lexer);
+
+		if (module->lexer.curTok == TUT_TOK_MINUS)
+		{
+			Tut_GetToken(&module->lexer);
+			tag = Tut_GetRefTypetag(cache, ParseType(module));
+		}
 
 		return tag;
 	}
@@ -115,44 +136,48 @@ static TutTypetag* ParseType(TutModule* module)
 	return tag;
 }
 
-static TutExpr* ParseInt(TutModule* module)
+static TutExprIndex ParseInt(TutModule* module)
 {
-	TutExpr* exp = Tut_CreateExpr(TUT_EXPR_INT, &module->lexer.context);
+	TutExprIndex index = CreateExpr(module, TUT_EXPR_INT);
+	TutExpr* exp = GetExpr(module, index);
 	exp->intVal = (int)module->lexer.number;
 	
 	Tut_GetToken(&module->lexer);
 	
-	return exp;
+	return index;
 }
 
-static TutExpr* ParseFloat(TutModule* module)
+static TutExprIndex ParseFloat(TutModule* module)
 {
-	TutExpr* exp = Tut_CreateExpr(TUT_EXPR_FLOAT, &module->lexer.context);
+	TutExprIndex index = CreateExpr(module, TUT_EXPR_FLOAT);
+	TutExpr* exp = GetExpr(module, index);
 	exp->floatVal = (float)module->lexer.number;
 	
 	Tut_GetToken(&module->lexer);
 	
-	return exp;
+	return index;
 }
 
-static TutExpr* ParseString(TutModule* module)
+static TutExprIndex ParseString(TutModule* module)
 {
-	TutExpr* exp = Tut_CreateExpr(TUT_EXPR_STR, &module->lexer.context);
-	exp->string = Tut_Strdup(module->lexer.lexeme);
+	TutExprIndex index = CreateExpr(module, TUT_EXPR_STR);
+	TutExpr* exp = GetExpr(module, index);
+	exp->string = Tut_Intern(module->lexer.lexeme);
 
 	Tut_GetToken(&module->lexer);
 	
-	return exp;
+	return index;
 }
 
-static TutExpr* ParseVar(TutModule* module)
+static TutExprIndex ParseVar(TutModule* module)
 {
-	TutExpr* exp = Tut_CreateExpr(TUT_EXPR_VAR, &module->lexer.context);
+	TutExprIndex index = CreateExpr(module, TUT_EXPR_VAR);
+	TutExpr* exp = GetExpr(module, index);
 	Tut_GetToken(&module->lexer);
 	
 	ExpectToken(module, TUT_TOK_IDENT);
 	
-	exp->varx.name = Tut_Strdup(module->lexer.lexeme);
+	exp->varx.name = module->lexer.atom;
 	Tut_GetToken(&module->lexer);
 	
 	EatToken(module, TUT_TOK_COLON);
@@ -160,42 +185,50 @@ static TutExpr* ParseVar(TutModule* module)
 	exp->varx.decl = Tut_DeclareVariable(module->symbolTable, exp->varx.name, ParseType(module));
 	exp->varx.funcDecl = NULL;
 
-	return exp;
+	if (!exp->varx.decl->parent)
+		Tut_ListAppendArena(&module->globals, exp->varx.decl, &module->symbolTable->arena);
+
+	return index;
 }
 
-static TutExpr* ParseIdent(TutModule* module)
+static TutExprIndex ParseIdent(TutModule* module)
 {
-	TutExpr* exp = Tut_CreateExpr(TUT_EXPR_IDENT, &module->lexer.context);
+	TutExprIndex index = CreateExpr(module, TUT_EXPR_IDENT);
+	TutExpr* exp = GetExpr(module, index);
 				
-	exp->varx.name = Tut_Strdup(module->lexer.lexeme);
-	exp->varx.decl = Tut_GetVarDecl(module->symbolTable, module->lexer.lexeme, -1);
+	exp->varx.name = module->lexer.atom;
+	exp->varx.decl = Tut_GetVarDecl(module->symbolTable, module->lexer.atom, -1);
 	exp->varx.funcDecl = NULL;
 	exp->varx.typetag = NULL;
 
 	Tut_GetToken(&module->lexer);
 	
-	return exp;
+	return index;
 }
 
-static TutExpr* ParseFunc(TutModule* module)
+static TutExprIndex ParseFunc(TutModule* module)
 {
 	if (module->symbolTable->curFunc)
 		ParseError(module, "Cannot nest function declarations.\n");	// TODO: Allow it someday
 
-	TutExpr* exp = Tut_CreateExpr(TUT_EXPR_FUNC, &module->lexer.context);
+	TutExprIndex index = CreateExpr(module, TUT_EXPR_FUNC);
+	TutExpr* exp = GetExpr(module, index);
 	Tut_GetToken(&module->lexer);
 	
 	ExpectToken(module, TUT_TOK_IDENT);
 
-	TutFuncDecl* decl = Tut_GetFuncDecl(module->symbolTable, module->lexer.lexeme);
+	TutFuncDecl* decl = Tut_GetFuncDecl(module->symbolTable, module->lexer.atom);
 	if (decl)
 		ParseError(module, "Multiple declaration of function '%s'\n", decl->name);
 
-	exp->funcx.decl = Tut_DeclareFunction(module->symbolTable, module->lexer.lexeme);
-	exp->funcx.decl->typetag = Tut_CreatePrimitiveTypetag("func");
+	exp->funcx.decl = Tut_DeclareFunction(module->symbolTable, module->lexer.atom);
+	Tut_ListAppendArena(&module->functions, exp->funcx.decl, &module->symbolTable->arena);
 	
 	Tut_GetToken(&module->lexer);
 
+	TutArray args;
+	Tut_InitArray(&args, sizeof(TutTypetag*));
+
 	Tut_PushCurFuncDecl(module->symbolTable, exp->funcx.decl);
 	Tut_PushScope(module->symbolTable);
 
@@ -208,7 +241,7 @@ static TutExpr* ParseFunc(TutModule* module)
 		else
 			ExpectToken(module, TUT_TOK_IDENT);
 
-		char* name = Tut_Strdup(module->lexer.lexeme);
+		TutAtom name = module->lexer.atom;
 		Tut_GetToken(&module->lexer);
 		
 		EatToken(module, TUT_TOK_COLON);
@@ -216,9 +249,7 @@ static TutExpr* ParseFunc(TutModule* module)
 		TutTypetag* tag = ParseType(module);
 		
 		Tut_DeclareArgument(module->symbolTable, name, tag);
-		Tut_ListAppend(&exp->funcx.decl->typetag->func.args, tag);
-		
-		Tut_Free(name);
+		Tut_ArrayPush(&args, &tag);
 
 		if(module->lexer.curTok == TUT_TOK_COMMA)
 			Tut_GetToken(&module->lexer);
@@ -229,27 +260,34 @@ static TutExpr* ParseFunc(TutModule* module)
 	
 	EatToken(module, TUT_TOK_COLON);
 
-	exp->funcx.decl->typetag->func.ret = ParseType(module);
-	exp->funcx.body = ParseStatement(module);
+	TutTypetag* ret = ParseType(module);
+
+	exp->funcx.decl->typetag = Tut_GetFuncTypetag(&module->symbolTable->typeCache, ret, (TutTypetag**)args.data, (uint32_t)args.length, TUT_FALSE);
+	Tut_DestroyArray(&args);
+
+	TutExprIndex body = ParseStatement(module);
+	GetExpr(module, index)->funcx.body = body;
 	
 	Tut_PopScope(module->symbolTable);
 
 	Tut_PopCurFuncDecl(module->symbolTable);
 	
-	return exp;
+	return index;
 }
 
 static void ParseExternDecl(TutModule* module)
 {
-	TutFuncDecl* decl = Tut_GetFuncDecl(module->symbolTable, module->lexer.lexeme);
+	TutFuncDecl* decl = Tut_GetFuncDecl(module->symbolTable, module->lexer.atom);
 
 	if (!decl)
 	{
-		decl = Tut_DeclareExtern(module->symbolTable, module->lexer.lexeme);
-		decl->typetag = Tut_CreatePrimitiveTypetag("func");
+		decl = Tut_DeclareExtern(module->symbolTable, module->lexer.atom);
 
 		Tut_GetToken(&module->lexer);
 
+		TutArray args;
+		Tut_InitArray(&args, sizeof(TutTypetag*));
+
 		Tut_PushCurFuncDecl(module->symbolTable, decl);
 
 		EatToken(module, TUT_TOK_OPENPAREN);
@@ -259,7 +297,6 @@ static void ParseExternDecl(TutModule* module)
 			if (module->lexer.curTok == TUT_TOK_ELLIPSIS)
 			{
 				decl->hasVarargs = TUT_TRUE;
-				decl->typetag->func.hasVarargs = TUT_TRUE;
 
 				Tut_GetToken(&module->lexer);
 
@@ -270,7 +307,7 @@ static void ParseExternDecl(TutModule* module)
 
 			ExpectToken(module, TUT_TOK_IDENT);
 
-			char* name = Tut_Strdup(module->lexer.lexeme);
+			TutAtom name = module->lexer.atom;
 			Tut_GetToken(&module->lexer);
 
 			EatToken(module, TUT_TOK_COLON);
@@ -278,9 +315,7 @@ static void ParseExternDecl(TutModule* module)
 			TutTypetag* tag = ParseType(module);
 
 			Tut_DeclareArgument(module->symbolTable, name, tag);
-			Tut_Free(name);
-
-			Tut_ListAppend(&decl->typetag->func.args, tag);
+			Tut_ArrayPush(&args, &tag);
 
 			if (module->lexer.curTok == TUT_TOK_COMMA)
 				Tut_GetToken(&module->lexer);
@@ -291,7 +326,10 @@ static void ParseExternDecl(TutModule* module)
 
 		EatToken(module, TUT_TOK_COLON);
 
-		decl->typetag->func.ret = ParseType(module);
+		TutTypetag* ret = ParseType(module);
+
+		decl->typetag = Tut_GetFuncTypetag(&module->symbolTable->typeCache, ret, (TutTypetag**)args.data, (uint32_t)args.length, decl->hasVarargs);
+		Tut_DestroyArray(&args);
 
 		Tut_PopCurFuncDecl(module->symbolTable);
 	}
@@ -314,10 +352,8 @@ static void ParseExternDecl(TutModule* module)
 			EatToken(module, TUT_TOK_IDENT);
 			EatToken(module, TUT_TOK_COLON);
 
-			TutTypetag* tag = ParseType(module);
-
 			// Discard type
-			Tut_DeleteTypetag(tag);
+			ParseType(module);
 
 			if (module->lexer.curTok == TUT_TOK_COMMA)
 				Tut_GetToken(&module->lexer);
@@ -329,13 +365,12 @@ static void ParseExternDecl(TutModule* module)
 
 		EatToken(module, TUT_TOK_COLON);
 
-		TutTypetag* tag = ParseType(module);
-
 		// Discard type
-		Tut_DeleteTypetag(tag);
+		ParseType(module);
 	}
 
 	assert(decl);
+	Tut_ListAppendArena(&module->functions, decl, &module->symbolTable->arena);
 }
 
 static void HandleExtern(TutModule* module)
@@ -359,45 +394,45 @@ static void HandleExtern(TutModule* module)
 		ParseExternDecl(module);
 }
 
-static TutExpr* ParseReturn(TutModule* module)
+static TutExprIndex ParseReturn(TutModule* module)
 {
-	TutExpr* exp = Tut_CreateExpr(TUT_EXPR_RETURN, &module->lexer.context);
+	TutExprIndex index = CreateExpr(module, TUT_EXPR_RETURN);
 	Tut_GetToken(&module->lexer);
 	
 	if (!module->symbolTable->curFunc)
 		ParseError(module, "Return statement not inside function.\n");
 
-	exp->retx.parent = module->symbolTable->curFunc;
+	GetExpr(module, index)->retx.parent = module->symbolTable->curFunc;
+	GetExpr(module, index)->retx.value = TUT_EXPR_NONE;
 	
 	if(module->lexer.curTok == TUT_TOK_SEMICOLON)
-	{
-		exp->retx.value = NULL;
-		return exp;
-	}
+		return index;
 	
-	exp->retx.value = ParseExpr(module);
+	TutExprIndex value = ParseExpr(module);
+	GetExpr(module, index)->retx.value = value;
 	
-	return exp;
+	return index;
 }
 
-static TutExpr* ParseParen(TutModule* module)
+static TutExprIndex ParseParen(TutModule* module)
 {
-	TutExpr* exp = Tut_CreateExpr(TUT_EXPR_PAREN, &module->lexer.context);
+	TutExprIndex index = CreateExpr(module, TUT_EXPR_PAREN);
 	Tut_GetToken(&module->lexer);
 	
-	exp->parenExpr = ParseExpr(module);
+	TutExprIndex value = ParseExpr(module);
+	GetExpr(module, index)->parenExpr = value;
 	
 	if(module->lexer.curTok != TUT_TOK_CLOSEPAREN)
 		ParseError(module, "Expected matching ')' after previous '(' but received '%s'\n", Tut_TokenRepr(module->lexer.curTok));
 	Tut_GetToken(&module->lexer);
 	
-	return exp;	
+	return index;	
 }
 
-static TutExpr* ParseBlock(TutModule* module)
+static TutExprIndex ParseBlock(TutModule* module)
 {
-	TutExpr* exp = Tut_CreateExpr(TUT_EXPR_BLOCK, &module->lexer.context);
-	Tut_InitList(&exp->blockList);
+	TutExprIndex index = CreateExpr(module, TUT_EXPR_BLOCK);
+	uint32_t mark = Tut_BeginExprList(&module->ast);
 	
 	Tut_GetToken(&module->lexer);
 
@@ -405,57 +440,70 @@ static TutExpr* ParseBlock(TutModule* module)
 
 	while(module->lexer.curTok != TUT_TOK_CLOSECURLY)
 	{
-		TutExpr* bodyExp = ParseExpr(module);
+		TutExprIndex bodyExp = ParseExpr(module);
 		SkipSemicolon(module);
 		
-		Tut_ListAppend(&exp->blockList, bodyExp);
+		if (bodyExp != TUT_EXPR_NONE)
+			Tut_PushExprList(&module->ast, bodyExp);
 	}
 
 	Tut_PopScope(module->symbolTable);
 
 	Tut_GetToken(&module->lexer);
 
-	return exp;
+	GetExpr(module, index)->blockList = Tut_EndExprList(&module->ast, mark);
+
+	return index;
 }
 
-static TutExpr* ParseIf(TutModule* module)
+static TutExprIndex ParseIf(TutModule* module)
 {
-	TutExpr* exp = Tut_CreateExpr(TUT_EXPR_IF, &module->lexer.context);
+	TutExprIndex index = CreateExpr(module, TUT_EXPR_IF);
 	Tut_GetToken(&module->lexer);
 
-	exp->ifx.cond = ParseExpr(module);
-	exp->ifx.body = ParseStatement(module);
+	TutExprIndex cond = ParseExpr(module);
+	TutExprIndex body = ParseStatement(module);
+	TutExprIndex alt = TUT_EXPR_NONE;
 
 	if (module->lexer.curTok == TUT_TOK_ELSE)
 	{
 		Tut_GetToken(&module->lexer);
-		exp->ifx.alt = ParseExpr(module);
+		alt = ParseExpr(module);
 	}
-	else
-		exp->ifx.alt = NULL;
 
-	return exp;
+	TutExpr* exp = GetExpr(module, index);
+
+	exp->ifx.cond = cond;
+	exp->ifx.body = body;
+	exp->ifx.alt = alt;
+
+	return index;
 }
 
-static TutExpr* ParseWhile(TutModule* module)
+static TutExprIndex ParseWhile(TutModule* module)
 {
-	TutExpr* exp = Tut_CreateExpr(TUT_EXPR_WHILE, &module->lexer.context);
+	TutExprIndex index = CreateExpr(module, TUT_EXPR_WHILE);
 	Tut_GetToken(&module->lexer);
 
-	exp->whilex.cond = ParseExpr(module);
-	exp->whilex.body = ParseStatement(module);
+	TutExprIndex cond = ParseExpr(module);
+	TutExprIndex body = ParseStatement(module);
 
-	return exp;
+	GetExpr(module, index)->whilex.cond = cond;
+	GetExpr(module, index)->whilex.body = body;
+
+	return index;
 }
 
-static TutExpr* ParseStruct(TutModule* module)
+static TutExprIndex ParseStruct(TutModule* module)
 {
-	TutExpr* exp = Tut_CreateExpr(TUT_EXPR_STRUCT_DEF, &module->lexer.context);
+	TutExprIndex index = CreateExpr(module, TUT_EXPR_STRUCT_DEF);
+	TutExpr* exp = GetExpr(module, index);
 	Tut_GetToken(&module->lexer);
 
 	ExpectToken(module, TUT_TOK_IDENT);
 	
-	exp->structx.typetag = Tut_DefineType(module->symbolTable, module->lexer.lexeme);
+	exp->structx.typetag = Tut_DefineType(module->symbolTable, module->lexer.atom);
+	Tut_ListAppendArena(&module->usertypes, exp->structx.typetag, &module->symbolTable->arena);
 	Tut_GetToken(&module->lexer);
 
 	EatToken(module, TUT_TOK_OPENCURLY);
@@ -467,7 +515,7 @@ static TutExpr* ParseStruct(TutModule* module)
 		TutTypetagMember mem;
 
 		// Offsets are determined in FinalizeTypes
-		mem.name = Tut_Strdup(module->lexer.lexeme);
+		mem.name = module->lexer.atom;
 		mem.offset = -1;
 
 		Tut_GetToken(&module->lexer);
@@ -486,56 +534,60 @@ static TutExpr* ParseStruct(TutModule* module)
 	}
 	Tut_GetToken(&module->lexer);
 
-	return exp;
+	return index;
 }
 
-static TutExpr* ParseDotOrArrow(TutModule* module, TutExpr* pre, TutExprType type)
+static TutExprIndex ParseDotOrArrow(TutModule* module, TutExprIndex pre, TutExprType type)
 {
-	TutExpr* exp = Tut_CreateExpr(type, &module->lexer.context);
+	TutExprIndex index = CreateExpr(module, type);
+	TutExpr* exp = GetExpr(module, index);
+
 	exp->dotx.value = pre;
 
 	Tut_GetToken(&module->lexer);
 
 	ExpectToken(module, TUT_TOK_IDENT);
 
-	exp->dotx.memberName = Tut_Strdup(module->lexer.lexeme);
+	exp->dotx.memberName = module->lexer.atom;
 	Tut_GetToken(&module->lexer);
 
-	return exp;
+	return index;
 }
 
-static TutExpr* ParseCast(TutModule* module)
+static TutExprIndex ParseCast(TutModule* module)
 {
-	TutExpr* exp = Tut_CreateExpr(TUT_EXPR_CAST, &module->lexer.context);
+	TutExprIndex index = CreateExpr(module, TUT_EXPR_CAST);
 
 	Tut_GetToken(&module->lexer);
 
 	EatToken(module, TUT_TOK_OPENPAREN);
 	
-	exp->castx.value = ParseExpr(module);
+	TutExprIndex value = ParseExpr(module);
 
 	EatToken(module, TUT_TOK_COMMA);
 
-	exp->castx.typetag = ParseType(module);
+	GetExpr(module, index)->castx.value = value;
+	GetExpr(module, index)->castx.typetag = ParseType(module);
 
 	EatToken(module, TUT_TOK_CLOSEPAREN);
 
-	return exp;
+	return index;
 }
 
-static TutExpr* ParseCall(TutModule* module, TutExpr* pre)
+static TutExprIndex ParseCall(TutModule* module, TutExprIndex pre)
 {
-	TutExpr* exp = Tut_CreateExpr(TUT_EXPR_CALL, &module->lexer.context);
+	TutExprIndex index = CreateExpr(module, TUT_EXPR_CALL);
+	uint32_t mark = Tut_BeginExprList(&module->ast);
 	
 	Tut_GetToken(&module->lexer);
-
-	exp->callx.func = pre;
-	Tut_InitList(&exp->callx.args);
 	
 	while(module->lexer.curTok != TUT_TOK_CLOSEPAREN)
 	{
-		TutExpr* arg = ParseExpr(module);
-		Tut_ListAppend(&exp->callx.args, arg);
+		TutExprIndex arg = ParseExpr(module);
+		if (arg == TUT_EXPR_NONE)
+			ParseError(module, "Expected expression in function call arguments.\n");
+
+		Tut_PushExprList(&module->ast, arg);
 		
 		if(module->lexer.curTok == TUT_TOK_COMMA)
 			Tut_GetToken(&module->lexer);
@@ -543,8 +595,13 @@ static TutExpr* ParseCall(TutModule* module, TutExpr* pre)
 			ParseError(module, "Expected ')' or ',' but received '%s'\n", Tut_TokenRepr(module->lexer.curTok));
 	}
 	Tut_GetToken(&module->lexer);
+
+	TutExpr* exp = GetExpr(module, index);
+
+	exp->callx.func = pre;
+	exp->callx.args = Tut_EndExprList(&module->ast, mark);
 	
-	return exp;
+	return index;
 }
 
 static void HandleImport(TutModule* module)
@@ -555,13 +612,14 @@ static void HandleImport(TutModule* module)
 
 	TutModule* mod = Tut_LoadModule(module->symbolTable, module->lexer.lexeme);
 	
-	Tut_ListAppend(&module->importedModules, mod);
+	Tut_ListAppendArena(&module->importedModules, mod, &module->symbolTable->arena);
 	Tut_GetToken(&module->lexer);
 }
 
-static TutExpr* ParseSizeof(TutModule* module)
+static TutExprIndex ParseSizeof(TutModule* module)
 {
-	TutExpr* exp = Tut_CreateExpr(TUT_EXPR_SIZEOF, &module->lexer.context);
+	TutExprIndex index = CreateExpr(module, TUT_EXPR_SIZEOF);
+	TutExpr* exp = GetExpr(module, index);
 
 	Tut_GetToken(&module->lexer);
 	
@@ -571,21 +629,21 @@ static TutExpr* ParseSizeof(TutModule* module)
 
 	EatToken(module, TUT_TOK_CLOSEPAREN);
 
-	return exp;
+	return index;
 }
 
-static TutExpr* ParseFactor(TutModule* module)
+static TutExprIndex ParseFactor(TutModule* module)
 {
 	switch(module->lexer.curTok)
 	{
 		case TUT_TOK_SIZEOF: return ParseSizeof(module);
 
-		case TUT_TOK_IMPORT: HandleImport(module); return NULL;
+		case TUT_TOK_IMPORT: HandleImport(module); return TUT_EXPR_NONE;
 
-		case TUT_TOK_TRUE: Tut_GetToken(&module->lexer); return Tut_CreateExpr(TUT_EXPR_TRUE, &module->lexer.context);
-		case TUT_TOK_FALSE: Tut_GetToken(&module->lexer); return Tut_CreateExpr(TUT_EXPR_FALSE, &module->lexer.context);
+		case TUT_TOK_TRUE: Tut_GetToken(&module->lexer); return CreateExpr(module, TUT_EXPR_TRUE);
+		case TUT_TOK_FALSE: Tut_GetToken(&module->lexer); return CreateExpr(module, TUT_EXPR_FALSE);
 
-		case TUT_TOK_NULL: Tut_GetToken(&module->lexer); return Tut_CreateExpr(TUT_EXPR_NULL, &module->lexer.context);
+		case TUT_TOK_NULL: Tut_GetToken(&module->lexer); return CreateExpr(module, TUT_EXPR_NULL);
 
 		case TUT_TOK_INT: return ParseInt(module);
 		case TUT_TOK_FLOAT: return ParseFloat(module);
@@ -604,7 +662,7 @@ static TutExpr* ParseFactor(TutModule* module)
 
 		case TUT_TOK_FUNC: return ParseFunc(module);
 		
-		case TUT_TOK_EXTERN: HandleExtern(module); return NULL;
+		case TUT_TOK_EXTERN: HandleExtern(module); return TUT_EXPR_NONE;
 
 		case TUT_TOK_RETURN: return ParseReturn(module);
 		
@@ -619,28 +677,28 @@ static TutExpr* ParseFactor(TutModule* module)
 			break;
 	}
 
-	return NULL;
+	return TUT_EXPR_NONE;
 }
 
-static TutExpr* ParsePost(TutModule* module, TutExpr* pre)
+static TutExprIndex ParsePost(TutModule* module, TutExprIndex pre)
 {
 	switch(module->lexer.curTok)
 	{
 		case TUT_TOK_OPENPAREN:
 		{
-			TutExpr* exp = ParseCall(module, pre);
+			TutExprIndex exp = ParseCall(module, pre);
 			return ParsePost(module, exp);
 		} break;
 
 		case TUT_TOK_DOT: 
 		{
-			TutExpr* exp = ParseDotOrArrow(module, pre, TUT_EXPR_DOT);
+			TutExprIndex exp = ParseDotOrArrow(module, pre, TUT_EXPR_DOT);
 			return ParsePost(module, exp);
 		} break;
 
 		case TUT_TOK_ARROW:
 		{
-			TutExpr* exp = ParseDotOrArrow(module, pre, TUT_EXPR_ARROW);
+			TutExprIndex exp = ParseDotOrArrow(module, pre, TUT_EXPR_ARROW);
 			return ParsePost(module, exp);
 		} break;
 
@@ -649,20 +707,22 @@ static TutExpr* ParsePost(TutModule* module, TutExpr* pre)
 	}
 }
 
-static TutExpr* ParseUnary(TutModule* module)
+static TutExprIndex ParseUnary(TutModule* module)
 {
 	if (module->lexer.curTok == TUT_TOK_MINUS ||
 		module->lexer.curTok == TUT_TOK_MUL ||
 		module->lexer.curTok == TUT_TOK_AND)
 	{
-		TutExpr* exp = Tut_CreateExpr(TUT_EXPR_UNARY, &module->lexer.context);
+		TutExprIndex index = CreateExpr(module, TUT_EXPR_UNARY);
 
-		exp->unaryx.op = module->lexer.curTok;
+		GetExpr(module, index)->unaryx.op = module->lexer.curTok;
 
 		Tut_GetToken(&module->lexer);
-		exp->unaryx.value = ParsePost(module, ParseFactor(module));
 
-		return exp;
+		TutExprIndex value = ParsePost(module, ParseFactor(module));
+		GetExpr(module, index)->unaryx.value = value;
+
+		return index;
 	}
 
 	return ParsePost(module, ParseFactor(module));
@@ -683,10 +743,10 @@ static int GetTokenPrec(TutToken op)
 	}
 }
 
-static TutExpr* ParseBinRhs(TutModule* module, TutExpr* lhs, int eprec)
+static TutExprIndex ParseBinRhs(TutModule* module, TutExprIndex lhs, int eprec)
 {
-	if (!lhs)
-		return NULL;
+	if (lhs == TUT_EXPR_NONE)
+		return TUT_EXPR_NONE;
 
 	while(TUT_TRUE)
 	{
@@ -698,21 +758,22 @@ static TutExpr* ParseBinRhs(TutModule* module, TutExpr* lhs, int eprec)
 		int op = module->lexer.curTok; 
 		Tut_GetToken(&module->lexer);
 		
-		TutExpr* rhs = ParseUnary(module);
+		TutExprIndex rhs = ParseUnary(module);
 		if(GetTokenPrec(module->lexer.curTok) > prec)
 			rhs = ParseBinRhs(module, rhs, prec + 1);
 		
-		TutExpr* exp = Tut_CreateExpr(TUT_EXPR_BIN, &module->lexer.context);
+		TutExprIndex index = CreateExpr(module, TUT_EXPR_BIN);
+		TutExpr* exp = GetExpr(module, index);
 		
 		exp->binx.lhs = lhs;
 		exp->binx.rhs = rhs;
 		exp->binx.op = op;
 		
-		lhs = exp;
+		lhs = index;
 	}
 }
 
-static TutExpr* ParseExpr(TutModule* module)
+static TutExprIndex ParseExpr(TutModule* module)
 {
 	return ParseBinRhs(module, ParseUnary(module), 0);
 }
@@ -724,18 +785,22 @@ void Tut_ParseModule(TutModule* module)
 	EatToken(module, TUT_TOK_MODULE);
 	ExpectToken(module, TUT_TOK_IDENT);
 
-	module->name = Tut_Strdup(module->lexer.lexeme);
+	module->name = module->lexer.atom;
 
 	Tut_GetToken(&module->lexer);
 
 	if (module->lexer.curTok == TUT_TOK_SEMICOLON)
 		Tut_GetToken(&module->lexer);
 
+	uint32_t mark = Tut_BeginExprList(&module->ast);
+
 	while(module->lexer.curTok != TUT_TOK_EOF)
 	{
-		TutExpr* exp = ParseExpr(module);
-		if(exp)
-			Tut_ListAppend(&module->exprList, exp);
+		TutExprIndex exp = ParseExpr(module);
+		if(exp != TUT_EXPR_NONE)
+			Tut_PushExprList(&module->ast, exp);
 		SkipSemicolon(module);
 	}
+
+	module->exprList = Tut_EndExprList(&module->ast, mark);
 }
@@ -0,0 +1,607 @@
+#include <string.h>
+#include <assert.h>
+
+#include "tut_peephole.h"
+#include "tut_opcodes.h"
+#include "tut_codegen.h"
+#include "tut_buf.h"
+
+#define MAX_INSTR_SIZE	12
+
+// Jumps are threaded through at most this many gotos so cycles don't hang us
+#define MAX_JUMP_HOPS	16
+
+typedef struct
+{
+	int32_t pc;			// In the original code; jump targets stay in terms of these
+	TutBool leader;		// Jumped to or a function entry, so nothing is folded into it
+	TutBool removed;
+
+	uint8_t size;
+	uint8_t bytes[MAX_INSTR_SIZE];
+} Instr;
+
+typedef struct
+{
+	Instr* instrs;
+	uint32_t count;
+} Code;
+
+static uint8_t Op(const Instr* ins)
+{
+	return ins->bytes[0];
+}
+
+static int32_t GetTarget(const Instr* ins)
+{
+	return Tut_ReadInt32(ins->bytes, Tut_GetJumpTargetOffset(Op(ins)));
+}
+
+static void SetTarget(Instr* ins, int32_t target)
+{
+	Tut_WriteInt32(ins->bytes, Tut_GetJumpTargetOffset(Op(ins)), target);
+}
+
+static int32_t NextLive(const Code* code, int32_t i)
+{
+	for (++i; i < (int32_t)code->count && code->instrs[i].removed; ++i);
+	return i;
+}
+
+static int32_t PrevLive(const Code* code, int32_t i)
+{
+	for (--i; i >= 0 && code->instrs[i].removed; --i);
+	return i;
+}
+
+// Index of the instruction at pc in the original code, or of the first one after
+// it which wasn't removed; code->count if there is none
+static int32_t FindLive(const Code* code, int32_t pc)
+{
+	int32_t lo = 0, hi = (int32_t)code->count;
+
+	while (lo < hi)
+	{
+		int32_t mid = (lo + hi) / 2;
+
+		if (code->instrs[mid].pc < pc)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo < (int32_t)code->count && code->instrs[lo].removed)
+		lo = NextLive(code, lo);
+
+	return lo;
+}
+
+// Whatever jumped to a removed instruction ends up at the next one instead
+static void Remove(Code* code, int32_t i)
+{
+	Instr* ins = &code->instrs[i];
+
+	ins->removed = TUT_TRUE;
+
+	if (ins->leader)
+	{
+		int32_t next = NextLive(code, i);
+		if (next < (int32_t)code->count)
+			code->instrs[next].leader = TUT_TRUE;
+	}
+}
+
+static void SetOp(Instr* ins, uint8_t op)
+{
+	ins->bytes[0] = op;
+	ins->size = 1;
+}
+
+static void SetOpUint16(Instr* ins, uint8_t op, uint16_t a)
+{
+	SetOp(ins, op);
+
+	Tut_WriteUint16(ins->bytes, 1, a);
+	ins->size += 2;
+}
+
+static void SetOpInt32(Instr* ins, uint8_t op, int32_t a)
+{
+	SetOp(ins, op);
+
+	Tut_WriteInt32(ins->bytes, 1, a);
+	ins->size += 4;
+}
+
+static void SetOpUint16Int32(Instr* ins, uint8_t op, uint16_t a, int32_t b)
+{
+	SetOpUint16(ins, op, a);
+
+	Tut_WriteInt32(ins->bytes, 3, b);
+	ins->size += 4;
+}
+
+// The Set* helpers below remove the instruction if count is 0
+static void SetPop(Code* code, int32_t i, int count)
+{
+	if (count == 0)
+		Remove(code, i);
+	else if (count == 1)
+		SetOp(&code->instrs[i], TUT_OP_POP1);
+	else
+		SetOpUint16(&code->instrs[i], TUT_OP_POPN, (uint16_t)count);
+}
+
+static void SetPush(Code* code, int32_t i, int count)
+{
+	if (count == 0)
+		Remove(code, i);
+	else if (count == 1)
+		SetOp(&code->instrs[i], TUT_OP_PUSH1);
+	else
+		SetOpUint16(&code->instrs[i], TUT_OP_PUSHN, (uint16_t)count);
+}
+
+static void SetGet(Code* code, int32_t i, TutBool global, int count, int32_t index)
+{
+	if (count == 0)
+		Remove(code, i);
+	else if (count == 1)
+		SetOpInt32(&code->instrs[i], global ? TUT_OP_GETGLOBAL1 : TUT_OP_GETLOCAL1, index);
+	else
+		SetOpUint16Int32(&code->instrs[i], global ? TUT_OP_GETGLOBALN : TUT_OP_GETLOCALN, (uint16_t)count, index);
+}
+
+static void SetSet(Code* code, int32_t i, TutBool global, int count, int32_t index)
+{
+	if (count == 1)
+		SetOpInt32(&code->instrs[i], global ? TUT_OP_SETGLOBAL1 : TUT_OP_SETLOCAL1, index);
+	else
+		SetOpUint16Int32(&code->instrs[i], global ? TUT_OP_SETGLOBALN : TUT_OP_SETLOCALN, (uint16_t)count, index);
+}
+
+static TutBool IsPop(const Instr* ins, int* count)
+{
+	switch (Op(ins))
+	{
+		case TUT_OP_POP1: *count = 1; return TUT_TRUE;
+		case TUT_OP_POPN: *count = Tut_ReadUint16(ins->bytes, 1); return TUT_TRUE;
+		default: return TUT_FALSE;
+	}
+}
+
+static TutBool IsPush(const Instr* ins, int* count)
+{
+	switch (Op(ins))
+	{
+		case TUT_OP_PUSH1: *count = 1; return TUT_TRUE;
+		case TUT_OP_PUSHN: *count = Tut_ReadUint16(ins->bytes, 1); return TUT_TRUE;
+		default: return TUT_FALSE;
+	}
+}
+
+static TutBool IsMove(const Instr* ins, int* count, int* spaces)
+{
+	switch (Op(ins))
+	{
+		case TUT_OP_MOVE1:
+			*count = 1;
+			*spaces = Tut_ReadUint16(ins->bytes, 1);
+			return TUT_TRUE;
+
+		case TUT_OP_MOVEN:
+			*count = Tut_ReadUint16(ins->bytes, 1);
+			*spaces = Tut_ReadUint16(ins->bytes, 3);
+			return TUT_TRUE;
+
+		default: return TUT_FALSE;
+	}
+}
+
+static TutBool IsGetOrSet(const Instr* ins, uint8_t one, uint8_t n, int* count, int32_t* index)
+{
+	if (Op(ins) == one)
+	{
+		*count = 1;
+		*index = Tut_ReadInt32(ins->bytes, 1);
+		return TUT_TRUE;
+	}
+
+	if (Op(ins) == n)
+	{
+		*count = Tut_ReadUint16(ins->bytes, 1);
+		*index = Tut_ReadInt32(ins->bytes, 3);
+		return TUT_TRUE;
+	}
+
+	return TUT_FALSE;
+}
+
+static TutBool IsGet(const Instr* ins, TutBool* global, int* count, int32_t* index)
+{
+	*global = TUT_FALSE;
+	if (IsGetOrSet(ins, TUT_OP_GETLOCAL1, TUT_OP_GETLOCALN, count, index))
+		return TUT_TRUE;
+
+	*global = TUT_TRUE;
+	return IsGetOrSet(ins, TUT_OP_GETGLOBAL1, TUT_OP_GETGLOBALN, count, index);
+}
+
+static TutBool IsSet(const Instr* ins, TutBool* global, int* count, int32_t* index)
+{
+	*global = TUT_FALSE;
+	if (IsGetOrSet(ins, TUT_OP_SETLOCAL1, TUT_OP_SETLOCALN, count, index))
+		return TUT_TRUE;
+
+	*global = TUT_TRUE;
+	return IsGetOrSet(ins, TUT_OP_SETGLOBAL1, TUT_OP_SETGLOBALN, count, index);
+}
+
+// Pushes exactly one value and has no other effect
+static TutBool IsPureSinglePush(uint8_t op)
+{
+	switch (op)
+	{
+		case TUT_OP_PUSH_TRUE:
+		case TUT_OP_PUSH_FALSE:
+		case TUT_OP_PUSH_INT:
+		case TUT_OP_PUSH_FLOAT:
+		case TUT_OP_PUSH_I8:
+		case TUT_OP_PUSH_I32:
+		case TUT_OP_PUSH_F32:
+		case TUT_OP_PUSH_STR:
+		case TUT_OP_PUSH_NULL:
+		case TUT_OP_MAKEGLOBALREF:
+		case TUT_OP_MAKELOCALREF:
+		case TUT_OP_MAKEFUNC:
+		case TUT_OP_MAKEEXTERNFUNC:
+		case TUT_OP_GETFIELD_L:
+			return TUT_TRUE;
+
+		default:
+			return TUT_FALSE;
+	}
+}
+
+static TutBool FoldSingle(Code* code, int32_t i)
+{
+	Instr* ins = &code->instrs[i];
+
+	int count, spaces;
+
+	// Moving down by nothing
+	if (IsMove(ins, &count, &spaces) && spaces == 0)
+	{
+		Remove(code, i);
+		return TUT_TRUE;
+	}
+
+	return TUT_FALSE;
+}
+
+// b is the instruction following a and is not a leader
+static TutBool FoldPair(Code* code, int32_t ia, int32_t ib)
+{
+	Instr* a = &code->instrs[ia];
+	Instr* b = &code->instrs[ib];
+
+	uint8_t opA = Op(a), opB = Op(b);
+
+	if (opB == TUT_OP_LNOT)
+	{
+		uint8_t negated = 0;
+
+		switch (opA)
+		{
+			case TUT_OP_IEQ: negated = TUT_OP_INE; break;
+			case TUT_OP_INE: negated = TUT_OP_IEQ; break;
+			case TUT_OP_FEQ: negated = TUT_OP_FNE; break;
+			case TUT_OP_FNE: negated = TUT_OP_FEQ; break;
+
+			case TUT_OP_LNOT:
+				Remove(code, ia);
+				Remove(code, ib);
+				return TUT_TRUE;
+		}
+
+		if (negated)
+		{
+			SetOp(a, negated);
+			Remove(code, ib);
+			return TUT_TRUE;
+		}
+	}
+
+	if (opA == TUT_OP_LNOT && (opB == TUT_OP_GOTOFALSE || opB == TUT_OP_GOTOTRUE))
+	{
+		b->bytes[0] = opB == TUT_OP_GOTOFALSE ? TUT_OP_GOTOTRUE : TUT_OP_GOTOFALSE;
+		Remove(code, ia);
+		return TUT_TRUE;
+	}
+
+	int popped;
+
+	if (IsPop(b, &popped))
+	{
+		int count;
+		TutBool global;
+		int32_t index;
+
+		if (IsPop(a, &count) && count + popped <= UINT16_MAX)
+		{
+			SetPop(code, ia, count + popped);
+			Remove(code, ib);
+			return TUT_TRUE;
+		}
+
+		if (IsPush(a, &count))
+		{
+			int net = count - popped;
+
+			if (net >= 0)
+			{
+				Remove(code, ib);
+				SetPush(code, ia, net);
+			}
+			else
+			{
+				Remove(code, ia);
+				SetPop(code, ib, -net);
+			}
+
+			return TUT_TRUE;
+		}
+
+		if (IsGet(a, &global, &count, &index))
+		{
+			if (popped >= count)
+			{
+				Remove(code, ia);
+				SetPop(code, ib, popped - count);
+			}
+			else
+			{
+				Remove(code, ib);
+				SetGet(code, ia, global, count - popped, index);
+			}
+
+			return TUT_TRUE;
+		}
+
+		if (IsPureSinglePush(opA))
+		{
+			Remove(code, ia);
+			SetPop(code, ib, popped - 1);
+			return TUT_TRUE;
+		}
+	}
+
+	TutBool globalA, globalB;
+	int countA, countB;
+	int32_t indexA, indexB;
+
+	if (IsGet(a, &globalA, &countA, &indexA))
+	{
+		int spaces;
+
+		// Getting a member of a struct variable; only the member is fetched
+		if (IsMove(b, &countB, &spaces) && countA == countB + spaces)
+		{
+			Remove(code, ib);
+			SetGet(code, ia, globalA, countB, indexA + spaces);
+			return TUT_TRUE;
+		}
+
+		if (IsGet(b, &globalB, &countB, &indexB) && globalA == globalB &&
+			indexB == indexA + countA && countA + countB <= UINT16_MAX)
+		{
+			Remove(code, ib);
+			SetGet(code, ia, globalA, countA + countB, indexA);
+			return TUT_TRUE;
+		}
+	}
+
+	// The first set takes the topmost values, so b's slots have to come right
+	// before a's
+	if (IsSet(a, &globalA, &countA, &indexA) && IsSet(b, &globalB, &countB, &indexB) &&
+		globalA == globalB && indexB + countB == indexA && countA + countB <= UINT16_MAX)
+	{
+		Remove(code, ib);
+		SetSet(code, ia, globalA, countA + countB, indexB);
+		return TUT_TRUE;
+	}
+
+	return TUT_FALSE;
+}
+
+static TutBool FoldBlocks(Code* code)
+{
+	TutBool changed = TUT_FALSE;
+
+	for (int32_t i = 0; i < (int32_t)code->count; )
+	{
+		if (code->instrs[i].removed)
+		{
+			++i;
+			continue;
+		}
+
+		if (FoldSingle(code, i))
+		{
+			changed = TUT_TRUE;
+			continue;
+		}
+
+		int32_t next = NextLive(code, i);
+
+		if (next < (int32_t)code->count && !code->instrs[next].leader && FoldPair(code, i, next))
+		{
+			changed = TUT_TRUE;
+
+			// What's left of the pair may fold with the instruction before it;
+			// every fold removes an instruction, so this terminates
+			int32_t prev = PrevLive(code, i);
+			if (prev >= 0)
+				i = prev;
+
+			continue;
+		}
+
+		i = next;
+	}
+
+	return changed;
+}
+
+static TutBool SimplifyJumps(Code* code)
+{
+	TutBool changed = TUT_FALSE;
+
+	for (int32_t i = 0; i < (int32_t)code->count; ++i)
+	{
+		Instr* ins = &code->instrs[i];
+
+		if (ins->removed || !Tut_GetJumpTargetOffset(Op(ins)))
+			continue;
+
+		int32_t target = GetTarget(ins);
+
+		// Jumping to a goto is jumping to where it goes
+		int hops = 0;
+
+		for (; hops < MAX_JUMP_HOPS; ++hops)
+		{
+			int32_t t = FindLive(code, target);
+			if (t >= (int32_t)code->count || t == i || Op(&code->instrs[t]) != TUT_OP_GOTO)
+				break;
+
+			int32_t next = GetTarget(&code->instrs[t]);
+			if (next == target)
+				break;
+
+			target = next;
+		}
+
+		// Gotos going around in a circle are left alone
+		if (hops < MAX_JUMP_HOPS && target != GetTarget(ins))
+		{
+			SetTarget(ins, target);
+			changed = TUT_TRUE;
+		}
+
+		if (FindLive(code, GetTarget(ins)) != NextLive(code, i))
+			continue;
+
+		// Jumping to the next instruction; GOTOFALSE and GOTOTRUE still have to
+		// get rid of the condition
+		if (Op(ins) == TUT_OP_GOTOFALSE || Op(ins) == TUT_OP_GOTOTRUE)
+			SetOp(ins, TUT_OP_POP1);
+		else
+			Remove(code, i);
+
+		changed = TUT_TRUE;
+	}
+
+	return changed;
+}
+
+static void MarkLeader(Code* code, int32_t pc)
+{
+	int32_t i = FindLive(code, pc);
+
+	if (i < (int32_t)code->count)
+		code->instrs[i].leader = TUT_TRUE;
+}
+
+// Maps a pc in the original code to where it ended up
+static int32_t Relocate(const Code* code, const int32_t* newPcs, int32_t pc)
+{
+	return newPcs[FindLive(code, pc)];
+}
+
+void Tut_OptimizeCode(TutProgram* program)
+{
+	assert(!program->codeReadOnly);
+
+	if (program->codeSize == 0)
+		return;
+
+	Code code;
+
+	code.instrs = Tut_Malloc(sizeof(Instr) * program->codeSize);
+	code.count = 0;
+
+	for (uint32_t pc = 0; pc < program->codeSize; )
+	{
+		int size = Tut_GetOpcodeSize(program->code[pc]);
+		assert(size <= MAX_INSTR_SIZE && pc + size <= program->codeSize);
+
+		Instr* ins = &code.instrs[code.count++];
+
+		ins->pc = (int32_t)pc;
+		ins->leader = TUT_FALSE;
+		ins->removed = TUT_FALSE;
+		ins->size = (uint8_t)size;
+
+		memcpy(ins->bytes, &program->code[pc], size);
+
+		pc += size;
+	}
+
+	// Basic blocks start at every jump target and every function entry point
+	for (uint32_t i = 0; i < code.count; ++i)
+	{
+		if (Tut_GetJumpTargetOffset(Op(&code.instrs[i])))
+			MarkLeader(&code, GetTarget(&code.instrs[i]));
+	}
+
+	for (size_t i = 0; i < program->functionPcs.length; ++i)
+	{
+		int32_t pc = TUT_ARRAY_GET_VALUE(&program->functionPcs, i, int32_t);
+		if (pc >= 0)
+			MarkLeader(&code, pc);
+	}
+
+	while (FoldBlocks(&code) | SimplifyJumps(&code));
+
+	// One past the last instruction too, for jumps to the end of the code
+	int32_t* newPcs = Tut_Malloc(sizeof(int32_t) * (code.count + 1));
+	int32_t pc = 0;
+
+	for (uint32_t i = 0; i < code.count; ++i)
+	{
+		newPcs[i] = pc;
+		if (!code.instrs[i].removed)
+			pc += code.instrs[i].size;
+	}
+
+	newPcs[code.count] = pc;
+
+	// Instructions only ever shrink, so the code is rewritten in place
+	for (uint32_t i = 0; i < code.count; ++i)
+	{
+		Instr* ins = &code.instrs[i];
+		if (ins->removed)
+			continue;
+
+		if (Tut_GetJumpTargetOffset(Op(ins)))
+			SetTarget(ins, Relocate(&code, newPcs, GetTarget(ins)));
+
+		memcpy(&program->code[newPcs[i]], ins->bytes, ins->size);
+	}
+
+	program->codeSize = (uint32_t)pc;
+
+	for (size_t i = 0; i < program->functionPcs.length; ++i)
+	{
+		int32_t entry = TUT_ARRAY_GET_VALUE(&program->functionPcs, i, int32_t);
+		if (entry < 0)
+			continue;
+
+		entry = Relocate(&code, newPcs, entry);
+		Tut_ArraySet(&program->functionPcs, i, &entry);
+	}
+
+	Tut_Free(newPcs);
+	Tut_Free(code.instrs);
+}
@@ -0,0 +1,14 @@
+#ifndef TUT_PEEPHOLE_H
+#define TUT_PEEPHOLE_H
+
+#include "tut_program.h"
+
+// Folds naive instruction sequences in program's code into cheaper ones (e.g.
+// IEQ; LNOT -> INE, LNOT; GOTOFALSE -> GOTOTRUE, GETLOCAL1 i; GETLOCAL1 i + 1 ->
+// GETLOCALN 2, i). Nothing is folded across the start of a basic block; jump
+// targets and function entry points are relocated afterwards. The code must not
+// be finalized yet and gotos have to be relative to the start of the code (i.e.
+// it has to be a whole program or a chunk which is not linked yet).
+void Tut_OptimizeCode(TutProgram* program);
+
+#endif
@@ -0,0 +1,441 @@
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "tut_program.h"
+#include "tut_verify.h"
+#include "tut_vm.h"
+
+// All fields are uint32_t so the header has the same layout everywhere; the magic
+// doubles as an endianness check since images are written in native byte order
+typedef struct
+{
+	uint32_t magic;
+	uint32_t version;
+	// sizeof(TutObject); sizeof() in scripts is compiled to a constant, so code
+	// only runs with the object layout it was compiled for
+	uint32_t objectSize;
+
+	uint32_t numGlobals;
+	uint32_t functionSignature;
+	uint32_t flags;
+
+	uint32_t codeOffset, codeSize;
+	uint32_t integersOffset, numIntegers;
+	uint32_t floatsOffset, numFloats;
+	uint32_t functionPcsOffset, numFunctionPcs;
+	// One for each function pc
+	uint32_t functionStackDepthsOffset;
+	uint32_t entryStackDepth;
+	uint32_t globalLayoutOffset, numGlobalLayout;
+	// NUL terminated, one after another
+	uint32_t stringsOffset, numStrings;
+	uint32_t externNamesOffset, numExternNames;
+
+	uint32_t imageSize;
+} TutImageHeader;
+
+#define TUT_IMAGE_MAGIC	(('T') | ('U' << 8) | ('T' << 16) | ('C' << 24))
+
+static void InitPoolIndex(TutPoolIndex* index)
+{
+	index->slots = NULL;
+	index->capacity = 0;
+	index->count = 0;
+}
+
+static void DestroyPoolIndices(TutProgram* program)
+{
+	Tut_Free(program->stringIndex.slots);
+
+	InitPoolIndex(&program->stringIndex);
+}
+
+TutProgram* Tut_CreateProgram()
+{
+	TutProgram* program = Tut_Malloc(sizeof(TutProgram));
+
+	program->refCount = 1;
+
+	Tut_InitArray(&program->integers, sizeof(int32_t));
+	Tut_InitArray(&program->floats, sizeof(float));
+	Tut_InitArray(&program->strings, sizeof(const char*));
+	Tut_InitArray(&program->functionPcs, sizeof(int32_t));
+	Tut_InitArray(&program->functionStackDepths, sizeof(int32_t));
+	program->entryStackDepth = 0;
+	Tut_InitArray(&program->functionArities, sizeof(TutFunctionArity));
+
+	InitPoolIndex(&program->stringIndex);
+
+	Tut_InitArray(&program->externNames, sizeof(const char*));
+	Tut_InitArray(&program->externs, sizeof(TutVMExternFunction));
+
+	program->numGlobals = 0;
+	Tut_InitArray(&program->globalLayout, sizeof(TutGlobalLayout));
+
+	program->functionSignature = 0;
+	program->flags = TUT_PROGRAM_NONE;
+
+	program->codeSize = 0;
+	program->codeCapacity = 0;
+	program->codeReadOnly = TUT_FALSE;
+	program->code = NULL;
+
+	program->image = NULL;
+	program->imageSize = 0;
+
+	return program;
+}
+
+static void DestroyProgram(TutProgram* program)
+{
+	DestroyPoolIndices(program);
+
+	for (size_t i = 0; i < program->externNames.length; ++i)
+		Tut_Free(TUT_ARRAY_GET_VALUE(&program->externNames, i, char*));
+
+	Tut_DestroyArray(&program->externNames);
+	Tut_DestroyArray(&program->externs);
+	Tut_DestroyArray(&program->functionArities);
+
+	if (program->image)
+	{
+		// Only the string table was allocated, everything else lives in the image
+		Tut_DestroyArray(&program->strings);
+		Tut_UnmapFile(program->image, program->imageSize);
+		
+		Tut_Free(program);
+		return;
+	}
+
+	for (size_t i = 0; i < program->strings.length; ++i)
+		Tut_Free(TUT_ARRAY_GET_VALUE(&program->strings, i, char*));
+
+	Tut_DestroyArray(&program->integers);
+	Tut_DestroyArray(&program->floats);
+	Tut_DestroyArray(&program->strings);
+	Tut_DestroyArray(&program->functionPcs);
+	Tut_DestroyArray(&program->functionStackDepths);
+	Tut_DestroyArray(&program->globalLayout);
+
+	if (program->codeReadOnly)
+		Tut_FreePages(program->code, program->codeSize);
+	else
+		Tut_Free(program->code);
+
+	Tut_Free(program);
+}
+
+void Tut_RetainProgram(TutProgram* program)
+{
+	Tut_AtomicAdd(&program->refCount, 1);
+}
+
+void Tut_ReleaseProgram(TutProgram* program)
+{
+	if (!program) return;
+
+	if (Tut_AtomicAdd(&program->refCount, -1) == 0)
+		DestroyProgram(program);
+}
+
+void Tut_BindExtern(TutProgram* program, uint32_t index, const char* name, TutVMExternFunction ext)
+{
+	assert(index < program->externNames.length &&
+		   index < program->externs.length);
+	
+	char* str = Tut_Strdup(name);
+
+	Tut_Free(TUT_ARRAY_GET_VALUE(&program->externNames, index, char*));
+
+	Tut_ArraySet(&program->externNames, index, &str);
+	Tut_ArraySet(&program->externs, index, &ext);
+}
+
+void Tut_BindExternByName(TutProgram* program, const char* name, TutVMExternFunction ext)
+{
+	for (size_t i = 0; i < program->externNames.length; ++i)
+	{
+		const char* externName = TUT_ARRAY_GET_VALUE(&program->externNames, i, const char*);
+
+		if (externName && strcmp(externName, name) == 0)
+		{
+			Tut_ArraySet(&program->externs, i, &ext);
+			return;
+		}
+	}
+}
+
+void Tut_FinalizeCode(TutProgram* program, TutBool readOnly)
+{
+	if (program->codeReadOnly || program->codeSize == 0)
+		return;
+
+	if (readOnly)
+	{
+		uint8_t* code = Tut_AllocPages(program->codeSize);
+		memcpy(code, program->code, program->codeSize);
+
+		Tut_ProtectPages(code, program->codeSize, TUT_TRUE);
+		Tut_Free(program->code);
+
+		program->code = code;
+		program->codeReadOnly = TUT_TRUE;
+
+		DestroyPoolIndices(program);
+	}
+	else
+		program->code = Tut_Realloc(program->code, program->codeSize);
+
+	program->codeCapacity = program->codeSize;
+}
+
+static uint32_t Align4(uint32_t value)
+{
+	return (value + 3) & ~3u;
+}
+
+static uint32_t StringTableSize(const TutArray* strings)
+{
+	uint32_t size = 0;
+
+	for (size_t i = 0; i < strings->length; ++i)
+	{
+		const char* str = *(const char**)&strings->data[i * strings->datumSize];
+		size += str ? strlen(str) + 1 : 1;
+	}
+
+	return size;
+}
+
+static void WriteStringTable(FILE* file, const TutArray* strings)
+{
+	for (size_t i = 0; i < strings->length; ++i)
+	{
+		const char* str = *(const char**)&strings->data[i * strings->datumSize];
+		if (!str) str = "";
+
+		fwrite(str, 1, strlen(str) + 1, file);
+	}
+}
+
+static void WriteArray(FILE* file, const TutArray* array)
+{
+	if (array->length > 0)
+		fwrite(array->data, array->datumSize, array->length, file);
+}
+
+static void WritePadding(FILE* file, uint32_t pos)
+{
+	static const uint8_t zeros[4] = { 0 };
+	fwrite(zeros, 1, Align4(pos) - pos, file);
+}
+
+TutBool Tut_SaveProgram(const TutProgram* program, const char* filename)
+{
+	TutImageHeader header;
+
+	header.magic = TUT_IMAGE_MAGIC;
+	header.version = TUT_IMAGE_VERSION;
+	header.objectSize = sizeof(TutObject);
+	header.numGlobals = program->numGlobals;
+	header.functionSignature = program->functionSignature;
+	header.flags = program->flags;
+
+	uint32_t pos = sizeof(header);
+
+	header.codeOffset = pos;
+	header.codeSize = program->codeSize;
+	pos = Align4(pos + header.codeSize);
+
+	header.integersOffset = pos;
+	header.numIntegers = program->integers.length;
+	pos += header.numIntegers * sizeof(int32_t);
+
+	header.floatsOffset = pos;
+	header.numFloats = program->floats.length;
+	pos += header.numFloats * sizeof(float);
+
+	header.functionPcsOffset = pos;
+	header.numFunctionPcs = program->functionPcs.length;
+	pos += header.numFunctionPcs * sizeof(int32_t);
+
+	assert(program->functionStackDepths.length == program->functionPcs.length);
+
+	header.functionStackDepthsOffset = pos;
+	header.entryStackDepth = program->entryStackDepth;
+	pos += header.numFunctionPcs * sizeof(int32_t);
+
+	header.globalLayoutOffset = pos;
+	header.numGlobalLayout = program->globalLayout.length;
+	pos += header.numGlobalLayout * sizeof(TutGlobalLayout);
+
+	header.stringsOffset = pos;
+	header.numStrings = program->strings.length;
+	pos = Align4(pos + StringTableSize(&program->strings));
+
+	header.externNamesOffset = pos;
+	header.numExternNames = program->externNames.length;
+	pos = Align4(pos + StringTableSize(&program->externNames));
+
+	header.imageSize = pos;
+
+	FILE* file = fopen(filename, "wb");
+	if (!file)
+		return TUT_FALSE;
+
+	fwrite(&header, sizeof(header), 1, file);
+
+	fwrite(program->code, 1, program->codeSize, file);
+	WritePadding(file, header.codeOffset + header.codeSize);
+
+	WriteArray(file, &program->integers);
+	WriteArray(file, &program->floats);
+	WriteArray(file, &program->functionPcs);
+	WriteArray(file, &program->functionStackDepths);
+	WriteArray(file, &program->globalLayout);
+
+	WriteStringTable(file, &program->strings);
+	WritePadding(file, header.stringsOffset + StringTableSize(&program->strings));
+
+	WriteStringTable(file, &program->externNames);
+	WritePadding(file, header.externNamesOffset + StringTableSize(&program->externNames));
+
+	TutBool success = !ferror(file);
+	
+	if (fclose(file) != 0)
+		success = TUT_FALSE;
+
+	return success;
+}
+
+// Points array at count elements inside the image without copying them
+static void MapArray(TutArray* array, uint8_t* image, uint32_t offset, uint32_t count, size_t datumSize)
+{
+	array->data = image + offset;
+	array->datumSize = datumSize;
+	array->length = count;
+	array->capacity = count;
+}
+
+// Fills strings with pointers to count NUL terminated strings starting at offset;
+// returns FALSE if they run past the end of the image
+static TutBool MapStringTable(TutArray* strings, const uint8_t* image, size_t imageSize, uint32_t offset, uint32_t count, TutBool copy)
+{
+	Tut_ArrayReserve(strings, count);
+
+	size_t pos = offset;
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		const uint8_t* end = pos < imageSize ? memchr(&image[pos], '\0', imageSize - pos) : NULL;
+		if (!end)
+			return TUT_FALSE;
+
+		const char* str = (const char*)&image[pos];
+		if (copy)
+			str = Tut_Strdup(str);
+
+		Tut_ArrayPush(strings, &str);
+		pos = (end - image) + 1;
+	}
+
+	return TUT_TRUE;
+}
+
+static TutBool SectionFits(const TutImageHeader* header, uint32_t offset, uint32_t count, size_t datumSize)
+{
+	return offset % 4 == 0 && offset <= header->imageSize && 
+		   count <= (header->imageSize - offset) / datumSize;
+}
+
+// Globals are copied by layout when reloading, so every entry has to be in range
+static TutBool GlobalLayoutFits(const TutProgram* program)
+{
+	for (uint32_t i = 0; i < program->globalLayout.length; ++i)
+	{
+		const TutGlobalLayout* layout = Tut_ArrayGetConst(&program->globalLayout, i);
+
+		if (layout->index < 0 || layout->size < 0 || layout->index > program->numGlobals - layout->size)
+			return TUT_FALSE;
+	}
+
+	return TUT_TRUE;
+}
+
+TutProgram* Tut_LoadProgram(const char* filename)
+{
+	size_t imageSize;
+	uint8_t* image = Tut_MapFile(filename, &imageSize);
+
+	if (!image)
+		return NULL;
+
+	TutImageHeader header;
+
+	if (imageSize < sizeof(header))
+	{
+		Tut_UnmapFile(image, imageSize);
+		return NULL;
+	}
+
+	memcpy(&header, image, sizeof(header));
+
+	if (header.magic != TUT_IMAGE_MAGIC || header.version != TUT_IMAGE_VERSION || header.imageSize != imageSize ||
+		header.objectSize != sizeof(TutObject) ||
+		header.numGlobals > TUT_VM_MAX_GLOBALS ||
+		!SectionFits(&header, header.codeOffset, header.codeSize, 1) ||
+		!SectionFits(&header, header.integersOffset, header.numIntegers, sizeof(int32_t)) ||
+		!SectionFits(&header, header.floatsOffset, header.numFloats, sizeof(float)) ||
+		!SectionFits(&header, header.functionPcsOffset, header.numFunctionPcs, sizeof(int32_t)) ||
+		!SectionFits(&header, header.functionStackDepthsOffset, header.numFunctionPcs, sizeof(int32_t)) ||
+		!SectionFits(&header, header.globalLayoutOffset, header.numGlobalLayout, sizeof(TutGlobalLayout)))
+	{
+		Tut_UnmapFile(image, imageSize);
+		return NULL;
+	}
+
+	TutProgram* program = Tut_CreateProgram();
+
+	program->image = image;
+	program->imageSize = imageSize;
+
+	program->numGlobals = header.numGlobals;
+	program->functionSignature = header.functionSignature;
+	program->flags = header.flags;
+
+	// The mapping is read-only, so the code is as protected as after Tut_FinalizeCode
+	program->code = image + header.codeOffset;
+	program->codeSize = header.codeSize;
+	program->codeCapacity = header.codeSize;
+	program->codeReadOnly = TUT_TRUE;
+
+	MapArray(&program->integers, image, header.integersOffset, header.numIntegers, sizeof(int32_t));
+	MapArray(&program->floats, image, header.floatsOffset, header.numFloats, sizeof(float));
+	MapArray(&program->functionPcs, image, header.functionPcsOffset, header.numFunctionPcs, sizeof(int32_t));
+	MapArray(&program->functionStackDepths, image, header.functionStackDepthsOffset, header.numFunctionPcs, sizeof(int32_t));
+	program->entryStackDepth = (int32_t)header.entryStackDepth;
+	MapArray(&program->globalLayout, image, header.globalLayoutOffset, header.numGlobalLayout, sizeof(TutGlobalLayout));
+
+	// Extern names are copied since binding may replace them
+	if (!GlobalLayoutFits(program) ||
+		!MapStringTable(&program->strings, image, imageSize, header.stringsOffset, header.numStrings, TUT_FALSE) ||
+		!MapStringTable(&program->externNames, image, imageSize, header.externNamesOffset, header.numExternNames, TUT_TRUE))
+	{
+		Tut_ReleaseProgram(program);
+		return NULL;
+	}
+
+	void* value = NULL;
+	Tut_ArrayResize(&program->externs, header.numExternNames, &value);
+
+	// The vm trusts the code and the stored stack depths, so they're checked here
+	// rather than on every instruction
+	if (!Tut_VerifyProgram(program))
+	{
+		Tut_ReleaseProgram(program);
+		return NULL;
+	}
+
+	return program;
+}
@@ -0,0 +1,131 @@
+#ifndef TUT_PROGRAM_H
+#define TUT_PROGRAM_H
+
+#define TUT_PROGRAM_INIT_CODE_CAPACITY	256
+
+// Bump whenever the image layout or the instruction set changes
+#define TUT_IMAGE_VERSION	8
+
+#include "tut_util.h"
+#include "tut_objects.h"
+#include "tut_array.h"
+
+struct TutVM;
+
+// Externs return number of values pushed onto the stack (0 if none are returned)
+// args are read through the TUT_OBJECT_* accessors (see tut_objects.h)
+typedef uint16_t(*TutVMExternFunction)(struct TutVM* vm, const TutObject* args, uint16_t nargs);
+
+// Open addressing index over a constant pool (hash 0 marks an empty slot)
+typedef struct
+{
+	uint32_t hash;
+	uint32_t length;
+	int32_t index;
+} TutPoolSlot;
+
+typedef struct
+{
+	TutPoolSlot* slots;
+	uint32_t capacity, count;
+} TutPoolIndex;
+
+// Where a global lives and what it holds, so that a reloaded program can take
+// over the globals of the program it replaces (see Tut_ReloadVM)
+typedef struct
+{
+	uint32_t nameHash;
+	// Type of the global and, for structs, their layout
+	uint32_t layoutHash;
+	int32_t index, size;
+} TutGlobalLayout;
+
+// What a call to a function has to agree with, as found by Tut_VerifyProgram
+typedef struct
+{
+	// Arguments the function reads at most (i.e. the lowest local index it uses,
+	// negated); calls may pass more. Functions which aren't defined get more than
+	// any call can pass.
+	int32_t numArgs;
+	// Objects every return of the function leaves, or -1 if it never returns
+	int32_t numReturns;
+} TutFunctionArity;
+
+typedef enum
+{
+	TUT_PROGRAM_NONE = 0,
+	// The code doesn't keep the runtime type of values up to date; only arguments
+	// passed to externs are tagged (see TUT_CFLAG_UNTAGGED)
+	TUT_PROGRAM_UNTAGGED = 1,
+} TutProgramFlags;
+
+// Everything the compiler produces. Once compiled (and externs are bound) a program
+// is never modified, so any number of TutVMs can execute it at the same time.
+typedef struct TutProgram
+{
+	volatile int32_t refCount;
+
+	TutArray integers;
+	TutArray floats;
+	TutArray strings;
+
+	// Only used while emitting code so that strings are deduplicated in O(1)
+	// (int and float literals are emitted inline, see Tut_EmitPushInt)
+	TutPoolIndex stringIndex;
+
+	TutArray functionPcs;
+	// Stack slots each function uses at most above its frame pointer and the same
+	// for the code at pc 0 (see Tut_VerifyProgram)
+	TutArray functionStackDepths;
+	int32_t entryStackDepth;
+	// Filled in by Tut_VerifyProgram, images included (it's not stored in them);
+	// CALL checks calls which aren't verified statically against it
+	TutArray functionArities;
+
+	TutArray externNames;
+	TutArray externs;
+
+	int32_t numGlobals;
+	TutArray globalLayout;
+
+	// Hash of the name, index and type of every function and extern; code of one
+	// program can call functions of another by index if both have the same
+	uint32_t functionSignature;
+
+	// TutProgramFlags
+	uint32_t flags;
+
+	// Grows as code is emitted; see Tut_FinalizeCode
+	uint32_t codeSize, codeCapacity;
+	TutBool codeReadOnly;
+	uint8_t* code;
+
+	// Set if the program was loaded from a .tutc image, in which case code, integers,
+	// floats, functionPcs and the string data point straight into the mapped file
+	void* image;
+	size_t imageSize;
+} TutProgram;
+
+// Returns a new, empty program with a reference count of 1
+TutProgram* Tut_CreateProgram();
+
+void Tut_RetainProgram(TutProgram* program);
+// Destroys the program once the last reference is released
+void Tut_ReleaseProgram(TutProgram* program);
+
+void Tut_BindExtern(TutProgram* program, uint32_t index, const char* name, TutVMExternFunction ext);
+// Binds ext to the extern declared with the given name (if the program has one)
+void Tut_BindExternByName(TutProgram* program, const char* name, TutVMExternFunction ext);
+
+// Shrinks the code segment to fit exactly; if readOnly is set, the code is moved into
+// its own pages which are then write protected (no more code can be emitted after that,
+// so the constant pool indices are freed as well)
+void Tut_FinalizeCode(TutProgram* program, TutBool readOnly);
+
+// Writes the program out as a .tutc image (externs have to be bound again after loading)
+TutBool Tut_SaveProgram(const TutProgram* program, const char* filename);
+// Maps a .tutc image; returns NULL if the file cannot be opened or is not a valid image
+// of the current version. The returned program has a reference count of 1.
+TutProgram* Tut_LoadProgram(const char* filename);
+
+#endif
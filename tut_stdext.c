@@ -8,7 +8,7 @@
 
 static uint16_t ExtPrintf(TutVM* vm, const TutObject* args, uint16_t nargs)
 {
-	const char* str = args[0].sv;
+	const char* str = TUT_OBJECT_STR(args[0]);
 	int argIndex = 1;
 	size_t length = strlen(str);
 
@@ -19,38 +19,38 @@ static uint16_t ExtPrintf(TutVM* vm, const TutObject* args, uint16_t nargs)
 			++i;
 			if (str[i] == 'i')
 			{
-				int32_t value = args[argIndex++].iv;
+				int32_t value = TUT_OBJECT_INT(args[argIndex++]);
 				printf("%i", value);
 			}
 			else if (str[i] == 'f')
 			{
-				float value = args[argIndex++].fv;
+				float value = TUT_OBJECT_FLOAT(args[argIndex++]);
 				printf("%f", value);
 			}
 			else if (str[i] == 's')
 			{
-				const char* str = args[argIndex++].sv;
+				const char* str = TUT_OBJECT_STR(args[argIndex++]);
 				printf("%s", str);
 			}
 			else if (str[i] == '.')
 			{
 				const TutObject* obj = &args[argIndex++];
 
-				switch (obj->type)
+				switch (TUT_OBJECT_TYPE(*obj))
 				{
-					case TUT_OBJECT_BOOL: printf("%s", obj->bv ? "true" : "false"); break;
-					case TUT_OBJECT_INT: printf("%i", obj->iv); break;
-					case TUT_OBJECT_FLOAT: printf("%f", obj->fv); break;
-					case TUT_OBJECT_STR: case TUT_OBJECT_CSTR: printf("%s", obj->sv); break;
+					case TUT_OBJECT_BOOL: printf("%s", TUT_OBJECT_BOOL(*obj) ? "true" : "false"); break;
+					case TUT_OBJECT_INT: printf("%i", TUT_OBJECT_INT(*obj)); break;
+					case TUT_OBJECT_FLOAT: printf("%f", TUT_OBJECT_FLOAT(*obj)); break;
+					case TUT_OBJECT_STR: case TUT_OBJECT_CSTR: printf("%s", TUT_OBJECT_STR(*obj)); break;
 					case TUT_OBJECT_FUNC: 
 					{
-						if (obj->func.isExtern)
-							printf("extern %s [%i]", TUT_ARRAY_GET_VALUE(&vm->externNames, obj->func.index, const char*), obj->func.index);
+						if (TUT_OBJECT_FUNC_IS_EXTERN(*obj))
+							printf("extern %s [%i]", TUT_ARRAY_GET_VALUE(&vm->program->externNames, TUT_OBJECT_FUNC_INDEX(*obj), const char*), TUT_OBJECT_FUNC_INDEX(*obj));
 						else
-							printf("function [%i]", obj->func.index);
+							printf("function [%i]", TUT_OBJECT_FUNC_INDEX(*obj));
 					} break;
-					case TUT_OBJECT_REF: printf("ref %" PRIdPTR, (uintptr_t)obj->ref); break;
-					case TUT_OBJECT_PTR: printf("ptr %" PRIdPTR, (uintptr_t)obj->ref); break;
+					case TUT_OBJECT_REF: printf("ref %" PRIdPTR, (uintptr_t)TUT_OBJECT_REF(*obj)); break;
+					case TUT_OBJECT_PTR: printf("ptr %" PRIdPTR, (uintptr_t)TUT_OBJECT_PTR(*obj)); break;
 				}
 			}
 		}
@@ -63,15 +63,15 @@ static uint16_t ExtPrintf(TutVM* vm, const TutObject* args, uint16_t nargs)
 
 static uint16_t ExtStrlen(TutVM* vm, const TutObject* args, uint16_t nargs)
 {
-	Tut_PushInt(vm, (int32_t)strlen(args[0].sv));
+	Tut_PushInt(vm, (int32_t)strlen(TUT_OBJECT_STR(args[0])));
 
 	return 1;
 }
 
 static uint16_t ExtMalloc(TutVM* vm, const TutObject* args, uint16_t nargs)
 {
-	assert(args[0].iv >= 0);
-	void* mem = Tut_Malloc(args[0].iv);
+	assert(TUT_OBJECT_INT(args[0]) >= 0);
+	void* mem = Tut_Malloc(TUT_OBJECT_INT(args[0]));
 
 	Tut_PushRef(vm, mem);
 
@@ -80,11 +80,11 @@ static uint16_t ExtMalloc(TutVM* vm, const TutObject* args, uint16_t nargs)
 
 static uint16_t ExtMemcpy(TutVM* vm, const TutObject* args, uint16_t nargs)
 {
-	assert(args[0].ref && args[1].ref);
+	assert(TUT_OBJECT_REF(args[0]) && TUT_OBJECT_REF(args[1]));
 	
-	size_t sizeInBytes = (size_t)args[2].iv;
+	size_t sizeInBytes = (size_t)TUT_OBJECT_INT(args[2]);
 
-	void* ref = memcpy(args[0].ref, args[1].ref, sizeInBytes);
+	void* ref = memcpy(TUT_OBJECT_REF(args[0]), TUT_OBJECT_REF(args[1]), sizeInBytes);
 	Tut_PushRef(vm, ref);
 
 	return 1;
@@ -92,30 +92,30 @@ static uint16_t ExtMemcpy(TutVM* vm, const TutObject* args, uint16_t nargs)
 
 static uint16_t ExtRadd(TutVM* vm, const TutObject* args, uint16_t nargs)
 {
-	assert(args[0].ref);
+	assert(TUT_OBJECT_REF(args[0]));
 
-	Tut_PushRef(vm, (void*)((intptr_t)args[0].ref + args[1].iv));
+	Tut_PushRef(vm, (void*)((intptr_t)TUT_OBJECT_REF(args[0]) + TUT_OBJECT_INT(args[1])));
 
 	return 1;
 }
 
 static uint16_t ExtFree(TutVM* vm, const TutObject* args, uint16_t nargs)
 {
-	Tut_Free(args[0].ref);
+	Tut_Free(TUT_OBJECT_REF(args[0]));
 	return 0;
 }
 
 static uint16_t ExtTostr(TutVM* vm, const TutObject* args, uint16_t nargs)
 {
-	Tut_PushString(vm, Tut_Strdup(args[0].sv));
+	Tut_PushString(vm, Tut_Strdup(TUT_OBJECT_STR(args[0])));
 	return 1;
 }
 
 static uint16_t ExtSubstr(TutVM* vm, const TutObject* args, uint16_t nargs)
 {
-	const char* str = args[0].sv;
-	int start = args[1].iv;
-	int end = args[2].iv;
+	const char* str = TUT_OBJECT_STR(args[0]);
+	int start = TUT_OBJECT_INT(args[1]);
+	int end = TUT_OBJECT_INT(args[2]);
 	int len = end - start;
 
 	char* buf = Tut_Malloc(end - start + 1);
@@ -129,7 +129,7 @@ static uint16_t ExtSubstr(TutVM* vm, const TutObject* args, uint16_t nargs)
 
 static uint16_t ExtFreestr(TutVM* vm, const TutObject* args, uint16_t nargs)
 {
-	char* str = args[0].sv;
+	char* str = TUT_OBJECT_STR(args[0]);
 	assert(str);
 
 	Tut_Free(str);
@@ -138,20 +138,20 @@ static uint16_t ExtFreestr(TutVM* vm, const TutObject* args, uint16_t nargs)
 
 static uint16_t ExtGettype(TutVM* vm, const TutObject* args, uint16_t nargs)
 {
-	Tut_PushInt(vm, args[0].type);
+	Tut_PushInt(vm, TUT_OBJECT_TYPE(args[0]));
 	return 1;
 }
 
-void TutStdExt_BindAll(TutModule* module, TutVM* vm)
+void TutStdExt_BindAll(TutProgram* program)
 {
-	Tut_BindExternFindIndex(module, vm, "gettype", ExtGettype);
-	Tut_BindExternFindIndex(module, vm, "printf", ExtPrintf);
-	Tut_BindExternFindIndex(module, vm, "strlen", ExtStrlen);
-	Tut_BindExternFindIndex(module, vm, "malloc", ExtMalloc);
-	Tut_BindExternFindIndex(module, vm, "memcpy", ExtMemcpy);
-	Tut_BindExternFindIndex(module, vm, "radd", ExtRadd);
-	Tut_BindExternFindIndex(module, vm, "free", ExtFree);
-	Tut_BindExternFindIndex(module, vm, "tostr", ExtTostr);
-	Tut_BindExternFindIndex(module, vm, "substr", ExtSubstr);
-	Tut_BindExternFindIndex(module, vm, "freestr", ExtFreestr);
+	Tut_BindExternByName(program, "gettype", ExtGettype);
+	Tut_BindExternByName(program, "printf", ExtPrintf);
+	Tut_BindExternByName(program, "strlen", ExtStrlen);
+	Tut_BindExternByName(program, "malloc", ExtMalloc);
+	Tut_BindExternByName(program, "memcpy", ExtMemcpy);
+	Tut_BindExternByName(program, "radd", ExtRadd);
+	Tut_BindExternByName(program, "free", ExtFree);
+	Tut_BindExternByName(program, "tostr", ExtTostr);
+	Tut_BindExternByName(program, "substr", ExtSubstr);
+	Tut_BindExternByName(program, "freestr", ExtFreestr);
 }
\ No newline at end of file
@@ -6,6 +6,6 @@
 #include "tut_module.h"
 #include "tut_vm.h"
 
-void TutStdExt_BindAll(TutModule* module, TutVM* vm);
+void TutStdExt_BindAll(TutProgram* program);
 
 #endif
\ No newline at end of file
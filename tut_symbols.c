@@ -5,9 +5,117 @@
 #include "tut_symbols.h"
 #include "tut_util.h"
 
-static TutFuncDecl* MakeFuncDecl(const char* name, TutFuncDeclType type)
+static void InitSymbolMap(TutSymbolMap* map)
 {
-	TutFuncDecl* decl = Tut_Malloc(sizeof(TutFuncDecl));
+	map->slots = NULL;
+	map->capacity = 0;
+	map->count = 0;
+
+	Tut_InitArray(&map->bindings, sizeof(TutSymbolBinding));
+}
+
+static void DestroySymbolMap(TutSymbolMap* map)
+{
+	Tut_Free(map->slots);
+	Tut_DestroyArray(&map->bindings);
+}
+
+static TutSymbolSlot* FindSymbolSlot(TutSymbolSlot* slots, uint32_t capacity, TutAtom name)
+{
+	uint32_t pos = Tut_AtomHash(name) & (capacity - 1);
+
+	while (slots[pos].name && slots[pos].name != name)
+		pos = (pos + 1) & (capacity - 1);
+
+	return &slots[pos];
+}
+
+static void GrowSymbolMap(TutSymbolMap* map)
+{
+	uint32_t capacity = map->capacity ? map->capacity * 2 : 16;
+	TutSymbolSlot* slots = Tut_Calloc(capacity, sizeof(TutSymbolSlot));
+
+	for (uint32_t i = 0; i < map->capacity; ++i)
+	{
+		if (map->slots[i].name)
+			*FindSymbolSlot(slots, capacity, map->slots[i].name) = map->slots[i];
+	}
+
+	Tut_Free(map->slots);
+
+	map->slots = slots;
+	map->capacity = capacity;
+}
+
+// Returns the innermost binding of name which was declared at or below scope
+static void* SymbolMapGet(TutSymbolMap* map, TutAtom name, int scope)
+{
+	if (!map->count)
+		return NULL;
+
+	TutSymbolSlot* slot = FindSymbolSlot(map->slots, map->capacity, name);
+
+	if (!slot->name)
+		return NULL;
+
+	for (int32_t i = slot->binding; i >= 0; )
+	{
+		TutSymbolBinding* binding = Tut_ArrayGet(&map->bindings, i);
+		if (binding->scope <= scope)
+			return binding->value;
+
+		i = binding->shadowed;
+	}
+
+	return NULL;
+}
+
+static void SymbolMapBind(TutSymbolMap* map, TutAtom name, int scope, void* value)
+{
+	if ((map->count + 1) * 4 > map->capacity * 3)
+		GrowSymbolMap(map);
+
+	TutSymbolSlot* slot = FindSymbolSlot(map->slots, map->capacity, name);
+
+	if (!slot->name)
+	{
+		slot->name = name;
+		slot->binding = -1;
+
+		map->count += 1;
+	}
+
+	TutSymbolBinding binding;
+
+	binding.name = name;
+	binding.scope = scope;
+	binding.shadowed = slot->binding;
+	binding.value = value;
+
+	slot->binding = map->bindings.length;
+	Tut_ArrayPush(&map->bindings, &binding);
+}
+
+// Unbinds everything bound at scope or deeper (bindings are made in scope order so
+// they are all at the end)
+static void SymbolMapPopScope(TutSymbolMap* map, int scope)
+{
+	while (map->bindings.length > 0)
+	{
+		TutSymbolBinding* binding = Tut_ArrayGet(&map->bindings, map->bindings.length - 1);
+		if (binding->scope < scope)
+			break;
+
+		TutSymbolSlot* slot = FindSymbolSlot(map->slots, map->capacity, binding->name);
+		slot->binding = binding->shadowed;
+
+		map->bindings.length -= 1;
+	}
+}
+
+static TutFuncDecl* MakeFuncDecl(TutSymbolTable* table, TutAtom name, TutFuncDeclType type)
+{
+	TutFuncDecl* decl = Tut_ArenaAlloc(&table->arena, sizeof(TutFuncDecl));
 	
 	decl->type = type;
 	decl->typetag = NULL;
@@ -16,34 +124,43 @@ static TutFuncDecl* MakeFuncDecl(const char* name, TutFuncDeclType type)
 	
 	decl->hasVarargs = TUT_FALSE;
 	decl->index = -1;
-	decl->name = Tut_Strdup(name);
+	decl->name = name;
 	
 	Tut_InitList(&decl->locals);
 	Tut_InitList(&decl->args);
 	Tut_InitList(&decl->nestedFunctions);
+
+	InitSymbolMap(&decl->vars);
 	
 	return decl;
 }
 
-static TutVarDecl* MakeVarDecl(const char* name, TutTypetag* typetag)
+static TutVarDecl* MakeVarDecl(TutSymbolTable* table, TutAtom name, TutTypetag* typetag)
 {
-	TutVarDecl* decl = Tut_Malloc(sizeof(TutVarDecl));
+	TutVarDecl* decl = Tut_ArenaAlloc(&table->arena, sizeof(TutVarDecl));
 	
 	decl->typetag = typetag;
 	decl->parent = NULL;
 	
 	decl->index = TUT_VAR_DECL_INDEX_UNDEFINED;
 	decl->scope = -1;
-	decl->name = Tut_Strdup(name);
+	decl->name = name;
 
 	return decl;
 }
 
 void Tut_InitSymbolTable(TutSymbolTable* table)
 {	
+	Tut_InitArena(&table->arena);
+	Tut_InitTypetagCache(&table->typeCache, &table->arena);
+
 	Tut_InitList(&table->usertypes);
 	Tut_InitList(&table->functions);
 	Tut_InitList(&table->globals);
+
+	InitSymbolMap(&table->typeMap);
+	InitSymbolMap(&table->functionMap);
+	InitSymbolMap(&table->globalMap);
 	
 	table->curFunc = NULL;
 	table->curScope = 0;
@@ -52,51 +169,56 @@ void Tut_InitSymbolTable(TutSymbolTable* table)
 	table->numExterns = 0;
 }
 
-TutFuncDecl* Tut_DeclareFunction(TutSymbolTable* table, const char* name)
+static void AddFuncDecl(TutSymbolTable* table, TutFuncDecl* decl)
 {
-	TutFuncDecl* decl = Tut_GetFuncDecl(table, name);
+	// Nested declarations are few (only externs), those are simply searched
+	if(table->curFunc)
+		Tut_ListAppendArena(&table->curFunc->nestedFunctions, decl, &table->arena);
+	else
+	{
+		Tut_ListAppendArena(&table->functions, decl, &table->arena);
+		SymbolMapBind(&table->functionMap, decl->name, 0, decl);
+	}
+}
 
-	decl = MakeFuncDecl(name, TUT_FUNC_DECL_NORMAL);
+TutFuncDecl* Tut_DeclareFunction(TutSymbolTable* table, TutAtom name)
+{
+	TutFuncDecl* decl = MakeFuncDecl(table, name, TUT_FUNC_DECL_NORMAL);
 	decl->index = table->numFunctions++;
 		
-	if(table->curFunc)
-		Tut_ListAppend(&table->curFunc->nestedFunctions, decl);
-	else
-		Tut_ListAppend(&table->functions, decl);
+	AddFuncDecl(table, decl);
 	
 	return decl;
 }
 
-TutFuncDecl* Tut_DeclareExtern(TutSymbolTable* table, const char* name)
+TutFuncDecl* Tut_DeclareExtern(TutSymbolTable* table, TutAtom name)
 {
-	TutFuncDecl* decl = MakeFuncDecl(name, TUT_FUNC_DECL_EXTERN);
+	TutFuncDecl* decl = MakeFuncDecl(table, name, TUT_FUNC_DECL_EXTERN);
 	decl->index = table->numExterns++;
 
-	if (table->curFunc)
-		Tut_ListAppend(&table->curFunc->nestedFunctions, decl);
-	else
-		Tut_ListAppend(&table->functions, decl);
+	AddFuncDecl(table, decl);
 
 	return decl;
 }
 
-TutVarDecl* Tut_DeclareArgument(TutSymbolTable* table, const char* name, TutTypetag* typetag)
+TutVarDecl* Tut_DeclareArgument(TutSymbolTable* table, TutAtom name, TutTypetag* typetag)
 {
 	assert(table->curFunc);
 	
-	TutVarDecl* decl = MakeVarDecl(name, typetag);
+	TutVarDecl* decl = MakeVarDecl(table, name, typetag);
 	
 	decl->parent = table->curFunc;
 	decl->scope = table->curScope;
 		
-	Tut_ListAppend(&table->curFunc->args, decl);
+	Tut_ListAppendArena(&table->curFunc->args, decl, &table->arena);
+	SymbolMapBind(&table->curFunc->vars, decl->name, decl->scope, decl);
 	
 	return decl;
 }
 
-TutVarDecl* Tut_DeclareVariable(TutSymbolTable* table, const char* name, TutTypetag* typetag)
+TutVarDecl* Tut_DeclareVariable(TutSymbolTable* table, TutAtom name, TutTypetag* typetag)
 {
-	TutVarDecl* decl = MakeVarDecl(name, typetag);
+	TutVarDecl* decl = MakeVarDecl(table, name, typetag);
 
 	decl->parent = table->curFunc;
 	decl->outOfScope = TUT_FALSE;
@@ -105,53 +227,31 @@ TutVarDecl* Tut_DeclareVariable(TutSymbolTable* table, const char* name, TutType
 	{
 		decl->scope = table->curScope;
 
-		Tut_ListAppend(&table->curFunc->locals, decl);
+		Tut_ListAppendArena(&table->curFunc->locals, decl, &table->arena);
+		SymbolMapBind(&table->curFunc->vars, decl->name, decl->scope, decl);
 	}
 	else
 	{
 		decl->scope = 0;
 		
-		Tut_ListAppend(&table->globals, decl);
+		Tut_ListAppendArena(&table->globals, decl, &table->arena);
+		SymbolMapBind(&table->globalMap, decl->name, 0, decl);
 	}
 	
 	return decl;
 }
 
-TutTypetag* Tut_DefineType(TutSymbolTable* table, const char* name)
+TutTypetag* Tut_DefineType(TutSymbolTable* table, TutAtom name)
 {
-	TUT_LIST_EACH(node, table->usertypes)
-	{
-		TutTypetag* tag = node->value;
-		assert(tag->user.name);
-		
-		if(strcmp(tag->user.name, name) == 0)
-		{
-			tag->user.defined = TUT_TRUE;
-			return tag;
-		}
-	}
-	
-	TutTypetag* tag = Tut_Malloc(sizeof(TutTypetag));
-	
-	Tut_InitTypetag(tag, TUT_TYPETAG_USERTYPE);
+	TutTypetag* tag = Tut_RegisterType(table, name);
 	tag->user.defined = TUT_TRUE;
-	tag->user.name = Tut_Strdup(name);
-	
-	Tut_ListAppend(&table->usertypes, tag);
-	
+
 	return tag;
 }
 
-TutTypetag* Tut_GetType(TutSymbolTable* table, const char* name)
+TutTypetag* Tut_GetType(TutSymbolTable* table, TutAtom name)
 {
-	TUT_LIST_EACH(node, table->usertypes)
-	{
-		TutTypetag* tag = node->value;
-		if (strcmp(tag->user.name, name) == 0)
-			return tag;
-	}
-
-	return NULL;
+	return SymbolMapGet(&table->typeMap, name, 0);
 }
 
 void Tut_PushScope(TutSymbolTable* table)
@@ -163,13 +263,19 @@ void Tut_PopScope(TutSymbolTable* table)
 {
 	if (table->curFunc)
 	{
+		TutSymbolMap* vars = &table->curFunc->vars;
+
 		// Set the variables which occupied this scope to be out of scope
-		TUT_LIST_EACH(node, table->curFunc->locals)
+		for (size_t i = vars->bindings.length; i-- > 0; )
 		{
-			TutVarDecl* decl = node->value;
-			if (!decl->outOfScope && decl->scope == table->curScope)
-				decl->outOfScope = TUT_TRUE;
+			TutSymbolBinding* binding = Tut_ArrayGet(&vars->bindings, i);
+			if (binding->scope < table->curScope)
+				break;
+
+			((TutVarDecl*)binding->value)->outOfScope = TUT_TRUE;
 		}
+
+		SymbolMapPopScope(vars, table->curScope);
 	}
 
 	--table->curScope;
@@ -187,86 +293,86 @@ void Tut_PopCurFuncDecl(TutSymbolTable* table)
 		table->curFunc = table->curFunc->parent;
 }
 
-TutVarDecl* Tut_GetVarDecl(TutSymbolTable* table, const char* name, int scope)
+TutVarDecl* Tut_GetVarDecl(TutSymbolTable* table, TutAtom name, int scope)
 {
 	if(scope < 0) scope = table->curScope;
 	
 	if(table->curFunc)
 	{
-		TutFuncDecl* funcDecl = table->curFunc;
-		
-		TUT_LIST_EACH(node, funcDecl->locals)
-		{
-			TutVarDecl* varDecl = node->value;
-			for(int i = scope; i >= 0; --i)
-			{
-				if(!varDecl->outOfScope && varDecl->scope == i && strcmp(varDecl->name, name) == 0)
-					return varDecl;
-			}
-		}
-		
-		TUT_LIST_EACH(node, funcDecl->args)
-		{
-			TutVarDecl* varDecl = node->value;
-			if(strcmp(varDecl->name, name) == 0)
-				return varDecl;
-		}
-	}
-	
-	TUT_LIST_EACH(node, table->globals)
-	{
-		TutVarDecl* decl = node->value;
-		if(strcmp(decl->name, name) == 0)
+		TutVarDecl* decl = SymbolMapGet(&table->curFunc->vars, name, scope);
+		if(decl)
 			return decl;
 	}
 	
-	return NULL;
+	return SymbolMapGet(&table->globalMap, name, 0);
 }
 
-TutFuncDecl* Tut_GetFuncDecl(TutSymbolTable* table, const char* name)
+TutFuncDecl* Tut_GetFuncDecl(TutSymbolTable* table, TutAtom name)
 {
 	if (table->curFunc)
 	{
 		TUT_LIST_EACH(node, table->curFunc->nestedFunctions)
 		{
 			TutFuncDecl* decl = node->value;
-			if (strcmp(decl->name, name) == 0)
+			if (decl->name == name)
 				return decl;
 		}
 	}
 
-	TUT_LIST_EACH(node, table->functions)
-	{
-		TutFuncDecl* decl = node->value;
-		if (strcmp(decl->name, name) == 0)
-			return decl;
-	}
-
-	return NULL;
+	return SymbolMapGet(&table->functionMap, name, 0);
 }
 
-TutTypetag* Tut_RegisterType(TutSymbolTable* table, const char* name)
+TutTypetag* Tut_RegisterType(TutSymbolTable* table, TutAtom name)
 {
-	TUT_LIST_EACH(node, table->usertypes)
-	{
-		TutTypetag* tag = node->value;
-		assert(tag->user.name);
-		
-		if(strcmp(tag->user.name, name) == 0)
-			return tag;
-	}
+	TutTypetag* tag = Tut_GetType(table, name);
+	if (tag)
+		return tag;
 	
-	TutTypetag* tag = Tut_Malloc(sizeof(TutTypetag));
+	tag = Tut_ArenaAlloc(&table->arena, sizeof(TutTypetag));
 	
 	Tut_InitTypetag(tag, TUT_TYPETAG_USERTYPE);
-	tag->user.name = Tut_Strdup(name);
+	tag->user.name = name;
 	
-	Tut_ListAppend(&table->usertypes, tag);
+	Tut_ListAppendArena(&table->usertypes, tag, &table->arena);
+	SymbolMapBind(&table->typeMap, tag->user.name, 0, tag);
 	
 	return tag;
 }
 
+static void DestroyFuncDecls(TutList* functions)
+{
+	TUT_LIST_EACH(node, *functions)
+	{
+		TutFuncDecl* decl = node->value;
+
+		DestroySymbolMap(&decl->vars);
+		DestroyFuncDecls(&decl->nestedFunctions);
+	}
+}
+
 void Tut_DestroySymbolTable(TutSymbolTable* table)
 {
-	// TODO: Write this
+	// Only what lives outside the arena has to be freed one by one
+	DestroyFuncDecls(&table->functions);
+
+	TUT_LIST_EACH(node, table->usertypes)
+	{
+		TutTypetag* tag = node->value;
+
+		Tut_DestroyArray(&tag->user.members);
+		Tut_Free(tag->user.memberSlots);
+	}
+
+	DestroySymbolMap(&table->typeMap);
+	DestroySymbolMap(&table->functionMap);
+	DestroySymbolMap(&table->globalMap);
+
+	Tut_DestroyTypetagCache(&table->typeCache);
+	Tut_DestroyArena(&table->arena);
+
+	Tut_InitList(&table->usertypes);
+	Tut_InitList(&table->functions);
+	Tut_InitList(&table->globals);
+
+	table->curFunc = NULL;
 }
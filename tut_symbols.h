@@ -4,7 +4,35 @@
 #define TUT_VAR_DECL_INDEX_UNDEFINED -0xFFFF
 
 #include "tut_list.h"
+#include "tut_array.h"
 #include "tut_typetag.h"
+#include "tut_atom.h"
+#include "tut_arena.h"
+
+// Name -> symbol hash map where every name maps to a chain of bindings, innermost
+// first; popping a scope unbinds everything declared in it, uncovering whatever
+// it shadowed. Names are atoms so they are compared by pointer.
+typedef struct
+{
+	int32_t binding;	// -1 if the name is not bound at the moment
+	TutAtom name;		// NULL marks an empty slot
+} TutSymbolSlot;
+
+typedef struct
+{
+	TutAtom name;
+	int scope;
+	int32_t shadowed;
+	void* value;
+} TutSymbolBinding;
+
+typedef struct
+{
+	TutSymbolSlot* slots;
+	uint32_t capacity, count;
+
+	TutArray bindings;
+} TutSymbolMap;
 
 typedef enum
 {
@@ -20,11 +48,14 @@ typedef struct TutFuncDecl
 	struct TutFuncDecl* parent;
 	
 	int index;
-	char* name;
+	TutAtom name;
 
 	TutBool hasVarargs;
 	TutList locals, args;
 	TutList nestedFunctions;
+
+	// Args and locals currently in scope
+	TutSymbolMap vars;
 } TutFuncDecl;
 
 typedef struct TutVarDecl
@@ -34,13 +65,21 @@ typedef struct TutVarDecl
 	
 	TutBool outOfScope;
 	int index, scope;
-	char* name;
+	TutAtom name;
 } TutVarDecl;
 
 typedef struct
 {
+	// Owns the decls, usertype tags, list nodes and composite typetags of the
+	// modules which are parsed into this table (their ASTs belong to the modules)
+	TutArena arena;
+	TutTypetagCache typeCache;
+
 	TutList usertypes;
 	TutList functions, globals;
+
+	TutSymbolMap typeMap, functionMap, globalMap;
+
 	TutFuncDecl* curFunc;
 	int curScope;
 	
@@ -49,20 +88,20 @@ typedef struct
 
 void Tut_InitSymbolTable(TutSymbolTable* table);
 
-TutFuncDecl* Tut_DeclareFunction(TutSymbolTable* table, const char* name);
-TutFuncDecl* Tut_DeclareExtern(TutSymbolTable* table, const char* name);
-TutVarDecl* Tut_DeclareArgument(TutSymbolTable* table, const char* name, TutTypetag* typetag);
-TutVarDecl* Tut_DeclareVariable(TutSymbolTable* table, const char* name, TutTypetag* typetag);
+TutFuncDecl* Tut_DeclareFunction(TutSymbolTable* table, TutAtom name);
+TutFuncDecl* Tut_DeclareExtern(TutSymbolTable* table, TutAtom name);
+TutVarDecl* Tut_DeclareArgument(TutSymbolTable* table, TutAtom name, TutTypetag* typetag);
+TutVarDecl* Tut_DeclareVariable(TutSymbolTable* table, TutAtom name, TutTypetag* typetag);
 
 // If a usertype by the name cannot be found, an undefined version of the type
 // is created and will automatically be filled when the type is defined
-TutTypetag* Tut_RegisterType(TutSymbolTable* table, const char* name);
+TutTypetag* Tut_RegisterType(TutSymbolTable* table, TutAtom name);
 
 // If a typetag by "name" does not exist then it is created
 // otherwise, the previously declared typetag is returned
-TutTypetag* Tut_DefineType(TutSymbolTable* table, const char* name);
+TutTypetag* Tut_DefineType(TutSymbolTable* table, TutAtom name);
 
-TutTypetag* Tut_GetType(TutSymbolTable* table, const char* name);
+TutTypetag* Tut_GetType(TutSymbolTable* table, TutAtom name);
 
 void Tut_PushScope(TutSymbolTable* table);
 void Tut_PopScope(TutSymbolTable* table);
@@ -71,9 +110,11 @@ void Tut_PushCurFuncDecl(TutSymbolTable* table, TutFuncDecl* decl);
 void Tut_PopCurFuncDecl(TutSymbolTable* table);
 
 // If scope is -1, it is automatically set to the symbol table's curScope
-TutVarDecl* Tut_GetVarDecl(TutSymbolTable* table, const char* name, int scope);
-TutFuncDecl* Tut_GetFuncDecl(TutSymbolTable* table, const char* name);
+TutVarDecl* Tut_GetVarDecl(TutSymbolTable* table, TutAtom name, int scope);
+TutFuncDecl* Tut_GetFuncDecl(TutSymbolTable* table, TutAtom name);
 
+// Frees everything in the arena, so the modules parsed into the table are
+// unusable afterwards (apart from Tut_DestroyModule)
 void Tut_DestroySymbolTable(TutSymbolTable* table);
 
 #endif
@@ -0,0 +1,143 @@
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "tut_thread.h"
+#include "tut_util.h"
+
+void Tut_InitMutex(TutMutex* mutex)
+{
+#ifdef _WIN32
+	InitializeSRWLock((PSRWLOCK)&mutex->lock);
+#else
+	pthread_mutex_init(&mutex->lock, NULL);
+#endif
+}
+
+void Tut_LockMutex(TutMutex* mutex)
+{
+#ifdef _WIN32
+	AcquireSRWLockExclusive((PSRWLOCK)&mutex->lock);
+#else
+	pthread_mutex_lock(&mutex->lock);
+#endif
+}
+
+void Tut_UnlockMutex(TutMutex* mutex)
+{
+#ifdef _WIN32
+	ReleaseSRWLockExclusive((PSRWLOCK)&mutex->lock);
+#else
+	pthread_mutex_unlock(&mutex->lock);
+#endif
+}
+
+void Tut_DestroyMutex(TutMutex* mutex)
+{
+#ifndef _WIN32
+	pthread_mutex_destroy(&mutex->lock);
+#endif
+}
+
+int Tut_GetProcessorCount()
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+
+	return (int)info.dwNumberOfProcessors;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+#endif
+}
+
+typedef struct
+{
+	TutParallelFunction fn;
+	void* data;
+
+	uint32_t count;
+	volatile int32_t next;
+} ParallelJob;
+
+static void RunJobs(ParallelJob* job)
+{
+	while (TUT_TRUE)
+	{
+		int32_t index = Tut_AtomicAdd(&job->next, 1) - 1;
+		if (index >= (int32_t)job->count)
+			break;
+
+		job->fn(job->data, (uint32_t)index);
+	}
+}
+
+#ifdef _WIN32
+static DWORD WINAPI Worker(LPVOID data)
+{
+	RunJobs(data);
+	return 0;
+}
+#else
+static void* Worker(void* data)
+{
+	RunJobs(data);
+	return NULL;
+}
+#endif
+
+#define MAX_WORKERS	64
+
+void Tut_ParallelFor(uint32_t count, TutParallelFunction fn, void* data)
+{
+	ParallelJob job;
+
+	job.fn = fn;
+	job.data = data;
+	job.count = count;
+	job.next = 0;
+
+	int numWorkers = Tut_GetProcessorCount() - 1;
+
+	if (numWorkers > (int)count - 1)
+		numWorkers = (int)count - 1;
+	if (numWorkers > MAX_WORKERS)
+		numWorkers = MAX_WORKERS;
+
+#ifdef _WIN32
+	HANDLE workers[MAX_WORKERS];
+#else
+	pthread_t workers[MAX_WORKERS];
+#endif
+
+	int numStarted = 0;
+
+	for (int i = 0; i < numWorkers; ++i)
+	{
+		// If a thread can't be started the remaining jobs just run on fewer threads
+#ifdef _WIN32
+		workers[numStarted] = CreateThread(NULL, 0, Worker, &job, 0, NULL);
+		if (!workers[numStarted])
+			break;
+#else
+		if (pthread_create(&workers[numStarted], NULL, Worker, &job) != 0)
+			break;
+#endif
+		++numStarted;
+	}
+
+	RunJobs(&job);
+
+	for (int i = 0; i < numStarted; ++i)
+	{
+#ifdef _WIN32
+		WaitForSingleObject(workers[i], INFINITE);
+		CloseHandle(workers[i]);
+#else
+		pthread_join(workers[i], NULL);
+#endif
+	}
+}
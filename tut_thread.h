@@ -0,0 +1,39 @@
+#ifndef TUT_THREAD_H
+#define TUT_THREAD_H
+
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+typedef struct
+{
+#ifdef _WIN32
+	void* lock;		// SRWLOCK
+#else
+	pthread_mutex_t lock;
+#endif
+} TutMutex;
+
+// For mutexes with static storage duration
+#ifdef _WIN32
+#define TUT_MUTEX_INITIALIZER { NULL }
+#else
+#define TUT_MUTEX_INITIALIZER { PTHREAD_MUTEX_INITIALIZER }
+#endif
+
+void Tut_InitMutex(TutMutex* mutex);
+void Tut_LockMutex(TutMutex* mutex);
+void Tut_UnlockMutex(TutMutex* mutex);
+void Tut_DestroyMutex(TutMutex* mutex);
+
+int Tut_GetProcessorCount();
+
+typedef void (*TutParallelFunction)(void* data, uint32_t index);
+
+// Calls fn(data, i) for every i in [0, count) spread over up to one thread per
+// processor (the calling thread included) and returns once all calls are done
+void Tut_ParallelFor(uint32_t count, TutParallelFunction fn, void* data);
+
+#endif
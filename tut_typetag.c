@@ -1,7 +1,9 @@
 #include <string.h>
 #include <stdio.h>
+#include <assert.h>
 
 #include "tut_typetag.h"
+#include "tut_hash.h"
 
 static const char* Names[TUT_TYPETAG_COUNT] = 
 {
@@ -26,6 +28,10 @@ void Tut_InitTypetag(TutTypetag* tag, TutTypetagType type)
 		tag->user.defined = TUT_FALSE;
 		tag->user.name = NULL;
 		Tut_InitArray(&tag->user.members, sizeof(TutTypetagMember));
+
+		tag->user.size = TUT_TYPETAG_SIZE_UNKNOWN;
+		tag->user.memberSlots = NULL;
+		tag->user.memberCapacity = 0;
 	}
 	else if (tag->type == TUT_TYPETAG_REF)
 		tag->ref.value = NULL;
@@ -37,33 +43,200 @@ void Tut_InitTypetag(TutTypetag* tag, TutTypetagType type)
 	}
 }
 
-TutTypetag* Tut_CreatePrimitiveTypetag(const char* name)
+// A bare 'ref' is the unspecified reference; 'func' always needs a signature so
+// it only exists as a composite tag
+static TutTypetag Primitives[TUT_TYPETAG_FUNC] =
+{
+	{ .type = TUT_TYPETAG_VOID },
+	{ .type = TUT_TYPETAG_BOOL },
+	{ .type = TUT_TYPETAG_INT },
+	{ .type = TUT_TYPETAG_FLOAT },
+	{ .type = TUT_TYPETAG_STR },
+	{ .type = TUT_TYPETAG_CSTR },
+	{ .type = TUT_TYPETAG_REF },
+	{ .type = TUT_TYPETAG_PTR }
+};
+
+TutTypetag* Tut_GetPrimitiveTypetag(TutTypetagType type)
+{
+	assert(type < TUT_TYPETAG_FUNC);
+	return &Primitives[type];
+}
+
+TutTypetag* Tut_FindPrimitiveTypetag(const char* name)
 {
-	for(int i = 0; i < TUT_TYPETAG_USERTYPE; ++i)
+	for(int i = 0; i < TUT_TYPETAG_FUNC; ++i)
 	{
 		if(strcmp(name, Names[i]) == 0)
-		{
-			TutTypetag* tag = Tut_Malloc(sizeof(TutTypetag));
-			Tut_InitTypetag(tag, (TutTypetagType)i);
-			return tag;
-		}
+			return &Primitives[i];
 	}
 	
 	return NULL;
 }
 
-int Tut_GetTypetagSize(TutTypetag* tag)
+void Tut_InitTypetagCache(TutTypetagCache* cache, TutArena* arena)
 {
-	if (tag->type == TUT_TYPETAG_USERTYPE)
+	Tut_InitMutex(&cache->lock);
+
+	cache->arena = arena;
+	cache->slots = NULL;
+	cache->capacity = 0;
+	cache->count = 0;
+}
+
+void Tut_DestroyTypetagCache(TutTypetagCache* cache)
+{
+	// The tags themselves live in the arena
+	Tut_Free(cache->slots);
+	Tut_DestroyMutex(&cache->lock);
+
+	cache->slots = NULL;
+	cache->capacity = 0;
+	cache->count = 0;
+}
+
+static void GrowTypetagCache(TutTypetagCache* cache)
+{
+	uint32_t capacity = cache->capacity ? cache->capacity * 2 : 64;
+	TutTypetagSlot* slots = Tut_Calloc(capacity, sizeof(TutTypetagSlot));
+
+	for (uint32_t i = 0; i < cache->capacity; ++i)
 	{
-		int totalSize = 0;
-		for (size_t i = 0; i < tag->user.members.length; ++i)
+		TutTypetagSlot* slot = &cache->slots[i];
+		if (!slot->hash) continue;
+
+		uint32_t pos = slot->hash & (capacity - 1);
+		while (slots[pos].hash)
+			pos = (pos + 1) & (capacity - 1);
+
+		slots[pos] = *slot;
+	}
+
+	Tut_Free(cache->slots);
+
+	cache->slots = slots;
+	cache->capacity = capacity;
+}
+
+static uint32_t HashPointer(const void* ptr)
+{
+	return Tut_HashBytes(&ptr, sizeof(ptr));
+}
+
+static TutBool FuncEquals(const TutTypetag* tag, const TutTypetag* ret, TutTypetag* const* args, uint32_t numArgs, TutBool hasVarargs)
+{
+	if (tag->func.ret != ret || tag->func.hasVarargs != hasVarargs || tag->func.args.length != numArgs)
+		return TUT_FALSE;
+
+	uint32_t i = 0;
+	TUT_LIST_EACH(node, tag->func.args)
+	{
+		if (node->value != args[i++])
+			return TUT_FALSE;
+	}
+
+	return TUT_TRUE;
+}
+
+// Returns the slot holding the matching tag, or the empty slot it should go into
+static TutTypetagSlot* FindTypetagSlot(TutTypetagCache* cache, uint32_t hash, TutTypetagType type, const TutTypetag* ret, TutTypetag* const* args, uint32_t numArgs, TutBool hasVarargs)
+{
+	// Keep the load factor under 3/4
+	if ((cache->count + 1) * 4 > cache->capacity * 3)
+		GrowTypetagCache(cache);
+
+	uint32_t pos = hash & (cache->capacity - 1);
+
+	while (cache->slots[pos].hash)
+	{
+		TutTypetagSlot* slot = &cache->slots[pos];
+
+		if (slot->hash == hash && slot->tag->type == type)
 		{
-			TutTypetagMember* mem = Tut_ArrayGet(&tag->user.members, i);
-			totalSize += Tut_GetTypetagSize(mem->typetag);
+			if (type == TUT_TYPETAG_REF && slot->tag->ref.value == ret)
+				return slot;
+			if (type == TUT_TYPETAG_FUNC && FuncEquals(slot->tag, ret, args, numArgs, hasVarargs))
+				return slot;
 		}
 
-		return totalSize;
+		pos = (pos + 1) & (cache->capacity - 1);
+	}
+
+	return &cache->slots[pos];
+}
+
+TutTypetag* Tut_GetRefTypetag(TutTypetagCache* cache, TutTypetag* value)
+{
+	if (!value)
+		return &Primitives[TUT_TYPETAG_REF];
+
+	uint32_t hash = HashPointer(value);
+
+	Tut_LockMutex(&cache->lock);
+
+	TutTypetagSlot* slot = FindTypetagSlot(cache, hash, TUT_TYPETAG_REF, value, NULL, 0, TUT_FALSE);
+
+	if (!slot->hash)
+	{
+		TutTypetag* tag = Tut_ArenaAlloc(cache->arena, sizeof(TutTypetag));
+		Tut_InitTypetag(tag, TUT_TYPETAG_REF);
+		tag->ref.value = value;
+
+		slot->hash = hash;
+		slot->tag = tag;
+		cache->count += 1;
+	}
+
+	TutTypetag* tag = slot->tag;
+
+	Tut_UnlockMutex(&cache->lock);
+
+	return tag;
+}
+
+TutTypetag* Tut_GetFuncTypetag(TutTypetagCache* cache, TutTypetag* ret, TutTypetag* const* args, uint32_t numArgs, TutBool hasVarargs)
+{
+	assert(ret);
+
+	uint32_t hash = HashPointer(ret) ^ Tut_HashUint32(numArgs * 2 + (hasVarargs ? 1 : 0));
+	if (numArgs)
+		hash ^= Tut_HashBytes(args, numArgs * sizeof(TutTypetag*));
+	if (!hash)
+		hash = 1;
+
+	Tut_LockMutex(&cache->lock);
+
+	TutTypetagSlot* slot = FindTypetagSlot(cache, hash, TUT_TYPETAG_FUNC, ret, args, numArgs, hasVarargs);
+
+	if (!slot->hash)
+	{
+		TutTypetag* tag = Tut_ArenaAlloc(cache->arena, sizeof(TutTypetag));
+		Tut_InitTypetag(tag, TUT_TYPETAG_FUNC);
+
+		tag->func.ret = ret;
+		tag->func.hasVarargs = hasVarargs;
+
+		for (uint32_t i = 0; i < numArgs; ++i)
+			Tut_ListAppendArena(&tag->func.args, args[i], cache->arena);
+
+		slot->hash = hash;
+		slot->tag = tag;
+		cache->count += 1;
+	}
+
+	TutTypetag* tag = slot->tag;
+
+	Tut_UnlockMutex(&cache->lock);
+
+	return tag;
+}
+
+int Tut_GetTypetagSize(const TutTypetag* tag)
+{
+	if (tag->type == TUT_TYPETAG_USERTYPE)
+	{
+		assert(tag->user.size >= 0);
+		return tag->user.size;
 	}
 	else if (tag->type == TUT_TYPETAG_VOID)
 		return 0;
@@ -71,14 +244,80 @@ int Tut_GetTypetagSize(TutTypetag* tag)
 	return 1;
 }
 
+void Tut_FreezeTypetagLayout(TutTypetag* tag)
+{
+	assert(tag->type == TUT_TYPETAG_USERTYPE);
+	assert(!tag->user.memberSlots);
+
+	int totalSize = 0;
+
+	for (size_t i = 0; i < tag->user.members.length; ++i)
+	{
+		TutTypetagMember* mem = Tut_ArrayGet(&tag->user.members, i);
+
+		mem->offset = totalSize;
+		totalSize += Tut_GetTypetagSize(mem->typetag);
+	}
+
+	tag->user.size = totalSize;
+
+	// At most half full
+	uint32_t capacity = 8;
+	while (capacity < tag->user.members.length * 2)
+		capacity *= 2;
+
+	tag->user.memberSlots = Tut_Calloc(capacity, sizeof(uint32_t));
+	tag->user.memberCapacity = capacity;
+
+	for (uint32_t i = 0; i < tag->user.members.length; ++i)
+	{
+		TutTypetagMember* mem = Tut_ArrayGet(&tag->user.members, i);
+		uint32_t pos = Tut_AtomHash(mem->name) & (capacity - 1);
+
+		while (tag->user.memberSlots[pos])
+		{
+			// Keep the first of any duplicate names
+			if (TUT_ARRAY_GET_VALUE(&tag->user.members, tag->user.memberSlots[pos] - 1, TutTypetagMember).name == mem->name)
+				break;
+
+			pos = (pos + 1) & (capacity - 1);
+		}
+
+		if (!tag->user.memberSlots[pos])
+			tag->user.memberSlots[pos] = i + 1;
+	}
+}
+
+TutTypetagMember* Tut_GetTypetagMember(const TutTypetag* tag, TutAtom name)
+{
+	assert(tag->type == TUT_TYPETAG_USERTYPE);
+	assert(tag->user.memberSlots);
+
+	uint32_t mask = tag->user.memberCapacity - 1;
+	uint32_t pos = Tut_AtomHash(name) & mask;
+
+	while (tag->user.memberSlots[pos])
+	{
+		TutTypetagMember* mem = (TutTypetagMember*)tag->user.members.data + (tag->user.memberSlots[pos] - 1);
+		if (mem->name == name)
+			return mem;
+
+		pos = (pos + 1) & mask;
+	}
+
+	return NULL;
+}
+
 TutBool Tut_CompareTypes(const TutTypetag* a, const TutTypetag* b)
 {
+	// Primitives are singletons and composites are hash-consed so this is the common case
+	if(a == b) return TUT_TRUE;
 	if(a->type != b->type) return TUT_FALSE;
 	
 	if(a->type == TUT_TYPETAG_USERTYPE)
 	{
 		if(a->user.name && b->user.name)
-			return strcmp(a->user.name, b->user.name) == 0;
+			return a->user.name == b->user.name;
 		return TUT_FALSE;
 	}
 	else if (a->type == TUT_TYPETAG_REF)
@@ -201,23 +440,3 @@ const char* Tut_TypetagRepr(const TutTypetag* tag)
 			return Names[(int)tag->type];
 	}
 }
-
-void Tut_DeleteTypetag(TutTypetag* tag)
-{
-	if (tag->type == TUT_TYPETAG_USERTYPE)
-	{
-		if (tag->user.name) Tut_Free(tag->user.name);
-
-		for (size_t i = 0; i < tag->user.members.length; ++i)
-		{
-			TutTypetagMember* mem = Tut_ArrayGet(&tag->user.members, i);
-
-			Tut_Free(mem->name);
-			Tut_DeleteTypetag(mem->typetag);
-		}
-		Tut_DestroyArray(&tag->user.members);
-	}
-	else if (tag->type == TUT_TYPETAG_REF && tag->ref.value)
-		Tut_DeleteTypetag(tag->ref.value);
-	Tut_Free(tag);
-}
@@ -4,6 +4,12 @@
 #include "tut_list.h"
 #include "tut_util.h"
 #include "tut_array.h"
+#include "tut_atom.h"
+#include "tut_arena.h"
+#include "tut_thread.h"
+
+#define TUT_TYPETAG_SIZE_UNKNOWN	-1
+#define TUT_TYPETAG_SIZE_PENDING	-2
 
 typedef enum
 {
@@ -24,7 +30,7 @@ struct TutTypetag;
 
 typedef struct
 {
-	char* name;
+	TutAtom name;
 	int offset;
 	struct TutTypetag* typetag;
 } TutTypetagMember;
@@ -38,8 +44,14 @@ typedef struct TutTypetag
 		struct
 		{
 			TutBool defined;
-			char* name;
+			TutAtom name;
 			TutArray members;
+
+			// Frozen by Tut_FreezeTypetagLayout; until then size is TUT_TYPETAG_SIZE_UNKNOWN
+			int size;
+			// Open addressed member name -> index + 1 (0 is empty)
+			uint32_t* memberSlots;
+			uint32_t memberCapacity;
 		} user;
 
 		struct
@@ -56,16 +68,50 @@ typedef struct TutTypetag
 	};
 } TutTypetag;
 
+typedef struct
+{
+	uint32_t hash;		// 0 marks an empty slot
+	TutTypetag* tag;
+} TutTypetagSlot;
+
+// Hash-consed ref-x and func(...)-x tags; structurally equal composite types
+// share one tag, so they can be compared by pointer. Modules are typechecked in
+// parallel so lookups are serialized.
+typedef struct
+{
+	TutMutex lock;
+	TutArena* arena;
+
+	TutTypetagSlot* slots;
+	uint32_t capacity, count;
+} TutTypetagCache;
+
 void Tut_InitTypetag(TutTypetag* tag, TutTypetagType type);
-TutTypetag* Tut_CreatePrimitiveTypetag(const char* name);
 
-int Tut_GetTypetagSize(TutTypetag* tag);
+// Primitive tags are immortal singletons and must never be modified
+TutTypetag* Tut_GetPrimitiveTypetag(TutTypetagType type);
+// Returns NULL if name is not a primitive type
+TutTypetag* Tut_FindPrimitiveTypetag(const char* name);
+
+// Composite tags are allocated from the cache's arena
+void Tut_InitTypetagCache(TutTypetagCache* cache, TutArena* arena);
+void Tut_DestroyTypetagCache(TutTypetagCache* cache);
+
+// value can be NULL for an unspecified reference
+TutTypetag* Tut_GetRefTypetag(TutTypetagCache* cache, TutTypetag* value);
+TutTypetag* Tut_GetFuncTypetag(TutTypetagCache* cache, TutTypetag* ret, TutTypetag* const* args, uint32_t numArgs, TutBool hasVarargs);
+
+// Usertype sizes are only valid once their layout has been frozen
+int Tut_GetTypetagSize(const TutTypetag* tag);
+
+// Assigns member offsets and builds the member index; the layouts of any usertype
+// members must have been frozen already
+void Tut_FreezeTypetagLayout(TutTypetag* tag);
+TutTypetagMember* Tut_GetTypetagMember(const TutTypetag* tag, TutAtom name);
 
 TutBool Tut_CompareTypes(const TutTypetag* a, const TutTypetag* b);
 TutBool Tut_CanAssignTypes(const TutTypetag* from, const TutTypetag* to);
 
 const char* Tut_TypetagRepr(const TutTypetag* tag);
 
-void Tut_DeleteTypetag(TutTypetag* tag);
-
 #endif
@@ -3,6 +3,15 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #include "tut_util.h"
 
 void Tut_ErrorExit(const char* fmt, ...)
@@ -47,6 +56,134 @@ void Tut_Free(void* ptr)
 	free(ptr);
 }
 
+void* Tut_AllocPages(size_t size)
+{
+#ifdef _WIN32
+	void* mem = VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if(!mem)
+		Tut_ErrorExit("Out of memory!\n");
+#else
+	void* mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(mem == MAP_FAILED)
+		Tut_ErrorExit("Out of memory!\n");
+#endif
+	return mem;
+}
+
+void Tut_ProtectPages(void* mem, size_t size, TutBool readOnly)
+{
+#ifdef _WIN32
+	DWORD old;
+	VirtualProtect(mem, size, readOnly ? PAGE_READONLY : PAGE_READWRITE, &old);
+#else
+	mprotect(mem, size, readOnly ? PROT_READ : (PROT_READ | PROT_WRITE));
+#endif
+}
+
+void Tut_FreePages(void* mem, size_t size)
+{
+	if(!mem) return;
+
+#ifdef _WIN32
+	VirtualFree(mem, 0, MEM_RELEASE);
+#else
+	munmap(mem, size);
+#endif
+}
+
+void* Tut_ReservePages(size_t size)
+{
+#ifdef _WIN32
+	void* mem = VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+	if(!mem)
+		Tut_ErrorExit("Out of memory!\n");
+#else
+	void* mem = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if(mem == MAP_FAILED)
+		Tut_ErrorExit("Out of memory!\n");
+#endif
+	return mem;
+}
+
+TutBool Tut_CommitPages(void* mem, size_t size)
+{
+#ifdef _WIN32
+	return VirtualAlloc(mem, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+#else
+	return mprotect(mem, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+void* Tut_MapFile(const char* filename, size_t* size)
+{
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+		return NULL;
+
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		CloseHandle(file);
+		return NULL;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+
+	if(!mapping)
+		return NULL;
+
+	void* mem = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+
+	if(!mem)
+		return NULL;
+
+	*size = (size_t)fileSize.QuadPart;
+#else
+	int fd = open(filename, O_RDONLY);
+	if(fd < 0)
+		return NULL;
+
+	struct stat st;
+	if(fstat(fd, &st) != 0 || st.st_size == 0)
+	{
+		close(fd);
+		return NULL;
+	}
+
+	void* mem = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(mem == MAP_FAILED)
+		return NULL;
+
+	*size = (size_t)st.st_size;
+#endif
+	return mem;
+}
+
+void Tut_UnmapFile(void* mem, size_t size)
+{
+	if(!mem) return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(mem);
+#else
+	munmap(mem, size);
+#endif
+}
+
+int32_t Tut_AtomicAdd(volatile int32_t* value, int32_t amount)
+{
+#ifdef _WIN32
+	return InterlockedAdd((volatile LONG*)value, amount);
+#else
+	return __sync_add_and_fetch(value, amount);
+#endif
+}
+
 char* Tut_Strdup(const char* string)
 {
 	size_t length = strlen(string);
@@ -22,6 +22,26 @@ void* Tut_Calloc(size_t num, size_t size);
 void* Tut_Realloc(void* mem, size_t newSize);
 
 void Tut_Free(void* ptr);
+
+// Page granular memory straight from the OS; size is rounded up to whole pages
+void* Tut_AllocPages(size_t size);
+void Tut_ProtectPages(void* mem, size_t size, TutBool readOnly);
+void Tut_FreePages(void* mem, size_t size);
+// Only reserves address space (free with Tut_FreePages); nothing in it can be
+// accessed before it is committed
+void* Tut_ReservePages(size_t size);
+// Makes the first size bytes of reserved memory readable and writable; returns
+// TUT_FALSE if the system is out of memory
+TutBool Tut_CommitPages(void* mem, size_t size);
+
+// Maps a whole file read-only into memory; returns NULL if it cannot be opened
+// (or is empty), otherwise *size is set to the size of the file
+void* Tut_MapFile(const char* filename, size_t* size);
+void Tut_UnmapFile(void* mem, size_t size);
+
+// Atomically adds amount to *value and returns the new value
+int32_t Tut_AtomicAdd(volatile int32_t* value, int32_t amount);
+
 char* Tut_Strdup(const char* string);
 int Tut_Strncmp(const char* a, const char* b, uint32_t length);
 
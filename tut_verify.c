@@ -0,0 +1,474 @@
+#include <string.h>
+#include <assert.h>
+
+#include "tut_verify.h"
+#include "tut_opcodes.h"
+#include "tut_codegen.h"
+#include "tut_buf.h"
+
+// Number of objects the instruction at pc pops and pushes; register ops, which
+// only touch locals, do neither
+static void GetStackEffect(const uint8_t* code, int32_t pc, int* pops, int* pushes)
+{
+	*pops = 0;
+	*pushes = 0;
+
+	switch (code[pc])
+	{
+		case TUT_OP_PUSH_TRUE:
+		case TUT_OP_PUSH_FALSE:
+		case TUT_OP_PUSH_INT:
+		case TUT_OP_PUSH_FLOAT:
+		case TUT_OP_PUSH_I8:
+		case TUT_OP_PUSH_I32:
+		case TUT_OP_PUSH_F32:
+		case TUT_OP_PUSH_STR:
+		case TUT_OP_PUSH_NULL:
+		case TUT_OP_MAKEGLOBALREF:
+		case TUT_OP_MAKELOCALREF:
+		case TUT_OP_MAKEFUNC:
+		case TUT_OP_MAKEEXTERNFUNC:
+		case TUT_OP_PUSH1:
+		case TUT_OP_GETGLOBAL1:
+		case TUT_OP_GETLOCAL1:
+		case TUT_OP_GETFIELD_L:
+			*pushes = 1;
+			break;
+
+		case TUT_OP_PUSHN:
+		case TUT_OP_GETGLOBALN:
+		case TUT_OP_GETLOCALN:
+			*pushes = Tut_ReadUint16(code, pc + 1);
+			break;
+
+		case TUT_OP_POPN:
+		case TUT_OP_SETGLOBALN:
+		case TUT_OP_SETLOCALN:
+		case TUT_OP_RETVALN:
+			*pops = Tut_ReadUint16(code, pc + 1);
+			break;
+
+		case TUT_OP_POP1:
+		case TUT_OP_SETGLOBAL1:
+		case TUT_OP_SETLOCAL1:
+		case TUT_OP_RETVAL1:
+		case TUT_OP_GOTOFALSE:
+		case TUT_OP_GOTOTRUE:
+			*pops = 1;
+			break;
+
+		case TUT_OP_MAKEDYNAMICREF:
+		case TUT_OP_GETREF1:
+		case TUT_OP_LNOT:
+		case TUT_OP_INEG:
+		case TUT_OP_FNEG:
+			*pops = 1;
+			*pushes = 1;
+			break;
+
+		// n objects are moved down m spaces
+		case TUT_OP_MOVEN:
+			*pushes = Tut_ReadUint16(code, pc + 1);
+			*pops = *pushes + Tut_ReadUint16(code, pc + 3);
+			break;
+
+		case TUT_OP_MOVE1:
+			*pushes = 1;
+			*pops = 1 + Tut_ReadUint16(code, pc + 1);
+			break;
+
+		// The ref is popped first
+		case TUT_OP_GETREFN:
+			*pops = 1;
+			*pushes = Tut_ReadUint16(code, pc + 1);
+			break;
+
+		case TUT_OP_SETREFN:
+			*pops = 1 + Tut_ReadUint16(code, pc + 1);
+			break;
+
+		case TUT_OP_SETREF1:
+			*pops = 2;
+			break;
+
+		case TUT_OP_ADDI: case TUT_OP_SUBI: case TUT_OP_MULI: case TUT_OP_DIVI:
+		case TUT_OP_ADDF: case TUT_OP_SUBF: case TUT_OP_MULF: case TUT_OP_DIVF:
+		case TUT_OP_LAND: case TUT_OP_LOR:
+		case TUT_OP_ILT: case TUT_OP_IGT: case TUT_OP_ILTE: case TUT_OP_IGTE: case TUT_OP_IEQ: case TUT_OP_INE:
+		case TUT_OP_FLT: case TUT_OP_FGT: case TUT_OP_FLTE: case TUT_OP_FGTE: case TUT_OP_FEQ: case TUT_OP_FNE:
+		case TUT_OP_BEQ: case TUT_OP_SEQ: case TUT_OP_REQ:
+			*pops = 2;
+			*pushes = 1;
+			break;
+
+		// Arguments and the function object go, the return values come back
+		case TUT_OP_CALL:
+			*pops = Tut_ReadUint16(code, pc + 1) + 1;
+			*pushes = Tut_ReadUint16(code, pc + 3);
+			break;
+	}
+}
+
+static TutBool EndsFunction(uint8_t op)
+{
+	return op == TUT_OP_RET || op == TUT_OP_RETVALN || op == TUT_OP_RETVAL1 || op == TUT_OP_HALT;
+}
+
+// Checks the operands which index into the program
+static TutBool CheckOperands(const TutProgram* program, const uint8_t* code, int32_t pc, int32_t depth)
+{
+	switch (code[pc])
+	{
+		case TUT_OP_PUSH_INT: return Tut_ReadInt32(code, pc + 1) >= 0 && Tut_ReadInt32(code, pc + 1) < (int32_t)program->integers.length;
+		case TUT_OP_PUSH_FLOAT: return Tut_ReadInt32(code, pc + 1) >= 0 && Tut_ReadInt32(code, pc + 1) < (int32_t)program->floats.length;
+		case TUT_OP_PUSH_STR: return Tut_ReadInt32(code, pc + 1) >= 0 && Tut_ReadInt32(code, pc + 1) < (int32_t)program->strings.length;
+		case TUT_OP_MAKEFUNC:
+		{
+			int32_t index = Tut_ReadInt32(code, pc + 1);
+			return index >= 0 && index < (int32_t)program->functionPcs.length &&
+				TUT_ARRAY_GET_CONST_VALUE(&program->functionPcs, index, int32_t) >= 0;
+		}
+
+		case TUT_OP_MAKEEXTERNFUNC: return Tut_ReadInt32(code, pc + 1) >= 0 && Tut_ReadInt32(code, pc + 1) < (int32_t)program->externNames.length;
+
+		case TUT_OP_MAKEGLOBALREF:
+		case TUT_OP_GETGLOBAL1:
+		case TUT_OP_SETGLOBAL1:
+			return Tut_ReadInt32(code, pc + 1) >= 0 && Tut_ReadInt32(code, pc + 1) < program->numGlobals;
+
+		case TUT_OP_GETGLOBALN:
+		case TUT_OP_SETGLOBALN:
+		{
+			int32_t index = Tut_ReadInt32(code, pc + 3);
+			return index >= 0 && index + Tut_ReadUint16(code, pc + 1) <= program->numGlobals;
+		}
+
+		case TUT_OP_TAG:
+		{
+			uint16_t tagDepth = Tut_ReadUint16(code, pc + 1);
+			return tagDepth >= 1 && tagDepth <= depth;
+		}
+	}
+
+	return TUT_TRUE;
+}
+
+// Stores the local indices the instruction at pc uses in locals and returns how many
+// there are; span is the number of slots used starting at each
+static int GetLocals(const uint8_t* code, int32_t pc, int32_t* locals, int32_t* span)
+{
+	*span = 1;
+
+	switch (code[pc])
+	{
+		case TUT_OP_GETLOCALN:
+		case TUT_OP_SETLOCALN:
+			*span = Tut_ReadUint16(code, pc + 1);
+			locals[0] = Tut_ReadInt32(code, pc + 3);
+			return 1;
+
+		case TUT_OP_GETLOCAL1:
+		case TUT_OP_SETLOCAL1:
+		case TUT_OP_MAKELOCALREF:
+			locals[0] = Tut_ReadInt32(code, pc + 1);
+			return 1;
+
+		case TUT_OP_ADDI_LLL: case TUT_OP_SUBI_LLL: case TUT_OP_MULI_LLL: case TUT_OP_DIVI_LLL:
+		case TUT_OP_ADDF_LLL: case TUT_OP_SUBF_LLL: case TUT_OP_MULF_LLL: case TUT_OP_DIVF_LLL:
+			locals[0] = Tut_ReadInt16(code, pc + 1);
+			locals[1] = Tut_ReadInt16(code, pc + 3);
+			locals[2] = Tut_ReadInt16(code, pc + 5);
+			return 3;
+
+		case TUT_OP_ADDI_LLK: case TUT_OP_SUBI_LLK: case TUT_OP_MULI_LLK: case TUT_OP_DIVI_LLK:
+		case TUT_OP_ADDF_LLK: case TUT_OP_SUBF_LLK: case TUT_OP_MULF_LLK: case TUT_OP_DIVF_LLK:
+		case TUT_OP_ILT_LL_JF: case TUT_OP_ILTE_LL_JF: case TUT_OP_IEQ_LL_JF: case TUT_OP_INE_LL_JF:
+			locals[0] = Tut_ReadInt16(code, pc + 1);
+			locals[1] = Tut_ReadInt16(code, pc + 3);
+			return 2;
+
+		case TUT_OP_ILT_LK_JF: case TUT_OP_ILTE_LK_JF: case TUT_OP_IGT_LK_JF:
+		case TUT_OP_IGTE_LK_JF: case TUT_OP_IEQ_LK_JF: case TUT_OP_INE_LK_JF:
+		case TUT_OP_INCLOCAL:
+		case TUT_OP_GETFIELD_L:
+			locals[0] = Tut_ReadInt16(code, pc + 1);
+			return 1;
+	}
+
+	return 0;
+}
+
+static int32_t GetReturnCount(const uint8_t* code, int32_t pc)
+{
+	switch (code[pc])
+	{
+		case TUT_OP_RETVALN: return Tut_ReadUint16(code, pc + 1);
+		case TUT_OP_RETVAL1: return 1;
+		case TUT_OP_RET: return 0;
+	}
+
+	return -1;
+}
+
+typedef struct
+{
+	int32_t pc, depth;
+} Branch;
+
+typedef struct
+{
+	const TutProgram* program;
+
+	// Set for every pc an instruction starts at
+	TutBool* starts;
+
+	// Depth each pc was first reached with from the entry being walked; only
+	// valid where visited holds that entry's stamp
+	int32_t* depths;
+	int32_t* visited;
+
+	TutArray branches;
+} Verifier;
+
+static TutBool IsInstruction(const Verifier* v, int32_t pc)
+{
+	return pc >= 0 && pc < (int32_t)v->program->codeSize && v->starts[pc];
+}
+
+// Walks every path from entry and checks that each instruction is reached with
+// the same depth, pops only what is on the stack and is followed by another
+// instruction. Values pushed by an instruction are counted before the ones it
+// pops are gone, which also covers what externs push on top of their arguments.
+// Locals have to be below the max depth and every return has to leave the same
+// number of objects; what calls have to agree with ends up in arity.
+// Returns -1 if the code is invalid, otherwise the max depth.
+static int32_t VerifyFunction(Verifier* v, int32_t entry, int32_t stamp, TutFunctionArity* arity)
+{
+	const uint8_t* code = v->program->code;
+	int32_t maxDepth = 0;
+
+	int32_t minLocal = 0, maxLocalEnd = 0;
+
+	arity->numArgs = 0;
+	arity->numReturns = -1;
+
+	if (!IsInstruction(v, entry))
+		return -1;
+
+	Branch branch;
+
+	branch.pc = entry;
+	branch.depth = 0;
+
+	Tut_ArrayClear(&v->branches);
+	Tut_ArrayPush(&v->branches, &branch);
+
+	while (v->branches.length > 0)
+	{
+		Tut_ArrayPop(&v->branches, &branch);
+
+		int32_t pc = branch.pc;
+		int32_t depth = branch.depth;
+
+		while (TUT_TRUE)
+		{
+			// Running off the end or into the middle of an instruction
+			if (!IsInstruction(v, pc))
+				return -1;
+
+			if (v->visited[pc] == stamp)
+			{
+				if (v->depths[pc] != depth)
+					return -1;
+				break;
+			}
+
+			v->visited[pc] = stamp;
+			v->depths[pc] = depth;
+
+			uint8_t op = code[pc];
+
+			int pops, pushes;
+			GetStackEffect(code, pc, &pops, &pushes);
+
+			if (pops > depth || !CheckOperands(v->program, code, pc, depth))
+				return -1;
+
+			if (depth + pushes > maxDepth)
+				maxDepth = depth + pushes;
+
+			int32_t locals[3], span;
+			int numLocals = GetLocals(code, pc, locals, &span);
+
+			for (int i = 0; i < numLocals; ++i)
+			{
+				if (locals[i] < minLocal)
+					minLocal = locals[i];
+				if (locals[i] + span > maxLocalEnd)
+					maxLocalEnd = locals[i] + span;
+			}
+
+			depth += pushes - pops;
+
+			if (EndsFunction(op))
+			{
+				int32_t numReturns = GetReturnCount(code, pc);
+
+				if (numReturns >= 0)
+				{
+					if (arity->numReturns >= 0 && arity->numReturns != numReturns)
+						return -1;
+					arity->numReturns = numReturns;
+				}
+				break;
+			}
+
+			int targetOffset = Tut_GetJumpTargetOffset(op);
+
+			if (targetOffset)
+			{
+				int32_t target = Tut_ReadInt32(code, pc + targetOffset);
+
+				if (op == TUT_OP_GOTO)
+				{
+					pc = target;
+					continue;
+				}
+
+				Branch taken;
+
+				taken.pc = target;
+				taken.depth = depth;
+
+				Tut_ArrayPush(&v->branches, &taken);
+			}
+
+			pc += Tut_GetOpcodeSize(op);
+		}
+	}
+
+	// Arguments are below the frame pointer, anything else a function uses it
+	// pushes first
+	if (maxLocalEnd > maxDepth)
+		return -1;
+
+	arity->numArgs = -minLocal;
+
+	return maxDepth;
+}
+
+// Checks calls of functions which are made right where the function object is
+// made against the function's arity; the rest is up to CALL
+static TutBool VerifyCalls(Verifier* v)
+{
+	const TutProgram* program = v->program;
+	const uint8_t* code = program->code;
+
+	for (int32_t pc = 0; pc < (int32_t)program->codeSize; pc += Tut_GetOpcodeSize(code[pc]))
+	{
+		int32_t callPc = pc + Tut_GetOpcodeSize(TUT_OP_MAKEFUNC);
+
+		if (!v->visited[pc] || code[pc] != TUT_OP_MAKEFUNC || !IsInstruction(v, callPc) || code[callPc] != TUT_OP_CALL)
+			continue;
+
+		const TutFunctionArity* arity = Tut_ArrayGetConst(&program->functionArities, Tut_ReadInt32(code, pc + 1));
+
+		int32_t nargs = Tut_ReadUint16(code, callPc + 1);
+		int32_t nret = Tut_ReadUint16(code, callPc + 3);
+
+		if (nargs < arity->numArgs || (arity->numReturns >= 0 && nret != arity->numReturns))
+			return TUT_FALSE;
+	}
+
+	return TUT_TRUE;
+}
+
+// Marks where instructions start; returns FALSE if there is an invalid opcode or
+// the last instruction is cut off
+static TutBool FindInstructions(Verifier* v)
+{
+	const TutProgram* program = v->program;
+	int32_t pc = 0;
+
+	while (pc < (int32_t)program->codeSize)
+	{
+		uint8_t op = program->code[pc];
+
+		if (op >= TUT_OP_COUNT)
+			return TUT_FALSE;
+
+		v->starts[pc] = TUT_TRUE;
+		pc += Tut_GetOpcodeSize(op);
+	}
+
+	return pc == (int32_t)program->codeSize;
+}
+
+// Checks depth against what an image says it is or stores it for a compiled program
+static TutBool RecordDepth(TutProgram* program, int32_t* stored, int32_t depth)
+{
+	if (depth < 0)
+		return TUT_FALSE;
+
+	if (program->image)
+		return depth <= *stored;
+
+	*stored = depth;
+	return TUT_TRUE;
+}
+
+TutBool Tut_VerifyProgram(TutProgram* program)
+{
+	Verifier v;
+
+	v.program = program;
+	v.starts = Tut_Calloc(program->codeSize + 1, sizeof(TutBool));
+	v.depths = Tut_Malloc((program->codeSize + 1) * sizeof(int32_t));
+	v.visited = Tut_Calloc(program->codeSize + 1, sizeof(int32_t));
+
+	Tut_InitArray(&v.branches, sizeof(Branch));
+
+	TutBool valid = program->functionStackDepths.length == program->functionPcs.length || !program->image;
+
+	// The code at pc 0 isn't called, so it has no arguments and its returns halt
+	TutFunctionArity arity;
+
+	valid = valid && FindInstructions(&v) &&
+		RecordDepth(program, &program->entryStackDepth, VerifyFunction(&v, 0, 1, &arity)) &&
+		arity.numArgs == 0;
+
+	if (!program->image)
+	{
+		int32_t zero = 0;
+
+		Tut_ArrayClear(&program->functionStackDepths);
+		Tut_ArrayResize(&program->functionStackDepths, program->functionPcs.length, &zero);
+	}
+
+	// Functions which aren't defined can't be called
+	arity.numArgs = UINT16_MAX + 1;
+	arity.numReturns = -1;
+
+	Tut_ArrayClear(&program->functionArities);
+	Tut_ArrayResize(&program->functionArities, program->functionPcs.length, &arity);
+
+	for (uint32_t i = 0; valid && i < program->functionPcs.length; ++i)
+	{
+		int32_t pc = TUT_ARRAY_GET_VALUE(&program->functionPcs, i, int32_t);
+		if (pc < 0)
+			continue;
+
+		int32_t* stored = Tut_ArrayGet(&program->functionStackDepths, i);
+		valid = RecordDepth(program, stored, VerifyFunction(&v, pc, (int32_t)i + 2, Tut_ArrayGet(&program->functionArities, i)));
+	}
+
+	valid = valid && VerifyCalls(&v);
+
+	Tut_DestroyArray(&v.branches);
+
+	Tut_Free(v.visited);
+	Tut_Free(v.depths);
+	Tut_Free(v.starts);
+
+	return valid;
+}
@@ -0,0 +1,18 @@
+#ifndef TUT_VERIFY_H
+#define TUT_VERIFY_H
+
+#include "tut_program.h"
+
+// Checks that the code can be run without the stack checks the vm leaves out:
+// every path through a function (and through the code at pc 0) has to stay on
+// instruction boundaries, reach each instruction with the same stack depth, never
+// pop more than it pushed above the frame pointer and end in a return or halt.
+// Constant, global and function indices are range checked as well.
+// Along the way the most stack slots each function uses above its frame pointer
+// (locals and values returned by calls included) are stored in
+// functionStackDepths and entryStackDepth; CALL commits that much up front. For
+// images, which come with their depths, those are checked instead. Has to be done
+// once all code is emitted and linked. Returns FALSE if the code is invalid.
+TutBool Tut_VerifyProgram(TutProgram* program);
+
+#endif
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdarg.h>
 #include <string.h>
 #include <assert.h>
 
@@ -7,31 +8,64 @@
 #include "tut_buf.h"
 #include "tut_opcodes.h"
 
-void Tut_InitVM(TutVM* vm)
+void Tut_InitVM(TutVM* vm, TutProgram* program)
 {
-	Tut_InitArray(&vm->integers, sizeof(int32_t));
-	Tut_InitArray(&vm->floats, sizeof(float));
-	Tut_InitArray(&vm->strings, sizeof(const char*));
-	Tut_InitArray(&vm->functionPcs, sizeof(int32_t));
+	Tut_InitVMWithStackSize(vm, program, TUT_VM_DEFAULT_MAX_STACK_SIZE);
+}
 
-	Tut_InitArray(&vm->returnFrames, sizeof(TutReturnFrame));
-	
-	Tut_InitArray(&vm->externNames, sizeof(const char*));
-	Tut_InitArray(&vm->externs, sizeof(TutVMExternFunction));
+void Tut_InitVMWithStackSize(TutVM* vm, TutProgram* program, int32_t maxStackSize)
+{
+	assert(maxStackSize > 0);
+
+	Tut_RetainProgram(program);
+	vm->program = program;
+	vm->curProgram = program;
 
-	vm->codeSize = 0;
+	Tut_InitArray(&vm->oldPrograms, sizeof(TutProgram*));
+	Tut_InitArray(&vm->returnFrames, sizeof(TutReturnFrame));
 
 	vm->sp = 0;
 	vm->pc = -1;
 	vm->fp = 0;
+
+	vm->stack = Tut_ReservePages(sizeof(TutObject) * maxStackSize);
+	vm->stackSize = 0;
+	vm->maxStackSize = maxStackSize;
+
+	if (!Tut_GrowStack(vm, TUT_VM_INITIAL_STACK_SIZE < maxStackSize ? TUT_VM_INITIAL_STACK_SIZE : maxStackSize))
+		Tut_ErrorExit("Out of memory!\n");
+}
+
+TutBool Tut_GrowStack(TutVM* vm, int32_t size)
+{
+	if (size <= vm->stackSize)
+		return TUT_TRUE;
+
+	if (size > vm->maxStackSize)
+		return TUT_FALSE;
+
+	// Doubling keeps the number of commits logarithmic in the final size
+	int32_t newSize = vm->stackSize * 2;
+
+	if (newSize < size)
+		newSize = size;
+	if (newSize > vm->maxStackSize)
+		newSize = vm->maxStackSize;
+
+	if (!Tut_CommitPages(vm->stack, sizeof(TutObject) * newSize))
+		return TUT_FALSE;
+
+	vm->stackSize = newSize;
+	return TUT_TRUE;
 }
 
 void Tut_Push(TutVM* vm, const TutObject* object)
 {
-	if(vm->sp >= TUT_VM_STACK_SIZE)
+	if(!Tut_GrowStack(vm, vm->sp + 1))
 	{
 		fprintf(stderr, "VM Stack Overflow!\n");
 		vm->pc = -1;
+		return;
 	}
 	
 	memcpy(&vm->stack[vm->sp], object, sizeof(*object));
@@ -54,7 +88,7 @@ void Tut_PushBool(TutVM* vm, TutBool value)
 {
 	TutObject object;
 
-	object.type = TUT_OBJECT_BOOL;
+	TUT_OBJECT_SET_TYPE(object, TUT_OBJECT_BOOL);
 	object.bv = value;
 
 	Tut_Push(vm, &object);
@@ -64,7 +98,7 @@ void Tut_PushInt(TutVM* vm, int32_t value)
 {
 	TutObject object;
 
-	object.type = TUT_OBJECT_INT;
+	TUT_OBJECT_SET_TYPE(object, TUT_OBJECT_INT);
 	object.iv = value;
 
 	Tut_Push(vm, &object);
@@ -74,7 +108,7 @@ void Tut_PushFloat(TutVM* vm, float value)
 {
 	TutObject object;
 
-	object.type = TUT_OBJECT_FLOAT;
+	TUT_OBJECT_SET_TYPE(object, TUT_OBJECT_FLOAT);
 	object.fv = value;
 
 	Tut_Push(vm, &object);
@@ -84,8 +118,7 @@ void Tut_PushString(TutVM* vm, const char* string)
 {
 	TutObject object;
 
-	object.type = TUT_OBJECT_STR;
-	object.sv = Tut_Strdup(string);
+	TUT_OBJECT_SET_REF(object, TUT_OBJECT_STR, Tut_Strdup(string));
 
 	Tut_Push(vm, &object);
 }
@@ -94,8 +127,7 @@ void Tut_PushStringNoCopy(TutVM* vm, const char* string)
 {
 	TutObject object;
 	
-	object.type = TUT_OBJECT_CSTR;
-	object.sv = string;
+	TUT_OBJECT_SET_REF(object, TUT_OBJECT_CSTR, string);
 
 	Tut_Push(vm, &object);
 }
@@ -104,8 +136,7 @@ void Tut_PushRef(TutVM* vm, TutObject* ref)
 {
 	TutObject object;
 
-	object.type = TUT_OBJECT_REF;
-	object.ref = ref;
+	TUT_OBJECT_SET_REF(object, TUT_OBJECT_REF, ref);
 
 	Tut_Push(vm, &object);
 }
@@ -114,8 +145,7 @@ void Tut_PushPtr(TutVM* vm, void* ptr)
 {
 	TutObject object;
 
-	object.type = TUT_OBJECT_PTR;
-	object.ptr = ptr;
+	TUT_OBJECT_SET_REF(object, TUT_OBJECT_PTR, ptr);
 
 	Tut_Push(vm, &object);
 }
@@ -124,9 +154,7 @@ void Tut_PushFunc(TutVM* vm, TutBool isExtern, int32_t index)
 {
 	TutObject object;
 
-	object.type = TUT_OBJECT_FUNC;
-	object.func.isExtern = isExtern;
-	object.func.index = index;
+	TUT_OBJECT_SET_FUNC(object, isExtern, index);
 
 	Tut_Push(vm, &object);
 }
@@ -160,7 +188,7 @@ const char* Tut_PopString(TutVM* vm)
 	TutObject object;
 	Tut_Pop(vm, &object);
 
-	return object.sv;
+	return TUT_OBJECT_STR(object);
 }
 
 TutObject* Tut_PopRef(TutVM* vm)
@@ -168,7 +196,7 @@ TutObject* Tut_PopRef(TutVM* vm)
 	TutObject object;
 	Tut_Pop(vm, &object);
 
-	return object.ref;
+	return TUT_OBJECT_REF(object);
 }
 
 void* Tut_PopPtr(TutVM* vm)
@@ -176,7 +204,7 @@ void* Tut_PopPtr(TutVM* vm)
 	TutObject object;
 	Tut_Pop(vm, &object);
 
-	return object.ptr;
+	return TUT_OBJECT_PTR(object);
 }
 
 TutFunctionObject Tut_PopFunc(TutVM* vm)
@@ -184,752 +212,176 @@ TutFunctionObject Tut_PopFunc(TutVM* vm)
 	TutObject object;
 	Tut_Pop(vm, &object);
 
-	return object.func;
-}
-
-void Tut_BindExtern(TutVM* vm, uint32_t index, const char* name, TutVMExternFunction ext)
-{
-	assert(index < vm->externNames.length &&
-		   index < vm->externs.length);
-	
-	const char* str = Tut_Strdup(name);
-
-	Tut_ArraySet(&vm->externNames, index, &str);
-	Tut_ArraySet(&vm->externs, index, &ext);
+	return TUT_OBJECT_FUNC(object);
 }
 
-#if 1
-#define DEBUG_CYCLE(op, format, ...) if(debugFlags & TUT_VM_DEBUG_OP) printf("%s " format "\n", #op, __VA_ARGS__)
-#else
-#define DEBUG_CYCLE(op, format, ...)
-#endif
-
-void Tut_ExecuteCycle(TutVM* vm, int debugFlags)
+static void DebugCycle(const char* op, const char* format, ...)
 {
-	if(vm->pc < 0) return;
-	
-	uint8_t op = vm->code[vm->pc++];
-
-	if (debugFlags & TUT_VM_DEBUG_REGS) printf("sp=%d, fp=%d\n", vm->sp, vm->fp);
-	if(debugFlags & TUT_VM_DEBUG_OP) printf("%d: ", vm->pc);
-
-	switch (op)
-	{
-		case TUT_OP_PUSH_TRUE:
-		{
-			DEBUG_CYCLE(TUT_OP_PUSH_TRUE, "");
-			Tut_PushBool(vm, TUT_TRUE);
-		} break;
-
-		case TUT_OP_PUSH_FALSE:
-		{
-			DEBUG_CYCLE(TUT_OP_PUSH_FALSE, "");
-			Tut_PushBool(vm, TUT_FALSE);
-		} break;
-
-		case TUT_OP_PUSH_INT:
-		{
-			int32_t index = Tut_ReadInt32(vm->code, vm->pc);
-			vm->pc += 4;
-
-			int32_t value = TUT_ARRAY_GET_VALUE(&vm->integers, index, int32_t);
-			Tut_PushInt(vm, value);
-
-			DEBUG_CYCLE(TUT_OP_PUSH_INT, "%d", value);
-		} break;
-
-		case TUT_OP_PUSH_FLOAT:
-		{
-			int32_t index = Tut_ReadInt32(vm->code, vm->pc);
-			vm->pc += 4;
-
-			float value = TUT_ARRAY_GET_VALUE(&vm->floats, index, float);
-			Tut_PushFloat(vm, value);
-
-			DEBUG_CYCLE(TUT_OP_PUSH_FLOAT, "%f", value);
-		} break;
-
-		case TUT_OP_PUSH_STR:
-		{
-			int32_t index = Tut_ReadInt32(vm->code, vm->pc);
-			vm->pc += 4;
-
-			const char* data = TUT_ARRAY_GET_VALUE(&vm->strings, index, const char*);
-			Tut_PushStringNoCopy(vm, data);
-
-			DEBUG_CYCLE(TUT_OP_PUSH_STR, "%s", data);
-		} break;
+	va_list args;
 
-		case TUT_OP_PUSH_NULL:
-		{
-			Tut_PushRef(vm, NULL);
+	printf("%s ", op);
 
-			DEBUG_CYCLE(TUT_OP_PUSH_NULL, "");
-		} break;
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
 
-		case TUT_OP_MAKEGLOBALREF:
-		{
-			int32_t index = Tut_ReadInt32(vm->code, vm->pc);
-			vm->pc += 4;
-
-			Tut_PushRef(vm, &vm->globals[index]);
-
-			DEBUG_CYCLE(TUT_OP_MAKEGLOBALREF, "%d (%x)", index, (uintptr_t)(&vm->globals[index]));
-		} break;
+	printf("\n");
+}
 
-		case TUT_OP_MAKELOCALREF:
-		{
-			int32_t index = Tut_ReadInt32(vm->code, vm->pc);
-			vm->pc += 4;
+#if (defined(__GNUC__) || defined(__clang__)) && !defined(TUT_VM_NO_COMPUTED_GOTO)
+#define TUT_VM_COMPUTED_GOTO
+#endif
 
-			Tut_PushRef(vm, &vm->stack[vm->fp + index]);
+#define TUT_VM_LOOP_NAME Run
+#define TUT_VM_LOOP_DEBUG 0
+#define TUT_VM_LOOP_UNTAGGED 0
+#include "tut_vmloop.h"
 
-			DEBUG_CYCLE(TUT_OP_MAKELOCALREF, "%d (%x)", index, (uintptr_t)(&vm->stack[vm->fp + index]));
-		} break;
+#define TUT_VM_LOOP_NAME RunUntagged
+#define TUT_VM_LOOP_DEBUG 0
+#define TUT_VM_LOOP_UNTAGGED 1
+#include "tut_vmloop.h"
 
-		case TUT_OP_MAKEDYNAMICREF:
-		{
-			uint16_t offset = Tut_ReadUint16(vm->code, vm->pc);
-			vm->pc += 2;
+// Always keeps the tags up to date, which doesn't hurt untagged programs
+#define TUT_VM_LOOP_NAME RunDebug
+#define TUT_VM_LOOP_DEBUG 1
+#define TUT_VM_LOOP_UNTAGGED 0
+#include "tut_vmloop.h"
 
-			TutObject* ref = Tut_PopRef(vm);
-			Tut_PushRef(vm, &ref[offset]);
+void Tut_Run(TutVM* vm, int64_t maxSteps)
+{
+	if (vm->program->flags & TUT_PROGRAM_UNTAGGED)
+		RunUntagged(vm, maxSteps, TUT_VM_DEBUG_NONE);
+	else
+		Run(vm, maxSteps, TUT_VM_DEBUG_NONE);
+}
 
-			DEBUG_CYCLE(TUT_OP_MAKEDYNAMICREF, "%d (%x)", offset, (uintptr_t)(&ref[offset]));
-		} break;
+void Tut_RunDebug(TutVM* vm, int64_t maxSteps, int debugFlags)
+{
+	if (debugFlags == TUT_VM_DEBUG_NONE)
+		Tut_Run(vm, maxSteps);
+	else
+		RunDebug(vm, maxSteps, debugFlags);
+}
 
-		case TUT_OP_MAKEFUNC:
-		{
-			int32_t index = Tut_ReadInt32(vm->code, vm->pc);
-			vm->pc += 4;
+void Tut_ExecuteCycle(TutVM* vm, int debugFlags)
+{
+	Tut_RunDebug(vm, 1, debugFlags);
+}
 
-			Tut_PushFunc(vm, TUT_FALSE, index);
+static TutBool ProgramInUse(const TutVM* vm, const TutProgram* program)
+{
+	if (vm->curProgram == program)
+		return TUT_TRUE;
 
-			DEBUG_CYCLE(TUT_OP_MAKEFUNC, "%d", index);
-		} break;
+	for (uint32_t i = 0; i < vm->returnFrames.length; ++i)
+	{
+		const TutReturnFrame* frame = Tut_ArrayGet((TutArray*)&vm->returnFrames, i);
+		if (frame->program == program)
+			return TUT_TRUE;
+	}
 
-		case TUT_OP_MAKEEXTERNFUNC:
-		{
-			int32_t index = Tut_ReadInt32(vm->code, vm->pc);
-			vm->pc += 4;
-	
-			Tut_PushFunc(vm, TUT_TRUE, index);
-
-			DEBUG_CYCLE(TUT_OP_MAKEFUNC, "%s(%d)", TUT_ARRAY_GET_VALUE(&vm->externNames, index, const char*), index);
-		} break;
-
-		case TUT_OP_PUSHN:
-		{
-			uint16_t n = Tut_ReadUint16(vm->code, vm->pc);
-			vm->pc += 2;
-
-			if (vm->sp + n > TUT_VM_STACK_SIZE)
-			{
-				fprintf(stderr, "VM Stack Overflow (TUT_OP_PUSHN)!\n");
-				vm->pc = -1;
-			}
-			vm->sp += n;
-
-			DEBUG_CYCLE(TUT_OP_PUSHN, "%d", n);
-		} break;
-
-		case TUT_OP_PUSH1:
-		{
-			if (vm->sp >= TUT_VM_STACK_SIZE)
-			{
-				fprintf(stderr, "VM Stack Overflow (TUT_OP_PUSH1)!\n");
-				vm->pc = -1;
-			}
-			++vm->sp;
-
-			DEBUG_CYCLE(TUT_OP_PUSH1, "");
-		} break;
-
-		case TUT_OP_POPN:
-		{
-			uint16_t n = Tut_ReadUint16(vm->code, vm->pc);
-			vm->pc += 2;
-
-			if (vm->sp - n < 0)
-			{
-				fprintf(stderr, "VM Stack Underflow (TUT_OP_POPN)!\n");
-				vm->pc = -1;
-				return;
-			}
-			vm->sp -= n;
-
-			DEBUG_CYCLE(TUT_OP_POPN, "%d", n);
-		} break;
-
-		case TUT_OP_POP1:
-		{
-			if (vm->sp <= 0)
-			{
-				fprintf(stderr, "VM Stack Underflow (TUT_OP_POP1)!\n");
-				vm->pc = -1;
-				return;
-			}
-			--vm->sp;
-
-			DEBUG_CYCLE(TUT_OP_POP1, "");
-		} break;
-
-		case TUT_OP_MOVEN:
-		{
-			uint16_t numObjects = Tut_ReadUint16(vm->code, vm->pc);
-			vm->pc += 2;
-			uint16_t stackSpaces = Tut_ReadUint16(vm->code, vm->pc);
-			vm->pc += 2;
-
-			int32_t targetSp = vm->sp - numObjects - stackSpaces;
-
-			if (targetSp < 0)
-			{
-				fprintf(stderr, "VM Stack Underflow (TUT_OP_MOVEN)!\n");
-				vm->pc = -1;
-				return;
-			}
-			
-			memmove(&vm->stack[targetSp], &vm->stack[vm->sp - numObjects], sizeof(TutObject) * numObjects);
-			vm->sp = targetSp + numObjects;
-
-			DEBUG_CYCLE(TUT_OP_MOVEN, "%d, %d", numObjects, stackSpaces);
-		} break;
-		
-		case TUT_OP_MOVE1:
-		{
-			// Copied from TUT_OP_MOVEN
-			uint16_t numObjects = 1;
-			uint16_t stackSpaces = Tut_ReadUint16(vm->code, vm->pc);
-			vm->pc += 2;
-
-			int32_t targetSp = vm->sp - numObjects - stackSpaces;
-
-			if (targetSp < 0)
-			{
-				fprintf(stderr, "VM Stack Underflow (TUT_OP_MOVEN)!\n");
-				vm->pc = -1;
-				return;
-			}
-
-			memmove(&vm->stack[targetSp], &vm->stack[vm->sp - numObjects], sizeof(TutObject) * numObjects);
-			vm->sp = targetSp + numObjects;
-
-			DEBUG_CYCLE(TUT_OP_MOVE1, "%d", stackSpaces);
-		} break;
-
-		case TUT_OP_GETGLOBALN:
-		{
-			uint16_t numObjects = Tut_ReadUint16(vm->code, vm->pc);
-			vm->pc += 2;
-
-			int32_t index = Tut_ReadInt32(vm->code, vm->pc);
-			vm->pc += 4;
-
-			memcpy(&vm->stack[vm->sp], &vm->globals[index], sizeof(TutObject) * numObjects);
-			vm->sp += numObjects;
-
-			DEBUG_CYCLE(TUT_OP_GETGLOBALN, "%d, %d", numObjects, index);
-		} break;
-
-		case TUT_OP_GETGLOBAL1:
-		{
-			int32_t index = Tut_ReadInt32(vm->code, vm->pc);
-			vm->pc += 4;
-
-			Tut_Push(vm, &vm->globals[index]);
-			DEBUG_CYCLE(TUT_OP_GETGLOBAL1, "%d", index);
-		} break;
-		 
-		case TUT_OP_SETGLOBALN:
-		{
-			uint16_t numObjects = Tut_ReadUint16(vm->code, vm->pc);
-			vm->pc += 2;
-
-			int32_t index = Tut_ReadInt32(vm->code, vm->pc);
-			vm->pc += 4;
-
-			if (vm->sp - numObjects < 0)
-			{
-				fprintf(stderr, "Error: Stack Underflow! (TUT_OP_SETGLOBALN)\n");
-				vm->pc = -1;
-				return;
-			}
-
-			memcpy(&vm->globals[index], &vm->stack[vm->sp - numObjects], sizeof(TutObject) * numObjects);
-			vm->sp -= numObjects;
-
-			DEBUG_CYCLE(TUT_OP_SETGLOBALN, "%d, %d", numObjects, index);
-		} break;
-
-		case TUT_OP_SETGLOBAL1:
-		{
-			int32_t index = Tut_ReadInt32(vm->code, vm->pc);
-			vm->pc += 4;
-
-			if (vm->sp <= 0)
-			{
-				fprintf(stderr, "Error: Stack Underflow! (TUT_OP_SETGLOBAL1)\n");
-				vm->pc = -1;
-				return;
-			}
-
-			Tut_Pop(vm, &vm->globals[index]);
-
-			DEBUG_CYCLE(TUT_OP_SETGLOBAL1, "%d", index);
-		} break;
-
-		case TUT_OP_GETLOCALN:
-		{
-			uint16_t numObjects = Tut_ReadUint16(vm->code, vm->pc);
-			vm->pc += 2;
-
-			int32_t index = Tut_ReadInt32(vm->code, vm->pc);
-			vm->pc += 4;
-
-			memcpy(&vm->stack[vm->sp], &vm->stack[vm->fp + index], sizeof(TutObject) * numObjects);
-			vm->sp += numObjects;
-
-			DEBUG_CYCLE(TUT_OP_GETLOCALN, "%d, %d", numObjects, index);
-		} break;
-
-		case TUT_OP_GETLOCAL1:
-		{
-			int32_t index = Tut_ReadInt32(vm->code, vm->pc);
-			vm->pc += 4;
-
-			Tut_Push(vm, &vm->stack[vm->fp + index]);
-
-			DEBUG_CYCLE(TUT_OP_GETLOCAL1, "%d", index);
-		} break;
-
-		case TUT_OP_SETLOCALN:
-		{
-			uint16_t numObjects = Tut_ReadUint16(vm->code, vm->pc);
-			vm->pc += 2;
-
-			int32_t index = Tut_ReadInt32(vm->code, vm->pc);
-			vm->pc += 4;
-			
-			memcpy(&vm->stack[vm->fp + index], &vm->stack[vm->sp - numObjects], sizeof(TutObject) * numObjects);
-			vm->sp -= numObjects;
-
-			DEBUG_CYCLE(TUT_OP_SETLOCALN, "%d, %d", numObjects, index);
-		} break;
-
-		case TUT_OP_SETLOCAL1:
-		{
-			int32_t index = Tut_ReadInt32(vm->code, vm->pc);
-			vm->pc += 4;
-
-			Tut_Pop(vm, &vm->stack[vm->fp + index]);
-			
-			DEBUG_CYCLE(TUT_OP_SETLOCAL1, "%d", index);
-		} break;
-
-		case TUT_OP_GETREFN:
-		{
-			uint16_t numObjects = Tut_ReadUint16(vm->code, vm->pc);
-			vm->pc += 2;
-
-			uint16_t offset = Tut_ReadUint16(vm->code, vm->pc);
-			vm->pc += 2;
-
-			TutObject* ref = Tut_PopRef(vm);
-
-			memcpy(&vm->stack[vm->sp], &ref[offset], sizeof(TutObject) * numObjects);
-			vm->sp += numObjects;
-
-			DEBUG_CYCLE(TUT_OP_GETREFN, "%x, %d", (uintptr_t)ref, numObjects);
-		} break;
-
-		case TUT_OP_GETREF1:
-		{
-			uint16_t offset = Tut_ReadUint16(vm->code, vm->pc);
-			vm->pc += 2;
-			
-			TutObject* ref = Tut_PopRef(vm);
-			
-			Tut_Push(vm, &ref[offset]);
-
-			DEBUG_CYCLE(TUT_OP_GETREF1, "%x", (uintptr_t)ref);
-		} break;
-
-		case TUT_OP_SETREFN:
-		{
-			uint16_t numObjects = Tut_ReadUint16(vm->code, vm->pc);
-			vm->pc += 2;
-
-			uint16_t offset = Tut_ReadUint16(vm->code, vm->pc);
-			vm->pc += 2;
-
-			TutObject* ref = Tut_PopRef(vm);
-
-			memcpy(&ref[offset], &vm->stack[vm->sp - numObjects], sizeof(TutObject) * numObjects);
-			vm->sp -= numObjects;
-
-			DEBUG_CYCLE(TUT_OP_SETREFN, "%x, %d", (uintptr_t)ref, numObjects);
-		} break;
-
-		case TUT_OP_SETREF1:
-		{
-			uint16_t offset = Tut_ReadUint16(vm->code, vm->pc);
-			vm->pc += 2;
-
-			TutObject* ref = Tut_PopRef(vm);
-			Tut_Pop(vm, &ref[offset]);
-
-			DEBUG_CYCLE(TUT_OP_SETREFN, "%x", (uintptr_t)ref);
-		} break;
-
-#define BIN_OP_INT(name, op) 
-#define BIN_OP_FLOAT(name, op) case name: { float b = Tut_PopFloat(vm); float a = Tut_PopFloat(vm); Tut_PushFloat(vm, a op b); DEBUG_CYCLE(name, "%f, %f", a, b); } break;
-		case TUT_OP_ADDI: 
-		{ 
-			int32_t b = Tut_PopInt(vm); 
-			int32_t a = Tut_PopInt(vm); 
-			Tut_PushInt(vm, a + b);
-
-			DEBUG_CYCLE(TUT_OP_ADDI, "%d, %d", a, b);
-		} break;
-		
-		case TUT_OP_SUBI: 
-		{ 
-			int32_t b = Tut_PopInt(vm); 
-			int32_t a = Tut_PopInt(vm); 
-			Tut_PushInt(vm, a - b); 
-
-			DEBUG_CYCLE(TUT_OP_SUBI, "%d, %d", a, b);
-		} break;
-
-		case TUT_OP_MULI: 
-		{ 
-			int32_t b = Tut_PopInt(vm); 
-			int32_t a = Tut_PopInt(vm); 
-			Tut_PushInt(vm, a * b); 
-
-			DEBUG_CYCLE(TUT_OP_MULI, "%d, %d", a, b);
-		} break;
-		
-		case TUT_OP_DIVI: 
-		{ 
-			int32_t b = Tut_PopInt(vm); 
-			int32_t a = Tut_PopInt(vm); 
-			Tut_PushInt(vm, a / b); 
-
-			DEBUG_CYCLE(TUT_OP_DIVI, "%d, %d", a, b);
-		} break;
-		
-		BIN_OP_FLOAT(TUT_OP_ADDF, +)
-		BIN_OP_FLOAT(TUT_OP_SUBF, -)
-		BIN_OP_FLOAT(TUT_OP_MULF, *)
-		BIN_OP_FLOAT(TUT_OP_DIVF, /)	
-
-#undef BIN_OP_INT
-#undef BIN_OP_FLOAT
-
-		case TUT_OP_LAND:
-		{
-			TutBool b = Tut_PopBool(vm), a = Tut_PopBool(vm);
-			Tut_PushBool(vm, a && b);
-
-			DEBUG_CYCLE(TUT_OP_LAND, "%d, %d", a, b);
-		} break;
-
-		case TUT_OP_LOR:
-		{
-			TutBool b = Tut_PopBool(vm), a = Tut_PopBool(vm);
-			Tut_PushBool(vm, a || b);
-
-			DEBUG_CYCLE(TUT_OP_LOR, "%d, %d", a, b);
-		} break;
-		
-		case TUT_OP_LNOT:
-		{
-			TutBool a = Tut_PopBool(vm);
-			Tut_PushBool(vm, !a);
-
-			DEBUG_CYCLE(TUT_OP_LNOT, "%d", a);
-		} break;
-
-		case TUT_OP_ILT:
-		{
-			int32_t b = Tut_PopInt(vm), a = Tut_PopInt(vm);
-			Tut_PushBool(vm, a < b);
-
-			DEBUG_CYCLE(TUT_OP_ILT, "%d, %d", a, b);
-		} break;
-
-		case TUT_OP_IGT:
-		{
-			int32_t b = Tut_PopInt(vm), a = Tut_PopInt(vm);
-			Tut_PushBool(vm, a > b);
-
-			DEBUG_CYCLE(TUT_OP_IGT, "%d, %d", a, b);
-		} break;
-
-		case TUT_OP_ILTE:
-		{
-			int32_t b = Tut_PopInt(vm), a = Tut_PopInt(vm);
-			Tut_PushBool(vm, a <= b);
-
-			DEBUG_CYCLE(TUT_OP_ILTE, "%d, %d", a, b);
-		} break;
-
-		case TUT_OP_IGTE:
-		{
-			int32_t b = Tut_PopInt(vm), a = Tut_PopInt(vm);
-			Tut_PushBool(vm, a >= b);
-
-			DEBUG_CYCLE(TUT_OP_IGTE, "%d, %d", a, b);
-		} break;
-
-		case TUT_OP_IEQ:
-		{
-			int32_t b = Tut_PopInt(vm), a = Tut_PopInt(vm);
-			Tut_PushBool(vm, a == b);
-
-			DEBUG_CYCLE(TUT_OP_IEQ, "%d, %d", a, b);
-		} break;
-
-		case TUT_OP_INEG:
-		{
-			int32_t i = Tut_PopInt(vm);
-			Tut_PushInt(vm, -i);
-
-			DEBUG_CYCLE(TUT_OP_INEG, "%d", i);
-		} break;
-
-		case TUT_OP_FLT: 
-		{
-			float b = Tut_PopFloat(vm), a = Tut_PopFloat(vm);
-			Tut_PushBool(vm, a < b);
-
-			DEBUG_CYCLE(TUT_OP_FLT, "%g, %g", a, b);
-		} break;
-		
-		case TUT_OP_FGT:
-		{
-			float b = Tut_PopFloat(vm), a = Tut_PopFloat(vm);
-			Tut_PushBool(vm, a > b);
-
-			DEBUG_CYCLE(TUT_OP_FGT, "%g, %g", a, b);
-		} break;
-		
-		case TUT_OP_FLTE:
-		{
-			float b = Tut_PopFloat(vm), a = Tut_PopFloat(vm);
-			Tut_PushBool(vm, a <= b);
-
-			DEBUG_CYCLE(TUT_OP_FLTE, "%g, %g", a, b);
-		} break;
-
-		case TUT_OP_FGTE:
-		{
-			float b = Tut_PopFloat(vm), a = Tut_PopFloat(vm);
-			Tut_PushBool(vm, a >= b);
-
-			DEBUG_CYCLE(TUT_OP_FGTE, "%g, %g", a, b);
-		} break;
-			
-		case TUT_OP_FEQ:
-		{
-			float b = Tut_PopFloat(vm), a = Tut_PopFloat(vm);
-			Tut_PushBool(vm, a == b);
-
-			DEBUG_CYCLE(TUT_OP_FEQ, "%g, %g", a, b);
-		} break;
-
-		case TUT_OP_FNEG:
-		{
-			float f = Tut_PopFloat(vm);
-			Tut_PushFloat(vm, -f);
-
-			DEBUG_CYCLE(TUT_OP_FNEG, "%g", f);
-		} break;
+	return TUT_FALSE;
+}
 
-		case TUT_OP_BEQ:
-		{
-			TutBool b = Tut_PopBool(vm);
-			TutBool a = Tut_PopBool(vm);
-
-			Tut_PushBool(vm, a == b);
-
-			DEBUG_CYCLE(TUT_OP_BEQ, "%s, %s", a ? "true" : "false", b ? "true" : "false");
-		} break;
-
-		case TUT_OP_SEQ:
-		{
-			const char* b = Tut_PopString(vm);
-			const char* a = Tut_PopString(vm);
-
-			Tut_PushBool(vm, strcmp(a, b) == 0);
-
-			DEBUG_CYCLE(TUT_OP_SEQ, "%s, %s", a, b);
-		} break;
-
-		case TUT_OP_REQ:
-		{
-			const void* b = Tut_PopRef(vm);
-			const void* a = Tut_PopRef(vm);
+static void ReleaseOldPrograms(TutVM* vm, TutBool all)
+{
+	uint32_t count = 0;
 
-			Tut_PushBool(vm, a == b);
-			
-			DEBUG_CYCLE(TUT_OP_REQ, "%x, %x", (uintptr_t)a, (uintptr_t)b);
-		} break;
-
-		case TUT_OP_CALL:
-		{
-			uint16_t nargs = Tut_ReadUint16(vm->code, vm->pc);
-			vm->pc += 2;
-
-			TutFunctionObject func = Tut_PopFunc(vm);
-
-			if (!func.isExtern)
-			{
-				assert(func.index >= 0 && func.index < vm->functionPcs.length);
-
-				TutReturnFrame frame;
-
-				frame.nargs = nargs;
-				frame.pc = vm->pc;
-				frame.fp = vm->fp;
-
-				Tut_ArrayPush(&vm->returnFrames, &frame);
-
-				vm->pc = TUT_ARRAY_GET_VALUE(&vm->functionPcs, func.index, int32_t);
-				vm->fp = vm->sp;
-
-				DEBUG_CYCLE(TUT_OP_CALL, "%d, %d", func.index, nargs);
-			}
-			else
-			{
-				DEBUG_CYCLE(TUT_OP_CALL, "extern %s, %d", TUT_ARRAY_GET_VALUE(&vm->externNames, func.index, const char*), nargs);
-				assert(func.index >= 0 && func.index < vm->externs.length);
-
-				TutVMExternFunction ext = TUT_ARRAY_GET_VALUE(&vm->externs, func.index, TutVMExternFunction);
-
-				int32_t sp = vm->sp;
+	for (uint32_t i = 0; i < vm->oldPrograms.length; ++i)
+	{
+		TutProgram* program = TUT_ARRAY_GET_VALUE(&vm->oldPrograms, i, TutProgram*);
 
-				uint16_t numObjects = ext(vm, &vm->stack[sp - nargs], nargs);
+		if (all || !ProgramInUse(vm, program))
+			Tut_ReleaseProgram(program);
+		else
+			Tut_ArraySet(&vm->oldPrograms, count++, &program);
+	}
 
-				vm->sp = sp - nargs;
+	vm->oldPrograms.length = count;
+}
 
-				memcpy(&vm->stack[vm->sp], &vm->stack[sp], sizeof(TutObject) * numObjects);
-				vm->sp += numObjects;
-			}
-		} break;
+// Code still running in the old program accesses globals by its own indices, so
+// only globals which stay where they are can be kept
+static const TutGlobalLayout* FindGlobal(const TutProgram* program, const TutGlobalLayout* layout)
+{
+	for (uint32_t i = 0; i < program->globalLayout.length; ++i)
+	{
+		const TutGlobalLayout* g = Tut_ArrayGet((TutArray*)&program->globalLayout, i);
 
-		case TUT_OP_RET:
-		{
-			if (vm->returnFrames.length <= 0)
-			{
-				vm->pc = -1;
-				return;
-			}
+		if (g->index == layout->index && g->nameHash == layout->nameHash &&
+			g->layoutHash == layout->layoutHash && g->size == layout->size)
+			return g;
+	}
 
-			TutReturnFrame frame;
-			Tut_ArrayPop(&vm->returnFrames, &frame);
+	return NULL;
+}
 
-			vm->sp = vm->fp;
-			vm->sp -= frame.nargs;
-			vm->fp = frame.fp;
-			vm->pc = frame.pc;
+static TutBool GlobalFits(const TutGlobalLayout* layout, int32_t numGlobals)
+{
+	return layout->index >= 0 && layout->size >= 0 && numGlobals <= TUT_VM_MAX_GLOBALS &&
+		layout->index <= numGlobals - layout->size;
+}
 
-			DEBUG_CYCLE(TUT_OP_RET, "");
-		} break;
+TutBool Tut_ReloadVM(TutVM* vm, TutProgram* program)
+{
+	TutProgram* old = vm->program;
 
-		case TUT_OP_RETVALN:
-		{
-			uint16_t numObjects = Tut_ReadUint16(vm->code, vm->pc);
-			vm->pc += 2;
+	if (program->functionSignature != old->functionSignature ||
+		program->flags != old->flags ||
+		program->functionPcs.length != old->functionPcs.length ||
+		program->externs.length != old->externs.length ||
+		program->numGlobals > TUT_VM_MAX_GLOBALS)
+		return TUT_FALSE;
 
-			int copySp = vm->sp - numObjects;
+	// program may be shared, so it has to come bound
+	for (uint32_t i = 0; i < program->externs.length; ++i)
+	{
+		if (!TUT_ARRAY_GET_VALUE(&program->externs, i, TutVMExternFunction))
+			return TUT_FALSE;
+	}
 
-			if (copySp < 0)
-			{
-				fprintf(stderr, "VM Stack Underflow (TUT_OP_RETVALN).\n");
-				vm->pc = -1;
-				return;
-			}
+	for (uint32_t i = 0; i < program->globalLayout.length; ++i)
+	{
+		if (!GlobalFits(Tut_ArrayGet(&program->globalLayout, i), program->numGlobals))
+			return TUT_FALSE;
+	}
 
-			if (vm->returnFrames.length <= 0)
-			{
-				vm->pc = -1;
-				return;
-			}
+	TutObject globals[TUT_VM_MAX_GLOBALS];
+	memset(globals, 0, sizeof(TutObject) * program->numGlobals);
 
-			TutReturnFrame frame;
-			Tut_ArrayPop(&vm->returnFrames, &frame);
+	for (uint32_t i = 0; i < program->globalLayout.length; ++i)
+	{
+		const TutGlobalLayout* layout = Tut_ArrayGet(&program->globalLayout, i);
+		if (FindGlobal(old, layout) && GlobalFits(layout, old->numGlobals))
+			memcpy(&globals[layout->index], &vm->globals[layout->index], sizeof(TutObject) * layout->size);
+	}
 
-			vm->sp = vm->fp;
-			vm->sp -= frame.nargs;
-			vm->fp = frame.fp;
-			vm->pc = frame.pc;
+	memcpy(vm->globals, globals, sizeof(TutObject) * program->numGlobals);
 
-			memcpy(&vm->stack[vm->sp], &vm->stack[copySp], sizeof(TutObject) * numObjects);
-			vm->sp += numObjects;
+	Tut_RetainProgram(program);
+	vm->program = program;
 
-			DEBUG_CYCLE(TUT_OP_RETVALN, "%d", numObjects);
-		} break;
+	// With nothing running there is nothing to finish on the old code
+	if (vm->pc < 0 && vm->returnFrames.length == 0)
+		vm->curProgram = program;
 
-		case TUT_OP_RETVAL1:
-		{
-			TutObject object;
-			Tut_Pop(vm, &object);
-	
-			if (vm->returnFrames.length <= 0)
-			{
-				vm->pc = -1;
-				return;
-			}
-
-			TutReturnFrame frame;
-			Tut_ArrayPop(&vm->returnFrames, &frame);
-
-			vm->sp = vm->fp;
-			vm->sp -= frame.nargs;
-			vm->fp = frame.fp;
-			vm->pc = frame.pc;
-
-			Tut_Push(vm, &object);
-
-			DEBUG_CYCLE(TUT_OP_RETVAL1, "");
-		} break;
-
-		case TUT_OP_GOTO:
-		{
-			int32_t pc = Tut_ReadInt32(vm->code, vm->pc);
-			DEBUG_CYCLE(TUT_OP_GOTO, "%d", pc);
-			vm->pc = pc;
-		} break;
-
-		case TUT_OP_GOTOFALSE:
-		{
-			int32_t pc = Tut_ReadInt32(vm->code, vm->pc);
-			DEBUG_CYCLE(TUT_OP_GOTOFALSE, "%d", pc);
-
-			vm->pc += 4;
-			
-			TutBool value = Tut_PopBool(vm);
-			if(!value)
-				vm->pc = pc;
-		} break;
-
-		case TUT_OP_HALT:
-		{
-			vm->pc = -1;
-			DEBUG_CYCLE(TUT_OP_HALT, "");
-		} break;
-
-		default:
-			DEBUG_CYCLE(INVALID_OP);
-			break;
-	}
+	Tut_ArrayPush(&vm->oldPrograms, &old);
+	ReleaseOldPrograms(vm, TUT_FALSE);
 
+	return TUT_TRUE;
 }
 
 void Tut_DestroyVM(TutVM* vm)
 {
-	// TODO: Implement this
+	Tut_DestroyArray(&vm->returnFrames);
+
+	ReleaseOldPrograms(vm, TUT_TRUE);
+	Tut_DestroyArray(&vm->oldPrograms);
+
+	Tut_ReleaseProgram(vm->program);
+	vm->program = NULL;
+
+	Tut_FreePages(vm->stack, sizeof(TutObject) * vm->maxStackSize);
+	vm->stack = NULL;
 }
@@ -1,18 +1,26 @@
 #ifndef TUT_VM_H
 #define TUT_VM_H
 
-#define TUT_VM_MAX_CODE_SIZE	4096
 #define TUT_VM_MAX_GLOBALS		256	
-#define TUT_VM_STACK_SIZE		256
+
+// In objects; the stack starts out with this much committed and grows up to its
+// max size (see Tut_InitVMWithStackSize)
+#define TUT_VM_INITIAL_STACK_SIZE		256
+#define TUT_VM_DEFAULT_MAX_STACK_SIZE	(1 << 16)
 
 #include "tut_util.h"
 #include "tut_objects.h"
 #include "tut_array.h"
+#include "tut_program.h"
 
 typedef struct
 {
 	uint16_t nargs;
 	int32_t pc, fp;
+
+	// Code pc is in; only differs from the vm's program for frames which were
+	// active when the program was reloaded
+	const struct TutProgram* program;
 } TutReturnFrame;
 
 typedef enum
@@ -22,32 +30,38 @@ typedef enum
 	TUT_VM_DEBUG_REGS = 2,
 } TutVMDebugFlags;
 
-typedef struct
+typedef struct TutVM
 {
-	int32_t sp, pc, fp;
-	
-	TutArray integers;
-	TutArray floats;
-	TutArray strings;
-	
-	TutArray functionPcs;
+	// Shared, read-only; the vm holds a reference to it. Calls always go to this
+	// program's functions.
+	TutProgram* program;
+	// Program the current frame is executing (see Tut_ReloadVM)
+	const TutProgram* curProgram;
+	// Replaced programs which frames may still be executing; they are released
+	// once no frame refers to them anymore
+	TutArray oldPrograms;
 
-	TutArray externNames;
-	TutArray externs;
+	int32_t sp, pc, fp;
 
 	TutArray returnFrames;
 
-	uint32_t codeSize;
-	uint8_t code[TUT_VM_MAX_CODE_SIZE];
-
 	TutObject globals[TUT_VM_MAX_GLOBALS];
-	TutObject stack[TUT_VM_STACK_SIZE];
+
+	// Address space for maxStackSize objects is reserved up front so the stack never
+	// moves (refs to locals stay valid); the first stackSize objects are committed
+	TutObject* stack;
+	int32_t stackSize, maxStackSize;
 } TutVM;
 
-// Externs return number of values pushed onto the stack (0 if none are returned)
-typedef uint16_t(*TutVMExternFunction)(TutVM* vm, const TutObject* args, uint16_t nargs);
+// Retains program; vm->pc starts out negative (halted)
+void Tut_InitVM(TutVM* vm, TutProgram* program);
+// Same as above but the stack can grow up to maxStackSize objects (instead of
+// TUT_VM_DEFAULT_MAX_STACK_SIZE)
+void Tut_InitVMWithStackSize(TutVM* vm, TutProgram* program, int32_t maxStackSize);
 
-void Tut_InitVM(TutVM* vm);
+// Commits at least size objects of the stack; returns FALSE if that's more than the
+// vm's max stack size (or the system is out of memory)
+TutBool Tut_GrowStack(TutVM* vm, int32_t size);
 
 void Tut_Push(TutVM* vm, const TutObject* value);
 void Tut_Pop(TutVM* vm, TutObject* object);
@@ -73,10 +87,26 @@ TutObject* Tut_PopRef(TutVM* vm);
 void* Tut_PopPtr(TutVM* vm);
 TutFunctionObject Tut_PopFunc(TutVM* vm);
 
-void Tut_BindExtern(TutVM* vm, uint32_t index, const char* name, TutVMExternFunction ext);
+// Runs until the program halts or maxSteps instructions have been executed
+// (a negative maxSteps means no limit); vm->pc is negative once halted
+void Tut_Run(TutVM* vm, int64_t maxSteps);
+// Same as Tut_Run but traces execution according to debugFlags (TutVMDebugFlags)
+void Tut_RunDebug(TutVM* vm, int64_t maxSteps, int debugFlags);
 
+// Executes a single instruction
 void Tut_ExecuteCycle(TutVM* vm, int debugFlags);
 
+// Swaps program in for the vm's program without touching the stack: frames which
+// are active keep running the code they are in until they return, but every call
+// from then on goes to the new program. Globals which have the same name, index,
+// size and type in both programs keep their value; the rest are zeroed. Every extern
+// of program has to be bound already. Returns FALSE and leaves the vm untouched if an
+// extern is unbound, a global lies outside the globals, or the functions or externs
+// of the two programs differ in name, index or type.
+// This can be called between Tut_Run calls or from inside an extern.
+TutBool Tut_ReloadVM(TutVM* vm, TutProgram* program);
+
+// Releases the vm's reference to its program and frees its stack
 void Tut_DestroyVM(TutVM* vm);
 
 #endif
@@ -0,0 +1,1104 @@
+// The interpreter loop. This file is included by tut_vm.c once for every
+// variant of the loop it needs; before including it define:
+//
+// TUT_VM_LOOP_NAME		name of the (static) function to generate
+// TUT_VM_LOOP_DEBUG	1 to compile in the debugFlags tracing, 0 to leave it out
+// TUT_VM_LOOP_UNTAGGED	1 to skip storing the type of values the code computes
+//						(for TUT_PROGRAM_UNTAGGED programs), 0 to store it
+//
+// Every handler works on local copies of pc/sp/fp which are written
+// back into the vm when the loop exits or calls out into an extern.
+
+#ifndef TUT_VM_LOOP_NAME
+#error "TUT_VM_LOOP_NAME must be defined before including tut_vmloop.h"
+#endif
+
+#if TUT_VM_LOOP_DEBUG
+#define DEBUG_CYCLE(op, ...) if(debugFlags & TUT_VM_DEBUG_OP) DebugCycle(#op, __VA_ARGS__)
+#define DEBUG_TRACE() \
+	do { \
+		if(debugFlags & TUT_VM_DEBUG_REGS) printf("sp=%d, fp=%d\n", sp, fp); \
+		if(debugFlags & TUT_VM_DEBUG_OP) printf("%d: ", pc + 1); \
+	} while(0)
+#else
+#define DEBUG_CYCLE(op, ...)
+#define DEBUG_TRACE()
+#endif
+
+#if TUT_VM_LOOP_UNTAGGED
+#define VM_SET_TYPE(obj, t) ((void)0)
+#else
+#define VM_SET_TYPE(obj, t) TUT_OBJECT_SET_TYPE(obj, t)
+#endif
+
+#define VM_SYNC() (vm->pc = pc, vm->sp = sp, vm->fp = fp, vm->curProgram = program)
+
+// Commits more of the stack if needed; the stack never moves, so nothing has to be reloaded
+#define VM_GROW_STACK(size) (Tut_GrowStack(vm, (size)) ? (stackSize = vm->stackSize, TUT_TRUE) : TUT_FALSE)
+#define VM_RESERVE_STACK(n) if(sp + (n) > stackSize && !VM_GROW_STACK(sp + (n))) goto stackOverflow
+
+// Code is verified (see Tut_VerifyProgram), so it never pops below the bottom of
+// the stack or pushes past the depth CALL reserved for the function; only the
+// debug loop still checks every push and pop
+#if TUT_VM_LOOP_DEBUG
+#define VM_CHECK_PUSH(n) VM_RESERVE_STACK(n)
+#define VM_CHECK_POP(n) if(sp - (n) < 0) goto stackUnderflow
+#else
+#define VM_CHECK_PUSH(n) ((void)0)
+#define VM_CHECK_POP(n) ((void)0)
+#endif
+
+#define VM_PUSH(object) do { VM_CHECK_PUSH(1); memcpy(&stack[sp], (object), sizeof(TutObject)); ++sp; } while(0)
+#define VM_POP(object) do { VM_CHECK_POP(1); --sp; memcpy((object), &stack[sp], sizeof(TutObject)); } while(0)
+
+#define VM_PUSH_VALUE(objType, field, value) do { VM_CHECK_PUSH(1); VM_SET_TYPE(stack[sp], (objType)); stack[sp].field = (value); ++sp; } while(0)
+#define VM_POP_VALUE(var, field) do { VM_CHECK_POP(1); --sp; (var) = stack[sp].field; } while(0)
+
+#define VM_PUSH_POINTER(objType, value) do { VM_CHECK_PUSH(1); TUT_OBJECT_SET_REF(stack[sp], (objType), (value)); ++sp; } while(0)
+#define VM_POP_REF(var) do { VM_CHECK_POP(1); --sp; (var) = TUT_OBJECT_REF(stack[sp]); } while(0)
+
+#define VM_PUSH_BOOL(value) VM_PUSH_VALUE(TUT_OBJECT_BOOL, bv, (value))
+#define VM_PUSH_INT(value) VM_PUSH_VALUE(TUT_OBJECT_INT, iv, (value))
+#define VM_PUSH_FLOAT(value) VM_PUSH_VALUE(TUT_OBJECT_FLOAT, fv, (value))
+#define VM_PUSH_REF(value) VM_PUSH_POINTER(TUT_OBJECT_REF, (value))
+
+#ifdef TUT_VM_COMPUTED_GOTO
+#define VM_CASE(name) op_##name:
+#define VM_DISPATCH() do { if(--steps < 0) goto suspend; DEBUG_TRACE(); goto *dispatchTable[code[pc++]]; } while(0)
+#define VM_NEXT() VM_DISPATCH()
+#define VM_LABEL(name) [name] = &&op_##name
+#else
+#define VM_CASE(name) case name:
+#define VM_NEXT() continue
+#endif
+
+static void TUT_VM_LOOP_NAME(TutVM* vm, int64_t maxSteps, int debugFlags)
+{
+#ifdef TUT_VM_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Woverride-init"
+#endif
+	static const void* dispatchTable[256] =
+	{
+		[0 ... 255] = &&op_INVALID,
+
+		VM_LABEL(TUT_OP_PUSH_TRUE),
+		VM_LABEL(TUT_OP_PUSH_FALSE),
+		VM_LABEL(TUT_OP_PUSH_INT),
+		VM_LABEL(TUT_OP_PUSH_FLOAT),
+		VM_LABEL(TUT_OP_PUSH_I8),
+		VM_LABEL(TUT_OP_PUSH_I32),
+		VM_LABEL(TUT_OP_PUSH_F32),
+		VM_LABEL(TUT_OP_PUSH_STR),
+		VM_LABEL(TUT_OP_PUSH_NULL),
+		VM_LABEL(TUT_OP_MAKEGLOBALREF),
+		VM_LABEL(TUT_OP_MAKELOCALREF),
+		VM_LABEL(TUT_OP_MAKEDYNAMICREF),
+		VM_LABEL(TUT_OP_MAKEFUNC),
+		VM_LABEL(TUT_OP_MAKEEXTERNFUNC),
+		VM_LABEL(TUT_OP_PUSHN),
+		VM_LABEL(TUT_OP_PUSH1),
+		VM_LABEL(TUT_OP_POPN),
+		VM_LABEL(TUT_OP_POP1),
+		VM_LABEL(TUT_OP_MOVEN),
+		VM_LABEL(TUT_OP_MOVE1),
+		VM_LABEL(TUT_OP_GETGLOBALN),
+		VM_LABEL(TUT_OP_GETGLOBAL1),
+		VM_LABEL(TUT_OP_SETGLOBALN),
+		VM_LABEL(TUT_OP_SETGLOBAL1),
+		VM_LABEL(TUT_OP_GETLOCALN),
+		VM_LABEL(TUT_OP_GETLOCAL1),
+		VM_LABEL(TUT_OP_SETLOCALN),
+		VM_LABEL(TUT_OP_SETLOCAL1),
+		VM_LABEL(TUT_OP_GETREFN),
+		VM_LABEL(TUT_OP_GETREF1),
+		VM_LABEL(TUT_OP_SETREFN),
+		VM_LABEL(TUT_OP_SETREF1),
+		VM_LABEL(TUT_OP_ADDI),
+		VM_LABEL(TUT_OP_SUBI),
+		VM_LABEL(TUT_OP_MULI),
+		VM_LABEL(TUT_OP_DIVI),
+		VM_LABEL(TUT_OP_ADDF),
+		VM_LABEL(TUT_OP_SUBF),
+		VM_LABEL(TUT_OP_MULF),
+		VM_LABEL(TUT_OP_DIVF),
+		VM_LABEL(TUT_OP_ADDI_LLL),
+		VM_LABEL(TUT_OP_SUBI_LLL),
+		VM_LABEL(TUT_OP_MULI_LLL),
+		VM_LABEL(TUT_OP_DIVI_LLL),
+		VM_LABEL(TUT_OP_ADDI_LLK),
+		VM_LABEL(TUT_OP_SUBI_LLK),
+		VM_LABEL(TUT_OP_MULI_LLK),
+		VM_LABEL(TUT_OP_DIVI_LLK),
+		VM_LABEL(TUT_OP_ADDF_LLL),
+		VM_LABEL(TUT_OP_SUBF_LLL),
+		VM_LABEL(TUT_OP_MULF_LLL),
+		VM_LABEL(TUT_OP_DIVF_LLL),
+		VM_LABEL(TUT_OP_ADDF_LLK),
+		VM_LABEL(TUT_OP_SUBF_LLK),
+		VM_LABEL(TUT_OP_MULF_LLK),
+		VM_LABEL(TUT_OP_DIVF_LLK),
+		VM_LABEL(TUT_OP_ILT_LL_JF),
+		VM_LABEL(TUT_OP_ILTE_LL_JF),
+		VM_LABEL(TUT_OP_IEQ_LL_JF),
+		VM_LABEL(TUT_OP_INE_LL_JF),
+		VM_LABEL(TUT_OP_ILT_LK_JF),
+		VM_LABEL(TUT_OP_ILTE_LK_JF),
+		VM_LABEL(TUT_OP_IGT_LK_JF),
+		VM_LABEL(TUT_OP_IGTE_LK_JF),
+		VM_LABEL(TUT_OP_IEQ_LK_JF),
+		VM_LABEL(TUT_OP_INE_LK_JF),
+		VM_LABEL(TUT_OP_INCLOCAL),
+		VM_LABEL(TUT_OP_GETFIELD_L),
+		VM_LABEL(TUT_OP_TAG),
+		VM_LABEL(TUT_OP_LAND),
+		VM_LABEL(TUT_OP_LOR),
+		VM_LABEL(TUT_OP_LNOT),
+		VM_LABEL(TUT_OP_ILT),
+		VM_LABEL(TUT_OP_IGT),
+		VM_LABEL(TUT_OP_ILTE),
+		VM_LABEL(TUT_OP_IGTE),
+		VM_LABEL(TUT_OP_IEQ),
+		VM_LABEL(TUT_OP_INE),
+		VM_LABEL(TUT_OP_INEG),
+		VM_LABEL(TUT_OP_FLT),
+		VM_LABEL(TUT_OP_FGT),
+		VM_LABEL(TUT_OP_FLTE),
+		VM_LABEL(TUT_OP_FGTE),
+		VM_LABEL(TUT_OP_FEQ),
+		VM_LABEL(TUT_OP_FNE),
+		VM_LABEL(TUT_OP_FNEG),
+		VM_LABEL(TUT_OP_BEQ),
+		VM_LABEL(TUT_OP_SEQ),
+		VM_LABEL(TUT_OP_REQ),
+		VM_LABEL(TUT_OP_CALL),
+		VM_LABEL(TUT_OP_RET),
+		VM_LABEL(TUT_OP_RETVALN),
+		VM_LABEL(TUT_OP_RETVAL1),
+		VM_LABEL(TUT_OP_GOTO),
+		VM_LABEL(TUT_OP_GOTOFALSE),
+		VM_LABEL(TUT_OP_GOTOTRUE),
+		VM_LABEL(TUT_OP_HALT),
+	};
+#if defined(__GNUC__) || defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+	const TutProgram* program = vm->curProgram;
+	const uint8_t* code = program->code;
+	TutObject* stack = vm->stack;
+	int32_t stackSize = vm->stackSize;
+
+	int32_t pc = vm->pc;
+	int32_t sp = vm->sp;
+	int32_t fp = vm->fp;
+
+	// A negative budget means run until the program halts
+	int64_t steps = maxSteps < 0 ? INT64_MAX : maxSteps;
+
+	if (pc < 0) return;
+
+	// Same as a call for the code at the entry point
+	if (pc == 0)
+	{
+		VM_RESERVE_STACK(program->entryStackDepth);
+	}
+
+#ifdef TUT_VM_COMPUTED_GOTO
+	VM_DISPATCH();
+#else
+	for (;;)
+	{
+		if (--steps < 0) goto suspend;
+		DEBUG_TRACE();
+
+		switch (code[pc++])
+		{
+#endif
+
+	VM_CASE(TUT_OP_PUSH_TRUE)
+	{
+		DEBUG_CYCLE(TUT_OP_PUSH_TRUE, "");
+		VM_PUSH_BOOL(TUT_TRUE);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_PUSH_FALSE)
+	{
+		DEBUG_CYCLE(TUT_OP_PUSH_FALSE, "");
+		VM_PUSH_BOOL(TUT_FALSE);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_PUSH_INT)
+	{
+		int32_t index = Tut_ReadInt32(code, pc);
+		pc += 4;
+
+		int32_t value = TUT_ARRAY_GET_CONST_VALUE(&program->integers, index, int32_t);
+		VM_PUSH_INT(value);
+
+		DEBUG_CYCLE(TUT_OP_PUSH_INT, "%d", value);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_PUSH_FLOAT)
+	{
+		int32_t index = Tut_ReadInt32(code, pc);
+		pc += 4;
+
+		float value = TUT_ARRAY_GET_CONST_VALUE(&program->floats, index, float);
+		VM_PUSH_FLOAT(value);
+
+		DEBUG_CYCLE(TUT_OP_PUSH_FLOAT, "%f", value);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_PUSH_I8)
+	{
+		int32_t value = Tut_ReadInt8(code, pc);
+		pc += 1;
+
+		VM_PUSH_INT(value);
+
+		DEBUG_CYCLE(TUT_OP_PUSH_I8, "%d", value);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_PUSH_I32)
+	{
+		int32_t value = Tut_ReadInt32(code, pc);
+		pc += 4;
+
+		VM_PUSH_INT(value);
+
+		DEBUG_CYCLE(TUT_OP_PUSH_I32, "%d", value);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_PUSH_F32)
+	{
+		float value = Tut_ReadFloat(code, pc);
+		pc += 4;
+
+		VM_PUSH_FLOAT(value);
+
+		DEBUG_CYCLE(TUT_OP_PUSH_F32, "%f", value);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_PUSH_STR)
+	{
+		int32_t index = Tut_ReadInt32(code, pc);
+		pc += 4;
+
+		char* data = TUT_ARRAY_GET_CONST_VALUE(&program->strings, index, char*);
+		VM_PUSH_POINTER(TUT_OBJECT_CSTR, data);
+
+		DEBUG_CYCLE(TUT_OP_PUSH_STR, "%s", data);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_PUSH_NULL)
+	{
+		VM_PUSH_REF(NULL);
+
+		DEBUG_CYCLE(TUT_OP_PUSH_NULL, "");
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_MAKEGLOBALREF)
+	{
+		int32_t index = Tut_ReadInt32(code, pc);
+		pc += 4;
+
+		VM_PUSH_REF(&vm->globals[index]);
+
+		DEBUG_CYCLE(TUT_OP_MAKEGLOBALREF, "%d (%x)", index, (uintptr_t)(&vm->globals[index]));
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_MAKELOCALREF)
+	{
+		int32_t index = Tut_ReadInt32(code, pc);
+		pc += 4;
+
+		VM_PUSH_REF(&stack[fp + index]);
+
+		DEBUG_CYCLE(TUT_OP_MAKELOCALREF, "%d (%x)", index, (uintptr_t)(&stack[fp + index]));
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_MAKEDYNAMICREF)
+	{
+		uint16_t offset = Tut_ReadUint16(code, pc);
+		pc += 2;
+
+		VM_CHECK_POP(1);
+
+		TutObject* ref = TUT_OBJECT_REF(stack[sp - 1]);
+		TUT_OBJECT_SET_REF(stack[sp - 1], TUT_OBJECT_REF, &ref[offset]);
+
+		DEBUG_CYCLE(TUT_OP_MAKEDYNAMICREF, "%d (%x)", offset, (uintptr_t)(&ref[offset]));
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_MAKEFUNC)
+	{
+		int32_t index = Tut_ReadInt32(code, pc);
+		pc += 4;
+
+		VM_CHECK_PUSH(1);
+
+		TUT_OBJECT_SET_FUNC(stack[sp], TUT_FALSE, index);
+		++sp;
+
+		DEBUG_CYCLE(TUT_OP_MAKEFUNC, "%d", index);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_MAKEEXTERNFUNC)
+	{
+		int32_t index = Tut_ReadInt32(code, pc);
+		pc += 4;
+
+		VM_CHECK_PUSH(1);
+
+		TUT_OBJECT_SET_FUNC(stack[sp], TUT_TRUE, index);
+		++sp;
+
+		DEBUG_CYCLE(TUT_OP_MAKEEXTERNFUNC, "%s(%d)", TUT_ARRAY_GET_CONST_VALUE(&program->externNames, index, const char*), index);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_PUSHN)
+	{
+		uint16_t n = Tut_ReadUint16(code, pc);
+		pc += 2;
+
+		VM_CHECK_PUSH(n);
+		sp += n;
+
+		DEBUG_CYCLE(TUT_OP_PUSHN, "%d", n);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_PUSH1)
+	{
+		VM_CHECK_PUSH(1);
+		++sp;
+
+		DEBUG_CYCLE(TUT_OP_PUSH1, "");
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_POPN)
+	{
+		uint16_t n = Tut_ReadUint16(code, pc);
+		pc += 2;
+
+		VM_CHECK_POP(n);
+		sp -= n;
+
+		DEBUG_CYCLE(TUT_OP_POPN, "%d", n);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_POP1)
+	{
+		VM_CHECK_POP(1);
+		--sp;
+
+		DEBUG_CYCLE(TUT_OP_POP1, "");
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_MOVEN)
+	{
+		uint16_t numObjects = Tut_ReadUint16(code, pc);
+		pc += 2;
+		uint16_t stackSpaces = Tut_ReadUint16(code, pc);
+		pc += 2;
+
+		VM_CHECK_POP(numObjects + stackSpaces);
+
+		int32_t targetSp = sp - numObjects - stackSpaces;
+
+		memmove(&stack[targetSp], &stack[sp - numObjects], sizeof(TutObject) * numObjects);
+		sp = targetSp + numObjects;
+
+		DEBUG_CYCLE(TUT_OP_MOVEN, "%d, %d", numObjects, stackSpaces);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_MOVE1)
+	{
+		uint16_t stackSpaces = Tut_ReadUint16(code, pc);
+		pc += 2;
+
+		VM_CHECK_POP(1 + stackSpaces);
+
+		int32_t targetSp = sp - 1 - stackSpaces;
+
+		stack[targetSp] = stack[sp - 1];
+		sp = targetSp + 1;
+
+		DEBUG_CYCLE(TUT_OP_MOVE1, "%d", stackSpaces);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_GETGLOBALN)
+	{
+		uint16_t numObjects = Tut_ReadUint16(code, pc);
+		pc += 2;
+
+		int32_t index = Tut_ReadInt32(code, pc);
+		pc += 4;
+
+		VM_CHECK_PUSH(numObjects);
+
+		memcpy(&stack[sp], &vm->globals[index], sizeof(TutObject) * numObjects);
+		sp += numObjects;
+
+		DEBUG_CYCLE(TUT_OP_GETGLOBALN, "%d, %d", numObjects, index);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_GETGLOBAL1)
+	{
+		int32_t index = Tut_ReadInt32(code, pc);
+		pc += 4;
+
+		VM_PUSH(&vm->globals[index]);
+
+		DEBUG_CYCLE(TUT_OP_GETGLOBAL1, "%d", index);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_SETGLOBALN)
+	{
+		uint16_t numObjects = Tut_ReadUint16(code, pc);
+		pc += 2;
+
+		int32_t index = Tut_ReadInt32(code, pc);
+		pc += 4;
+
+		VM_CHECK_POP(numObjects);
+
+		memcpy(&vm->globals[index], &stack[sp - numObjects], sizeof(TutObject) * numObjects);
+		sp -= numObjects;
+
+		DEBUG_CYCLE(TUT_OP_SETGLOBALN, "%d, %d", numObjects, index);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_SETGLOBAL1)
+	{
+		int32_t index = Tut_ReadInt32(code, pc);
+		pc += 4;
+
+		VM_POP(&vm->globals[index]);
+
+		DEBUG_CYCLE(TUT_OP_SETGLOBAL1, "%d", index);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_GETLOCALN)
+	{
+		uint16_t numObjects = Tut_ReadUint16(code, pc);
+		pc += 2;
+
+		int32_t index = Tut_ReadInt32(code, pc);
+		pc += 4;
+
+		VM_CHECK_PUSH(numObjects);
+
+		memcpy(&stack[sp], &stack[fp + index], sizeof(TutObject) * numObjects);
+		sp += numObjects;
+
+		DEBUG_CYCLE(TUT_OP_GETLOCALN, "%d, %d", numObjects, index);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_GETLOCAL1)
+	{
+		int32_t index = Tut_ReadInt32(code, pc);
+		pc += 4;
+
+		VM_PUSH(&stack[fp + index]);
+
+		DEBUG_CYCLE(TUT_OP_GETLOCAL1, "%d", index);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_SETLOCALN)
+	{
+		uint16_t numObjects = Tut_ReadUint16(code, pc);
+		pc += 2;
+
+		int32_t index = Tut_ReadInt32(code, pc);
+		pc += 4;
+
+		VM_CHECK_POP(numObjects);
+
+		memcpy(&stack[fp + index], &stack[sp - numObjects], sizeof(TutObject) * numObjects);
+		sp -= numObjects;
+
+		DEBUG_CYCLE(TUT_OP_SETLOCALN, "%d, %d", numObjects, index);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_SETLOCAL1)
+	{
+		int32_t index = Tut_ReadInt32(code, pc);
+		pc += 4;
+
+		VM_POP(&stack[fp + index]);
+
+		DEBUG_CYCLE(TUT_OP_SETLOCAL1, "%d", index);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_GETREFN)
+	{
+		uint16_t numObjects = Tut_ReadUint16(code, pc);
+		pc += 2;
+
+		uint16_t offset = Tut_ReadUint16(code, pc);
+		pc += 2;
+
+		TutObject* ref;
+		VM_POP_REF(ref);
+
+		VM_CHECK_PUSH(numObjects);
+
+		memcpy(&stack[sp], &ref[offset], sizeof(TutObject) * numObjects);
+		sp += numObjects;
+
+		DEBUG_CYCLE(TUT_OP_GETREFN, "%x, %d", (uintptr_t)ref, numObjects);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_GETREF1)
+	{
+		uint16_t offset = Tut_ReadUint16(code, pc);
+		pc += 2;
+
+		VM_CHECK_POP(1);
+
+		TutObject* ref = TUT_OBJECT_REF(stack[sp - 1]);
+		stack[sp - 1] = ref[offset];
+
+		DEBUG_CYCLE(TUT_OP_GETREF1, "%x", (uintptr_t)ref);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_SETREFN)
+	{
+		uint16_t numObjects = Tut_ReadUint16(code, pc);
+		pc += 2;
+
+		uint16_t offset = Tut_ReadUint16(code, pc);
+		pc += 2;
+
+		TutObject* ref;
+		VM_POP_REF(ref);
+
+		VM_CHECK_POP(numObjects);
+
+		memcpy(&ref[offset], &stack[sp - numObjects], sizeof(TutObject) * numObjects);
+		sp -= numObjects;
+
+		DEBUG_CYCLE(TUT_OP_SETREFN, "%x, %d", (uintptr_t)ref, numObjects);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_SETREF1)
+	{
+		uint16_t offset = Tut_ReadUint16(code, pc);
+		pc += 2;
+
+		TutObject* ref;
+		VM_POP_REF(ref);
+		VM_POP(&ref[offset]);
+
+		DEBUG_CYCLE(TUT_OP_SETREF1, "%x", (uintptr_t)ref);
+	} VM_NEXT();
+
+	// Binary operators pop b, then a, and push (a op b) back in place of a
+#define BIN_OP(name, field, resultType, resultField, op, format) \
+	VM_CASE(name) \
+	{ \
+		VM_CHECK_POP(2); \
+		--sp; \
+		DEBUG_CYCLE(name, format ", " format, stack[sp - 1].field, stack[sp].field); \
+		stack[sp - 1].resultField = stack[sp - 1].field op stack[sp].field; \
+		VM_SET_TYPE(stack[sp - 1], (resultType)); \
+	} VM_NEXT();
+
+#define BIN_OP_INT(name, op) BIN_OP(name, iv, TUT_OBJECT_INT, iv, op, "%d")
+#define BIN_OP_FLOAT(name, op) BIN_OP(name, fv, TUT_OBJECT_FLOAT, fv, op, "%f")
+#define CMP_OP_INT(name, op) BIN_OP(name, iv, TUT_OBJECT_BOOL, bv, op, "%d")
+#define CMP_OP_FLOAT(name, op) BIN_OP(name, fv, TUT_OBJECT_BOOL, bv, op, "%g")
+
+	BIN_OP_INT(TUT_OP_ADDI, +)
+	BIN_OP_INT(TUT_OP_SUBI, -)
+	BIN_OP_INT(TUT_OP_MULI, *)
+	BIN_OP_INT(TUT_OP_DIVI, /)
+
+	BIN_OP_FLOAT(TUT_OP_ADDF, +)
+	BIN_OP_FLOAT(TUT_OP_SUBF, -)
+	BIN_OP_FLOAT(TUT_OP_MULF, *)
+	BIN_OP_FLOAT(TUT_OP_DIVF, /)
+
+	// Register forms: dst, a (and b) are int16 frame slots
+#define LOCAL_OP_LLL(name, field, objType, op, format) \
+	VM_CASE(name) \
+	{ \
+		int16_t dst = Tut_ReadInt16(code, pc); \
+		int16_t a = Tut_ReadInt16(code, pc + 2); \
+		int16_t b = Tut_ReadInt16(code, pc + 4); \
+		pc += 6; \
+		DEBUG_CYCLE(name, "%d, %d, %d (" format ", " format ")", dst, a, b, stack[fp + a].field, stack[fp + b].field); \
+		stack[fp + dst].field = stack[fp + a].field op stack[fp + b].field; \
+		VM_SET_TYPE(stack[fp + dst], (objType)); \
+	} VM_NEXT();
+
+#define LOCAL_OP_LLK(name, field, objType, readValue, kType, op, format) \
+	VM_CASE(name) \
+	{ \
+		int16_t dst = Tut_ReadInt16(code, pc); \
+		int16_t a = Tut_ReadInt16(code, pc + 2); \
+		kType k = readValue(code, pc + 4); \
+		pc += 8; \
+		DEBUG_CYCLE(name, "%d, %d, " format " (" format ")", dst, a, k, stack[fp + a].field); \
+		stack[fp + dst].field = stack[fp + a].field op k; \
+		VM_SET_TYPE(stack[fp + dst], (objType)); \
+	} VM_NEXT();
+
+	LOCAL_OP_LLL(TUT_OP_ADDI_LLL, iv, TUT_OBJECT_INT, +, "%d")
+	LOCAL_OP_LLL(TUT_OP_SUBI_LLL, iv, TUT_OBJECT_INT, -, "%d")
+	LOCAL_OP_LLL(TUT_OP_MULI_LLL, iv, TUT_OBJECT_INT, *, "%d")
+	LOCAL_OP_LLL(TUT_OP_DIVI_LLL, iv, TUT_OBJECT_INT, /, "%d")
+
+	LOCAL_OP_LLK(TUT_OP_ADDI_LLK, iv, TUT_OBJECT_INT, Tut_ReadInt32, int32_t, +, "%d")
+	LOCAL_OP_LLK(TUT_OP_SUBI_LLK, iv, TUT_OBJECT_INT, Tut_ReadInt32, int32_t, -, "%d")
+	LOCAL_OP_LLK(TUT_OP_MULI_LLK, iv, TUT_OBJECT_INT, Tut_ReadInt32, int32_t, *, "%d")
+	LOCAL_OP_LLK(TUT_OP_DIVI_LLK, iv, TUT_OBJECT_INT, Tut_ReadInt32, int32_t, /, "%d")
+
+	LOCAL_OP_LLL(TUT_OP_ADDF_LLL, fv, TUT_OBJECT_FLOAT, +, "%f")
+	LOCAL_OP_LLL(TUT_OP_SUBF_LLL, fv, TUT_OBJECT_FLOAT, -, "%f")
+	LOCAL_OP_LLL(TUT_OP_MULF_LLL, fv, TUT_OBJECT_FLOAT, *, "%f")
+	LOCAL_OP_LLL(TUT_OP_DIVF_LLL, fv, TUT_OBJECT_FLOAT, /, "%f")
+
+	LOCAL_OP_LLK(TUT_OP_ADDF_LLK, fv, TUT_OBJECT_FLOAT, Tut_ReadFloat, float, +, "%f")
+	LOCAL_OP_LLK(TUT_OP_SUBF_LLK, fv, TUT_OBJECT_FLOAT, Tut_ReadFloat, float, -, "%f")
+	LOCAL_OP_LLK(TUT_OP_MULF_LLK, fv, TUT_OBJECT_FLOAT, Tut_ReadFloat, float, *, "%f")
+	LOCAL_OP_LLK(TUT_OP_DIVF_LLK, fv, TUT_OBJECT_FLOAT, Tut_ReadFloat, float, /, "%f")
+
+#undef LOCAL_OP_LLL
+#undef LOCAL_OP_LLK
+
+	// Compare and branch: the loop condition 'while i < n' is a single dispatch
+#define LOCAL_CMP_LL_JF(name, op) \
+	VM_CASE(name) \
+	{ \
+		int16_t a = Tut_ReadInt16(code, pc); \
+		int16_t b = Tut_ReadInt16(code, pc + 2); \
+		int32_t target = Tut_ReadInt32(code, pc + 4); \
+		DEBUG_CYCLE(name, "%d, %d, %d (%d, %d)", a, b, target, stack[fp + a].iv, stack[fp + b].iv); \
+		pc = stack[fp + a].iv op stack[fp + b].iv ? pc + 8 : target; \
+	} VM_NEXT();
+
+#define LOCAL_CMP_LK_JF(name, op) \
+	VM_CASE(name) \
+	{ \
+		int16_t a = Tut_ReadInt16(code, pc); \
+		int32_t k = Tut_ReadInt32(code, pc + 2); \
+		int32_t target = Tut_ReadInt32(code, pc + 6); \
+		DEBUG_CYCLE(name, "%d, %d, %d (%d)", a, k, target, stack[fp + a].iv); \
+		pc = stack[fp + a].iv op k ? pc + 10 : target; \
+	} VM_NEXT();
+
+	LOCAL_CMP_LL_JF(TUT_OP_ILT_LL_JF, <)
+	LOCAL_CMP_LL_JF(TUT_OP_ILTE_LL_JF, <=)
+	LOCAL_CMP_LL_JF(TUT_OP_IEQ_LL_JF, ==)
+	LOCAL_CMP_LL_JF(TUT_OP_INE_LL_JF, !=)
+
+	LOCAL_CMP_LK_JF(TUT_OP_ILT_LK_JF, <)
+	LOCAL_CMP_LK_JF(TUT_OP_ILTE_LK_JF, <=)
+	LOCAL_CMP_LK_JF(TUT_OP_IGT_LK_JF, >)
+	LOCAL_CMP_LK_JF(TUT_OP_IGTE_LK_JF, >=)
+	LOCAL_CMP_LK_JF(TUT_OP_IEQ_LK_JF, ==)
+	LOCAL_CMP_LK_JF(TUT_OP_INE_LK_JF, !=)
+
+#undef LOCAL_CMP_LL_JF
+#undef LOCAL_CMP_LK_JF
+
+	VM_CASE(TUT_OP_INCLOCAL)
+	{
+		int16_t a = Tut_ReadInt16(code, pc);
+		int32_t k = Tut_ReadInt32(code, pc + 2);
+		pc += 6;
+
+		DEBUG_CYCLE(TUT_OP_INCLOCAL, "%d, %d (%d)", a, k, stack[fp + a].iv);
+
+		stack[fp + a].iv += k;
+		VM_SET_TYPE(stack[fp + a], TUT_OBJECT_INT);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_GETFIELD_L)
+	{
+		int16_t a = Tut_ReadInt16(code, pc);
+		uint16_t offset = Tut_ReadUint16(code, pc + 2);
+		pc += 4;
+
+		VM_PUSH(&TUT_OBJECT_REF(stack[fp + a])[offset]);
+
+		DEBUG_CYCLE(TUT_OP_GETFIELD_L, "%d, %d (%x)", a, offset, (uintptr_t)TUT_OBJECT_REF(stack[fp + a]));
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_TAG)
+	{
+		uint16_t depth = Tut_ReadUint16(code, pc);
+		uint8_t type = Tut_ReadUint8(code, pc + 2);
+		pc += 3;
+
+		VM_CHECK_POP(depth);
+
+		// Untagged loops tag too, that's what this is for
+		TUT_OBJECT_SET_TYPE(stack[sp - depth], type);
+
+		DEBUG_CYCLE(TUT_OP_TAG, "%d, %d", depth, type);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_LAND)
+	{
+		VM_CHECK_POP(2);
+		--sp;
+
+		TutBool a = (TutBool)stack[sp - 1].bv, b = (TutBool)stack[sp].bv;
+
+		VM_SET_TYPE(stack[sp - 1], TUT_OBJECT_BOOL);
+		stack[sp - 1].bv = a && b;
+
+		DEBUG_CYCLE(TUT_OP_LAND, "%d, %d", a, b);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_LOR)
+	{
+		VM_CHECK_POP(2);
+		--sp;
+
+		TutBool a = (TutBool)stack[sp - 1].bv, b = (TutBool)stack[sp].bv;
+
+		VM_SET_TYPE(stack[sp - 1], TUT_OBJECT_BOOL);
+		stack[sp - 1].bv = a || b;
+
+		DEBUG_CYCLE(TUT_OP_LOR, "%d, %d", a, b);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_LNOT)
+	{
+		VM_CHECK_POP(1);
+
+		TutBool a = (TutBool)stack[sp - 1].bv;
+
+		VM_SET_TYPE(stack[sp - 1], TUT_OBJECT_BOOL);
+		stack[sp - 1].bv = !a;
+
+		DEBUG_CYCLE(TUT_OP_LNOT, "%d", a);
+	} VM_NEXT();
+
+	CMP_OP_INT(TUT_OP_ILT, <)
+	CMP_OP_INT(TUT_OP_IGT, >)
+	CMP_OP_INT(TUT_OP_ILTE, <=)
+	CMP_OP_INT(TUT_OP_IGTE, >=)
+	CMP_OP_INT(TUT_OP_IEQ, ==)
+	CMP_OP_INT(TUT_OP_INE, !=)
+
+	VM_CASE(TUT_OP_INEG)
+	{
+		VM_CHECK_POP(1);
+
+		DEBUG_CYCLE(TUT_OP_INEG, "%d", stack[sp - 1].iv);
+		stack[sp - 1].iv = -stack[sp - 1].iv;
+	} VM_NEXT();
+
+	CMP_OP_FLOAT(TUT_OP_FLT, <)
+	CMP_OP_FLOAT(TUT_OP_FGT, >)
+	CMP_OP_FLOAT(TUT_OP_FLTE, <=)
+	CMP_OP_FLOAT(TUT_OP_FGTE, >=)
+	CMP_OP_FLOAT(TUT_OP_FEQ, ==)
+	CMP_OP_FLOAT(TUT_OP_FNE, !=)
+
+	VM_CASE(TUT_OP_FNEG)
+	{
+		VM_CHECK_POP(1);
+
+		DEBUG_CYCLE(TUT_OP_FNEG, "%g", stack[sp - 1].fv);
+		stack[sp - 1].fv = -stack[sp - 1].fv;
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_BEQ)
+	{
+		VM_CHECK_POP(2);
+		--sp;
+
+		TutBool a = (TutBool)stack[sp - 1].bv, b = (TutBool)stack[sp].bv;
+
+		VM_SET_TYPE(stack[sp - 1], TUT_OBJECT_BOOL);
+		stack[sp - 1].bv = a == b;
+
+		DEBUG_CYCLE(TUT_OP_BEQ, "%s, %s", a ? "true" : "false", b ? "true" : "false");
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_SEQ)
+	{
+		VM_CHECK_POP(2);
+		--sp;
+
+		const char* a = TUT_OBJECT_STR(stack[sp - 1]);
+		const char* b = TUT_OBJECT_STR(stack[sp]);
+
+		VM_SET_TYPE(stack[sp - 1], TUT_OBJECT_BOOL);
+		stack[sp - 1].bv = strcmp(a, b) == 0;
+
+		DEBUG_CYCLE(TUT_OP_SEQ, "%s, %s", a, b);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_REQ)
+	{
+		VM_CHECK_POP(2);
+		--sp;
+
+		const void* a = TUT_OBJECT_REF(stack[sp - 1]);
+		const void* b = TUT_OBJECT_REF(stack[sp]);
+
+		VM_SET_TYPE(stack[sp - 1], TUT_OBJECT_BOOL);
+		stack[sp - 1].bv = a == b;
+
+		DEBUG_CYCLE(TUT_OP_REQ, "%x, %x", (uintptr_t)a, (uintptr_t)b);
+	} VM_NEXT();
+
+#undef BIN_OP
+#undef BIN_OP_INT
+#undef BIN_OP_FLOAT
+#undef CMP_OP_INT
+#undef CMP_OP_FLOAT
+
+	VM_CASE(TUT_OP_CALL)
+	{
+		uint16_t nargs = Tut_ReadUint16(code, pc);
+		uint16_t nret = Tut_ReadUint16(code, pc + 2);
+		pc += 4;
+
+		TutObject callee;
+		VM_POP(&callee);
+
+		TutFunctionObject func;
+		func.isExtern = TUT_OBJECT_FUNC_IS_EXTERN(callee);
+		func.index = TUT_OBJECT_FUNC_INDEX(callee);
+
+		if (!func.isExtern)
+		{
+			assert(func.index >= 0 && func.index < program->functionPcs.length);
+
+			TutReturnFrame frame;
+
+			frame.nargs = nargs;
+			frame.pc = pc;
+			frame.fp = fp;
+			frame.program = program;
+
+			Tut_ArrayPush(&vm->returnFrames, &frame);
+
+			// Calls made by code which was reloaded go to the new code
+			program = vm->program;
+			code = program->code;
+
+			// The verifier can't tell which function is called through a function
+			// value, so its depth only holds if the call agrees with it
+			const TutFunctionArity* arity = Tut_ArrayGetConst(&program->functionArities, func.index);
+
+			if (nargs < arity->numArgs || (arity->numReturns >= 0 && nret != arity->numReturns))
+				goto badCall;
+
+			pc = TUT_ARRAY_GET_CONST_VALUE(&program->functionPcs, func.index, int32_t);
+			fp = sp;
+
+			// The only check the function's pushes need
+			VM_RESERVE_STACK(TUT_ARRAY_GET_CONST_VALUE(&program->functionStackDepths, func.index, int32_t));
+
+			DEBUG_CYCLE(TUT_OP_CALL, "%d, %d", func.index, nargs);
+		}
+		else
+		{
+			DEBUG_CYCLE(TUT_OP_CALL, "extern %s, %d", TUT_ARRAY_GET_CONST_VALUE(&program->externNames, func.index, const char*), nargs);
+			assert(func.index >= 0 && func.index < program->externs.length);
+
+			TutVMExternFunction ext = TUT_ARRAY_GET_CONST_VALUE(&program->externs, func.index, TutVMExternFunction);
+
+			// Externs push their return values through the public api
+			VM_SYNC();
+
+			uint16_t numObjects = ext(vm, &stack[sp - nargs], nargs);
+
+			memmove(&stack[sp - nargs], &stack[sp], sizeof(TutObject) * numObjects);
+			sp = sp - nargs + numObjects;
+
+			if (vm->pc < 0)
+				goto halt;
+
+			// Anything else throws off the depths the caller was verified with
+			if (numObjects != nret)
+				goto badCall;
+		}
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_RET)
+	{
+		DEBUG_CYCLE(TUT_OP_RET, "");
+
+		if (vm->returnFrames.length <= 0)
+			goto halt;
+
+		TutReturnFrame frame;
+		Tut_ArrayPop(&vm->returnFrames, &frame);
+
+		sp = fp - frame.nargs;
+		fp = frame.fp;
+		pc = frame.pc;
+
+		program = frame.program;
+		code = program->code;
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_RETVALN)
+	{
+		uint16_t numObjects = Tut_ReadUint16(code, pc);
+		pc += 2;
+
+		VM_CHECK_POP(numObjects);
+
+		int32_t copySp = sp - numObjects;
+
+		if (vm->returnFrames.length <= 0)
+			goto halt;
+
+		TutReturnFrame frame;
+		Tut_ArrayPop(&vm->returnFrames, &frame);
+
+		sp = fp - frame.nargs;
+		fp = frame.fp;
+		pc = frame.pc;
+
+		program = frame.program;
+		code = program->code;
+
+		memmove(&stack[sp], &stack[copySp], sizeof(TutObject) * numObjects);
+		sp += numObjects;
+
+		DEBUG_CYCLE(TUT_OP_RETVALN, "%d", numObjects);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_RETVAL1)
+	{
+		TutObject object;
+		VM_POP(&object);
+
+		if (vm->returnFrames.length <= 0)
+			goto halt;
+
+		TutReturnFrame frame;
+		Tut_ArrayPop(&vm->returnFrames, &frame);
+
+		sp = fp - frame.nargs;
+		fp = frame.fp;
+		pc = frame.pc;
+
+		program = frame.program;
+		code = program->code;
+
+		stack[sp++] = object;
+
+		DEBUG_CYCLE(TUT_OP_RETVAL1, "");
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_GOTO)
+	{
+		pc = Tut_ReadInt32(code, pc);
+		DEBUG_CYCLE(TUT_OP_GOTO, "%d", pc);
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_GOTOFALSE)
+	{
+		int32_t target = Tut_ReadInt32(code, pc);
+		DEBUG_CYCLE(TUT_OP_GOTOFALSE, "%d", target);
+
+		pc += 4;
+
+		TutBool value;
+		VM_POP_VALUE(value, bv);
+
+		if (!value)
+			pc = target;
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_GOTOTRUE)
+	{
+		int32_t target = Tut_ReadInt32(code, pc);
+		DEBUG_CYCLE(TUT_OP_GOTOTRUE, "%d", target);
+
+		pc += 4;
+
+		TutBool value;
+		VM_POP_VALUE(value, bv);
+
+		if (value)
+			pc = target;
+	} VM_NEXT();
+
+	VM_CASE(TUT_OP_HALT)
+	{
+		DEBUG_CYCLE(TUT_OP_HALT, "");
+		goto halt;
+	} VM_NEXT();
+
+#ifdef TUT_VM_COMPUTED_GOTO
+	op_INVALID:
+#else
+		default:
+#endif
+	{
+		fprintf(stderr, "Invalid opcode %d at pc %d.\n", code[pc - 1], pc - 1);
+		goto halt;
+	}
+
+#ifndef TUT_VM_COMPUTED_GOTO
+		}
+	}
+#endif
+
+suspend:
+	VM_SYNC();
+	return;
+
+stackOverflow:
+	fprintf(stderr, "VM Stack Overflow!\n");
+	goto halt;
+
+badCall:
+	fprintf(stderr, "VM Call Doesn't Match Function!\n");
+	goto halt;
+
+#if TUT_VM_LOOP_DEBUG
+stackUnderflow:
+	fprintf(stderr, "VM Stack Underflow!\n");
+	goto halt;
+#endif
+
+halt:
+	VM_SYNC();
+	vm->pc = -1;
+}
+
+#undef DEBUG_CYCLE
+#undef DEBUG_TRACE
+#undef VM_SYNC
+#undef VM_SET_TYPE
+#undef VM_GROW_STACK
+#undef VM_RESERVE_STACK
+#undef VM_CHECK_PUSH
+#undef VM_CHECK_POP
+#undef VM_PUSH
+#undef VM_POP
+#undef VM_PUSH_VALUE
+#undef VM_POP_VALUE
+#undef VM_PUSH_POINTER
+#undef VM_POP_REF
+#undef VM_PUSH_BOOL
+#undef VM_PUSH_INT
+#undef VM_PUSH_FLOAT
+#undef VM_PUSH_REF
+#undef VM_CASE
+#undef VM_NEXT
+#ifdef TUT_VM_COMPUTED_GOTO
+#undef VM_DISPATCH
+#undef VM_LABEL
+#endif
+
+#undef TUT_VM_LOOP_NAME
+#undef TUT_VM_LOOP_DEBUG
+#undef TUT_VM_LOOP_UNTAGGED